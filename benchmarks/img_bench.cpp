@@ -0,0 +1,639 @@
+// Microbenchmarks for the dpso_img kernels.
+//
+// Measures toGray(), Upscale, UnsharpMask, and Preprocess on their
+// serial paths across pixel formats, image sizes, pitches, and blur
+// radii, and optionally compares the results with a baseline saved
+// by a previous run.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define DPSO_BENCH_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DPSO_BENCH_TSC 1
+#endif
+
+#include "dpso_img/ops.h"
+#include "dpso_img/px_format.h"
+#include "dpso_utils/line_reader.h"
+#include "dpso_utils/os_error.h"
+#include "dpso_utils/str.h"
+#include "dpso_utils/str_stdio.h"
+#include "dpso_utils/stream/file_stream.h"
+#include "dpso_utils/stream/utils.h"
+
+
+using namespace dpso;
+
+
+namespace {
+
+
+using Clock = std::chrono::steady_clock;
+
+
+struct Options {
+    std::string filter;
+    double minTimeS{0.2};
+    std::string baselinePath;
+    std::string saveBaselinePath;
+    double threshold{5};
+};
+
+
+void printHelp(std::string_view argv0)
+{
+    str::print("Usage\n");
+    str::print("    {} [options...]\n\n", argv0);
+
+    str::print(
+        "Measures the throughput of image processing kernels.\n"
+        "\n"
+        "Options\n"
+        "\n"
+        "  -help\n"
+        "      Print this help and exit.\n"
+        "  -filter TEXT\n"
+        "      Only run benchmarks with names containing TEXT.\n"
+        "  -min-time MS\n"
+        "      Minimum time of a measurement round. Default is\n"
+        "      200.\n"
+        "  -baseline FILE\n"
+        "      Compare the results with a baseline saved by\n"
+        "      -save-baseline. The exit status is non-zero if a\n"
+        "      benchmark is slower than the baseline by more than\n"
+        "      the threshold.\n"
+        "  -threshold PERCENT\n"
+        "      Regression threshold for -baseline. Default is 5.\n"
+        "  -save-baseline FILE\n"
+        "      Save the results as a baseline.\n"
+        "\n"
+        "Cycles are those of the time stamp counter, which runs at\n"
+        "a fixed reference frequency rather than the current core\n"
+        "frequency, and are only reported on x86.\n");
+}
+
+
+[[noreturn]]
+void exitWithError(std::string_view msg)
+{
+    str::print(stderr, "{}\n", msg);
+    std::exit(EXIT_FAILURE);
+}
+
+
+double parseDouble(std::string_view optName, const char* str)
+{
+    char* end;
+    const auto value = std::strtod(str, &end);
+    if (end == str || *end || !(value > 0))
+        exitWithError(
+            str::format(
+                "Invalid {} value \"{}\"; expected a positive number",
+                optName, str));
+
+    return value;
+}
+
+
+Options parseArgs(int argc, char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+
+        if (arg == "-help") {
+            printHelp(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+
+        if (i + 1 == argc)
+            exitWithError(
+                str::format(
+                    "Option \"{}\" is either unknown or requires a "
+                    "value. Use \"-help\" for a list of available "
+                    "options.",
+                    arg));
+
+        const auto* value = argv[++i];
+
+        if (arg == "-filter")
+            options.filter = value;
+        else if (arg == "-min-time")
+            options.minTimeS = parseDouble(arg, value) / 1000;
+        else if (arg == "-baseline")
+            options.baselinePath = value;
+        else if (arg == "-threshold")
+            options.threshold = parseDouble(arg, value);
+        else if (arg == "-save-baseline")
+            options.saveBaselinePath = value;
+        else
+            exitWithError(
+                str::format(
+                    "Unknown option \"{}\". Use \"-help\" for a list "
+                    "of available options.",
+                    arg));
+    }
+
+    return options;
+}
+
+
+struct Benchmark {
+    std::string name;
+    // Number of pixels processed by a single call of fn. For
+    // kernels that change the size, this is the size of the output.
+    std::int64_t numPx;
+    std::function<void()> fn;
+};
+
+
+struct Buffer {
+    int pitch;
+    std::vector<std::uint8_t> data;
+};
+
+
+// Pitches are either tight or padded by an odd number of bytes, so
+// that rows after the first are not aligned; some of the kernels are
+// sensitive to that.
+const struct {
+    const char* name;
+    int padding;
+} pitchKinds[]{
+    {"tight", 0},
+    {"padded", 61},
+};
+
+
+Buffer createBuffer(int w, int h, int bytesPerPx, int padding)
+{
+    Buffer result{w * bytesPerPx + padding, {}};
+    result.data.resize(static_cast<std::size_t>(result.pitch) * h);
+
+    // The kernels don't branch on pixel values, but avoid the
+    // degenerate case of a constant image anyway.
+    std::uint32_t state{12345};
+    for (auto& b : result.data) {
+        state = state * 1103515245 + 12345;
+        b = state >> 24;
+    }
+
+    return result;
+}
+
+
+std::string getSizeStr(int w, int h)
+{
+    return str::format("{}x{}", w, h);
+}
+
+
+void addToGrayBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const DpsoPxFormat pxFormats[]{
+        DpsoPxFormatGrayscale,
+        DpsoPxFormatRgb,
+        DpsoPxFormatBgr,
+        DpsoPxFormatRgba,
+        DpsoPxFormatBgra,
+        DpsoPxFormatArgb,
+        DpsoPxFormatAbgr,
+    };
+
+    const struct {
+        int w;
+        int h;
+    } sizes[]{
+        {640, 480},
+        {1920, 1080},
+    };
+
+    for (const auto pxFormat : pxFormats)
+        for (const auto& size : sizes)
+            for (const auto& pitchKind : pitchKinds) {
+                auto src = std::make_shared<Buffer>(
+                    createBuffer(
+                        size.w,
+                        size.h,
+                        dpsoPxFormatGetBytesPerPx(pxFormat),
+                        pitchKind.padding));
+                auto dst = std::make_shared<Buffer>(
+                    createBuffer(
+                        size.w, size.h, 1, pitchKind.padding));
+
+                benchmarks.push_back(
+                    {
+                        str::format(
+                            "toGray/{}/{}/{}",
+                            dpsoPxFormatToStr(pxFormat),
+                            getSizeStr(size.w, size.h),
+                            pitchKind.name),
+                        static_cast<std::int64_t>(size.w) * size.h,
+                        [=]
+                        {
+                            img::toGray(
+                                src->data.data(),
+                                src->pitch,
+                                pxFormat,
+                                dst->data.data(),
+                                dst->pitch,
+                                size.w,
+                                size.h);
+                        }});
+            }
+}
+
+
+void addUpscaleBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const struct {
+        int w;
+        int h;
+    } srcSizes[]{
+        {320, 240},
+        {960, 540},
+    };
+
+    const int scales[]{2, 4};
+
+    for (const auto& srcSize : srcSizes)
+        for (const auto scale : scales)
+            for (const auto& pitchKind : pitchKinds) {
+                const auto dstW = srcSize.w * scale;
+                const auto dstH = srcSize.h * scale;
+
+                auto src = std::make_shared<Buffer>(
+                    createBuffer(
+                        srcSize.w, srcSize.h, 1, pitchKind.padding));
+                auto dst = std::make_shared<Buffer>(
+                    createBuffer(dstW, dstH, 1, pitchKind.padding));
+                auto upscale = std::make_shared<img::Upscale>();
+
+                benchmarks.push_back(
+                    {
+                        str::format(
+                            "Upscale/x{}/{}/{}",
+                            scale,
+                            getSizeStr(srcSize.w, srcSize.h),
+                            pitchKind.name),
+                        static_cast<std::int64_t>(dstW) * dstH,
+                        [=]
+                        {
+                            (*upscale)(
+                                src->data.data(),
+                                srcSize.w,
+                                srcSize.h,
+                                src->pitch,
+                                dst->data.data(),
+                                dstW,
+                                dstH,
+                                dst->pitch);
+                        }});
+            }
+}
+
+
+// UnsharpMask is dominated by its box blur, so the radius is the
+// main parameter here.
+void addUnsharpMaskBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const struct {
+        int w;
+        int h;
+    } sizes[]{
+        {1280, 960},
+        {3840, 2160},
+    };
+
+    const int radii[]{1, 4, 10, 32};
+
+    for (const auto& size : sizes)
+        for (const auto radius : radii)
+            for (const auto& pitchKind : pitchKinds) {
+                auto src = std::make_shared<Buffer>(
+                    createBuffer(
+                        size.w, size.h, 1, pitchKind.padding));
+                auto dst = std::make_shared<Buffer>(
+                    createBuffer(
+                        size.w, size.h, 1, pitchKind.padding));
+                auto unsharpMask =
+                    std::make_shared<img::UnsharpMask>();
+
+                benchmarks.push_back(
+                    {
+                        str::format(
+                            "UnsharpMask/r{}/{}/{}",
+                            radius,
+                            getSizeStr(size.w, size.h),
+                            pitchKind.name),
+                        static_cast<std::int64_t>(size.w) * size.h,
+                        [=]
+                        {
+                            (*unsharpMask)(
+                                src->data.data(),
+                                src->pitch,
+                                dst->data.data(),
+                                dst->pitch,
+                                size.w,
+                                size.h,
+                                radius);
+                        }});
+            }
+}
+
+
+// The parameters match what dpso_ocr uses for typical screenshots.
+void addPreprocessBenchmarks(std::vector<Benchmark>& benchmarks)
+{
+    const DpsoPxFormat pxFormats[]{
+        DpsoPxFormatGrayscale,
+        DpsoPxFormatBgra,
+    };
+
+    const struct {
+        int w;
+        int h;
+    } srcSizes[]{
+        {320, 240},
+        {960, 540},
+    };
+
+    const auto scale = 4;
+    const auto radius = 10;
+
+    for (const auto pxFormat : pxFormats)
+        for (const auto& srcSize : srcSizes) {
+            const auto dstW = srcSize.w * scale;
+            const auto dstH = srcSize.h * scale;
+
+            auto src = std::make_shared<Buffer>(
+                createBuffer(
+                    srcSize.w,
+                    srcSize.h,
+                    dpsoPxFormatGetBytesPerPx(pxFormat),
+                    0));
+            auto dst = std::make_shared<Buffer>(
+                createBuffer(dstW, dstH, 1, 0));
+            auto preprocess = std::make_shared<img::Preprocess>();
+
+            benchmarks.push_back(
+                {
+                    str::format(
+                        "Preprocess/{}/x{}/r{}/{}",
+                        dpsoPxFormatToStr(pxFormat),
+                        scale,
+                        radius,
+                        getSizeStr(srcSize.w, srcSize.h)),
+                    static_cast<std::int64_t>(dstW) * dstH,
+                    [=]
+                    {
+                        (*preprocess)(
+                            src->data.data(),
+                            src->pitch,
+                            pxFormat,
+                            srcSize.w,
+                            srcSize.h,
+                            dst->data.data(),
+                            dst->pitch,
+                            dstW,
+                            dstH,
+                            radius);
+                    }});
+        }
+}
+
+
+std::vector<Benchmark> createBenchmarks()
+{
+    std::vector<Benchmark> result;
+
+    addToGrayBenchmarks(result);
+    addUpscaleBenchmarks(result);
+    addUnsharpMaskBenchmarks(result);
+    addPreprocessBenchmarks(result);
+
+    return result;
+}
+
+
+struct Measurement {
+    double mpxPerS;
+    // Negative if not available.
+    double cyclesPerPx;
+};
+
+
+std::uint64_t getCycles()
+{
+    #if DPSO_BENCH_TSC
+    return __rdtsc();
+    #else
+    return 0;
+    #endif
+}
+
+
+// Returns the best of several rounds, each taking at least
+// minTimeS, to filter out the noise from other processes.
+Measurement measure(const Benchmark& benchmark, double minTimeS)
+{
+    // Warm up caches and let the kernels allocate their buffers.
+    benchmark.fn();
+
+    const auto numRounds = 3;
+
+    double bestSPerCall{};
+    double bestCyclesPerCall{};
+
+    for (int round{}; round < numRounds; ++round) {
+        std::int64_t numCalls{};
+        const auto startTime = Clock::now();
+        const auto startCycles = getCycles();
+
+        std::chrono::duration<double> elapsed{};
+        do {
+            benchmark.fn();
+            ++numCalls;
+            elapsed = Clock::now() - startTime;
+        } while (elapsed.count() < minTimeS);
+
+        const auto sPerCall = elapsed.count() / numCalls;
+        const auto cyclesPerCall =
+            static_cast<double>(getCycles() - startCycles)
+            / numCalls;
+
+        if (round == 0 || sPerCall < bestSPerCall) {
+            bestSPerCall = sPerCall;
+            bestCyclesPerCall = cyclesPerCall;
+        }
+    }
+
+    return {
+        benchmark.numPx / bestSPerCall / 1e6,
+        #if DPSO_BENCH_TSC
+        bestCyclesPerCall / benchmark.numPx
+        #else
+        -1
+        #endif
+    };
+}
+
+
+// The baseline file consists of lines in the form "name mpxPerS".
+// Empty lines and lines starting with # are ignored.
+using Baseline = std::map<std::string, double, std::less<>>;
+
+
+Baseline loadBaseline(const std::string& filePath)
+{
+    Baseline result;
+
+    try {
+        FileStream file{filePath, FileStream::Mode::read};
+        LineReader lineReader{file};
+
+        std::string line;
+        for (int lineNum = 1; lineReader.readLine(line); ++lineNum) {
+            const auto l = str::trim(line, str::isSpace);
+            if (l.empty() || l[0] == '#')
+                continue;
+
+            const auto sepPos = l.find(' ');
+            const std::string valueStr{
+                sepPos == l.npos
+                    ? std::string_view{} : l.substr(sepPos + 1)};
+
+            char* end;
+            const auto value = std::strtod(valueStr.c_str(), &end);
+            if (valueStr.empty() || *end || !(value > 0))
+                exitWithError(
+                    str::format(
+                        "{}:{}: Invalid baseline entry",
+                        filePath, lineNum));
+
+            result[std::string{l.substr(0, sepPos)}] = value;
+        }
+    } catch (std::runtime_error& e) {
+        exitWithError(
+            str::format(
+                "Can't load baseline from \"{}\": {}",
+                filePath, e.what()));
+    }
+
+    return result;
+}
+
+
+void saveBaseline(
+    const std::string& filePath,
+    const std::vector<std::pair<std::string, double>>& results)
+{
+    try {
+        FileStream file{filePath, FileStream::Mode::write};
+
+        write(file, "# Mpx/s of dpso_img_bench; see -baseline.\n");
+        for (const auto& [name, mpxPerS] : results)
+            write(file, str::format("{} {}\n", name, mpxPerS));
+    } catch (std::runtime_error& e) {
+        exitWithError(
+            str::format(
+                "Can't save baseline to \"{}\": {}",
+                filePath, e.what()));
+    }
+}
+
+
+std::string roundToStr(double v)
+{
+    return str::toStr(std::round(v * 10) / 10);
+}
+
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    const auto options = parseArgs(argc, argv);
+
+    Baseline baseline;
+    if (!options.baselinePath.empty())
+        baseline = loadBaseline(options.baselinePath);
+
+    const auto nameWidth = 40;
+
+    str::print(
+        "{} {} {}{}\n",
+        str::justifyLeft("Benchmark", nameWidth),
+        str::justifyRight("Mpx/s", 9),
+        str::justifyRight("cycles/px", 10),
+        baseline.empty() ? "" : str::justifyRight("vs base", 10));
+
+    std::vector<std::pair<std::string, double>> results;
+    int numRegressions{};
+
+    for (const auto& benchmark : createBenchmarks()) {
+        if (benchmark.name.find(options.filter) == std::string::npos)
+            continue;
+
+        const auto m = measure(benchmark, options.minTimeS);
+        results.emplace_back(benchmark.name, m.mpxPerS);
+
+        std::string cmpStr;
+        if (!baseline.empty()) {
+            const auto iter = baseline.find(benchmark.name);
+            if (iter == baseline.end())
+                cmpStr = "new";
+            else {
+                const auto changePercent =
+                    (m.mpxPerS / iter->second - 1) * 100;
+                cmpStr = str::format(
+                    "{}{}%",
+                    changePercent >= 0 ? "+" : "",
+                    roundToStr(changePercent));
+
+                if (changePercent < -options.threshold) {
+                    cmpStr += " !";
+                    ++numRegressions;
+                }
+            }
+
+            cmpStr = str::justifyRight(cmpStr, 10);
+        }
+
+        str::print(
+            "{} {} {}{}\n",
+            str::justifyLeft(benchmark.name, nameWidth),
+            str::justifyRight(roundToStr(m.mpxPerS), 9),
+            str::justifyRight(
+                m.cyclesPerPx < 0 ? "-" : roundToStr(m.cyclesPerPx),
+                10),
+            cmpStr);
+    }
+
+    if (!options.saveBaselinePath.empty())
+        saveBaseline(options.saveBaselinePath, results);
+
+    if (numRegressions > 0) {
+        str::print(
+            "\n{} benchmark(s) slower than the baseline by more "
+            "than {}%\n",
+            numRegressions, options.threshold);
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,583 @@
+// OCR throughput and latency benchmark.
+//
+// Runs a corpus of PNM images through the public dpso_ocr API and
+// reports jobs per second, per-job latency, per-stage latency from
+// dpsoOcrGetStats(), and the peak memory usage.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <poll.h>
+#include <sys/resource.h>
+#endif
+
+#include "dpso_img/pnm.h"
+#include "dpso_ocr/dpso_ocr.h"
+#include "dpso_utils/error_get.h"
+#include "dpso_utils/str.h"
+#include "dpso_utils/str_stdio.h"
+
+
+using namespace dpso;
+
+
+namespace {
+
+
+using Clock = std::chrono::steady_clock;
+
+
+struct Options {
+    std::string engineId;
+    std::string dataDir;
+    std::vector<std::string> langCodes;
+    int numWorkers{};
+    int queueDepth{1};
+    int numPasses{1};
+    DpsoOcrJobFlags jobFlags{};
+    bool json{};
+    std::vector<std::string> imagePaths;
+};
+
+
+void printHelp(std::string_view argv0)
+{
+    str::print("Usage\n");
+    str::print("    {} [options...] image.pnm...\n\n", argv0);
+
+    str::print(
+        "Runs binary PGM and PPM images through OCR and reports the\n"
+        "throughput and latency.\n"
+        "\n"
+        "Options\n"
+        "\n"
+        "  -help\n"
+        "      Print this help and exit.\n"
+        "  -engine ID\n"
+        "      OCR engine id. The default is the first engine.\n"
+        "  -data-dir DIR\n"
+        "      OCR data directory. The default is the engine's\n"
+        "      default.\n"
+        "  -lang CODE\n"
+        "      Language to activate. Can be given several times.\n"
+        "      The default is the engine's default language.\n"
+        "  -workers N\n"
+        "      Number of OCR workers, as in dpsoOcrCreateEx(). The\n"
+        "      default 0 uses its default: the number of\n"
+        "      hardware threads, but no more than 4.\n"
+        "  -depth N\n"
+        "      Maximum number of jobs in flight. The default 1\n"
+        "      measures the latency of isolated jobs; use a value\n"
+        "      above the number of workers to measure the\n"
+        "      throughput.\n"
+        "  -passes N\n"
+        "      Number of passes over the images. Default is 1.\n"
+        "  -segmentation\n"
+        "      Enable text segmentation\n"
+        "      (dpsoOcrJobTextSegmentation).\n"
+        "  -json\n"
+        "      Print the report as JSON.\n");
+}
+
+
+[[noreturn]]
+void exitWithError(std::string_view msg)
+{
+    str::print(stderr, "{}\n", msg);
+    std::exit(EXIT_FAILURE);
+}
+
+
+int parseInt(std::string_view optName, const char* str, int minValue)
+{
+    char* end;
+    const auto value = std::strtol(str, &end, 10);
+    if (end == str || *end || value < minValue || value > 1 << 20)
+        exitWithError(
+            str::format(
+                "Invalid {} value \"{}\"; expected an integer >= {}",
+                optName, str, minValue));
+
+    return value;
+}
+
+
+Options parseArgs(int argc, char* argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+
+        if (arg.empty() || arg[0] != '-') {
+            options.imagePaths.emplace_back(arg);
+            continue;
+        }
+
+        if (arg == "-help") {
+            printHelp(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+
+        if (arg == "-segmentation") {
+            options.jobFlags |= dpsoOcrJobTextSegmentation;
+            continue;
+        }
+
+        if (arg == "-json") {
+            options.json = true;
+            continue;
+        }
+
+        if (i + 1 == argc)
+            exitWithError(
+                str::format(
+                    "Option \"{}\" is either unknown or requires a "
+                    "value. Use \"-help\" for a list of available "
+                    "options.",
+                    arg));
+
+        const auto* value = argv[++i];
+
+        if (arg == "-engine")
+            options.engineId = value;
+        else if (arg == "-data-dir")
+            options.dataDir = value;
+        else if (arg == "-lang")
+            options.langCodes.emplace_back(value);
+        else if (arg == "-workers")
+            options.numWorkers = parseInt(arg, value, 0);
+        else if (arg == "-depth")
+            options.queueDepth = parseInt(arg, value, 1);
+        else if (arg == "-passes")
+            options.numPasses = parseInt(arg, value, 1);
+        else
+            exitWithError(
+                str::format(
+                    "Unknown option \"{}\". Use \"-help\" for a list "
+                    "of available options.",
+                    arg));
+    }
+
+    if (options.imagePaths.empty())
+        exitWithError(
+            "No images given. Use \"-help\" for the usage.");
+
+    return options;
+}
+
+
+int findEngineIdx(std::string_view engineId)
+{
+    if (dpsoOcrGetNumEngines() == 0)
+        exitWithError("No OCR engines available");
+
+    if (engineId.empty())
+        return 0;
+
+    for (int i{}; i < dpsoOcrGetNumEngines(); ++i) {
+        DpsoOcrEngineInfo info;
+        dpsoOcrGetEngineInfo(i, &info);
+        if (info.id == engineId)
+            return i;
+    }
+
+    exitWithError(str::format("Unknown OCR engine \"{}\"", engineId));
+}
+
+
+void activateLangs(DpsoOcr* ocr, std::vector<std::string>& langCodes)
+{
+    if (langCodes.empty())
+        langCodes.emplace_back(dpsoOcrGetDefaultLangCode(ocr));
+
+    for (const auto& langCode : langCodes) {
+        const auto langIdx = dpsoOcrGetLangIdx(ocr, langCode.c_str());
+        if (langIdx == -1)
+            exitWithError(
+                str::format(
+                    "Language \"{}\" is not available", langCode));
+
+        dpsoOcrSetLangIsActive(ocr, langIdx, true);
+    }
+}
+
+
+std::vector<img::ImgUPtr> loadImages(
+    const std::vector<std::string>& imagePaths)
+{
+    std::vector<img::ImgUPtr> result;
+    result.reserve(imagePaths.size());
+
+    for (const auto& imagePath : imagePaths) {
+        auto img = img::loadPnm(imagePath);
+        if (!img)
+            exitWithError(
+                str::format(
+                    "Can't load \"{}\": {}",
+                    imagePath, dpsoGetError()));
+
+        result.push_back(std::move(img));
+    }
+
+    return result;
+}
+
+
+img::ImgUPtr copyImage(const DpsoImg& img)
+{
+    const auto pxFormat = dpsoImgGetPxFormat(&img);
+    const auto w = dpsoImgGetWidth(&img);
+    const auto h = dpsoImgGetHeight(&img);
+    const auto pitch = dpsoImgGetPitch(&img);
+
+    img::ImgUPtr result{dpsoImgCreate(pxFormat, w, h, pitch)};
+    if (!result)
+        exitWithError(
+            str::format("dpsoImgCreate(): {}", dpsoGetError()));
+
+    std::memcpy(
+        dpsoImgGetData(result.get()),
+        dpsoImgGetConstData(&img),
+        static_cast<std::size_t>(pitch) * h);
+
+    return result;
+}
+
+
+// Wait till the OCR has updates, or for a short time if waiting is
+// not supported.
+void waitForOcr(DpsoOcr* ocr)
+{
+    #ifndef _WIN32
+    pollfd pfd{dpsoOcrGetNotifyFd(ocr), POLLIN, 0};
+    if (pfd.fd != -1) {
+        poll(&pfd, 1, -1);
+        dpsoOcrClearNotifyFd(ocr);
+        return;
+    }
+    #endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+}
+
+
+// Returns 0 if not available.
+std::size_t getPeakRssKb()
+{
+    #ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(
+            GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize / 1024;
+    #else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    #ifdef __APPLE__
+    // Bytes rather than kilobytes.
+    return usage.ru_maxrss / 1024;
+    #else
+    return usage.ru_maxrss;
+    #endif
+    #endif
+}
+
+
+struct LatencyStats {
+    double meanMs;
+    double p50Ms;
+    double p90Ms;
+    double p99Ms;
+    double maxMs;
+};
+
+
+// Exact statistics, as opposed to the histogram-based estimates of
+// dpsoOcrGetStats().
+LatencyStats getLatencyStats(std::vector<double> latenciesMs)
+{
+    if (latenciesMs.empty())
+        return {};
+
+    std::sort(latenciesMs.begin(), latenciesMs.end());
+
+    double sum{};
+    for (const auto latencyMs : latenciesMs)
+        sum += latencyMs;
+
+    const auto getQuantile = [&](double q)
+    {
+        const auto idx = static_cast<std::size_t>(
+            q * (latenciesMs.size() - 1) + 0.5);
+        return latenciesMs[idx];
+    };
+
+    return {
+        sum / latenciesMs.size(),
+        getQuantile(0.5),
+        getQuantile(0.9),
+        getQuantile(0.99),
+        latenciesMs.back()};
+}
+
+
+struct Report {
+    std::size_t numJobs;
+    std::size_t numPixels;
+    double wallTimeS;
+    LatencyStats latency;
+    std::size_t peakRssKb;
+};
+
+
+Report run(
+    DpsoOcr* ocr,
+    const Options& options,
+    const std::vector<img::ImgUPtr>& images)
+{
+    const auto numJobs = images.size() * options.numPasses;
+
+    Report report{};
+    report.numJobs = numJobs;
+
+    std::vector<double> latenciesMs;
+    latenciesMs.reserve(numJobs);
+
+    // Results come in the queue order.
+    std::deque<Clock::time_point> queueTimes;
+
+    const auto startTime = Clock::now();
+
+    std::size_t numQueuedJobs{};
+    while (latenciesMs.size() < numJobs) {
+        while (numQueuedJobs < numJobs
+                && queueTimes.size()
+                    < static_cast<std::size_t>(options.queueDepth)) {
+            const auto& img = *images[numQueuedJobs % images.size()];
+            report.numPixels +=
+                static_cast<std::size_t>(dpsoImgGetWidth(&img))
+                * dpsoImgGetHeight(&img);
+
+            auto* imgCopy = copyImage(img).release();
+            queueTimes.push_back(Clock::now());
+            if (!dpsoOcrQueueJob(ocr, &imgCopy, options.jobFlags))
+                exitWithError(
+                    str::format(
+                        "dpsoOcrQueueJob(): {}", dpsoGetError()));
+
+            ++numQueuedJobs;
+        }
+
+        waitForOcr(ocr);
+
+        DpsoOcrJobResult result;
+        while (dpsoOcrGetResult(ocr, &result)) {
+            const std::chrono::duration<double, std::milli> latency{
+                Clock::now() - queueTimes.front()};
+            latenciesMs.push_back(latency.count());
+            queueTimes.pop_front();
+        }
+    }
+
+    report.wallTimeS = std::chrono::duration<double>{
+        Clock::now() - startTime}.count();
+    report.latency = getLatencyStats(std::move(latenciesMs));
+    report.peakRssKb = getPeakRssKb();
+
+    return report;
+}
+
+
+std::string latencyStatsToJson(const LatencyStats& s)
+{
+    return str::format(
+        "{{\"mean\": {}, \"p50\": {}, \"p90\": {}, \"p99\": {}, "
+        "\"max\": {}}",
+        s.meanMs, s.p50Ms, s.p90Ms, s.p99Ms, s.maxMs);
+}
+
+
+void printJsonReport(
+    DpsoOcr* ocr,
+    const Options& options,
+    const DpsoOcrEngineInfo& engineInfo,
+    const Report& report)
+{
+    std::string langCodes;
+    for (const auto& langCode : options.langCodes) {
+        if (!langCodes.empty())
+            langCodes += ", ";
+        langCodes += '"' + str::escapeJsonStr(langCode) + '"';
+    }
+
+    str::print("{\n");
+    str::print(
+        "  \"engine\": \"{}\",\n"
+        "  \"engine_version\": \"{}\",\n"
+        "  \"langs\": [{}],\n"
+        "  \"workers\": {},\n"
+        "  \"depth\": {},\n"
+        "  \"segmentation\": {},\n",
+        str::escapeJsonStr(engineInfo.id),
+        str::escapeJsonStr(engineInfo.version),
+        langCodes,
+        options.numWorkers,
+        options.queueDepth,
+        options.jobFlags & dpsoOcrJobTextSegmentation
+            ? "true" : "false");
+    str::print(
+        "  \"num_jobs\": {},\n"
+        "  \"wall_time_s\": {},\n"
+        "  \"jobs_per_s\": {},\n"
+        "  \"mpx_per_s\": {},\n"
+        "  \"latency_ms\": {},\n"
+        "  \"peak_rss_kb\": {},\n",
+        report.numJobs,
+        report.wallTimeS,
+        report.numJobs / report.wallTimeS,
+        report.numPixels / report.wallTimeS / 1e6,
+        latencyStatsToJson(report.latency),
+        report.peakRssKb);
+
+    // The stats JSON is multiline; indent it to match.
+    std::string ocrStats{dpsoOcrGetStatsJson(ocr)};
+    while (!ocrStats.empty() && ocrStats.back() == '\n')
+        ocrStats.pop_back();
+
+    std::string indentedOcrStats;
+    for (const auto c : ocrStats) {
+        indentedOcrStats += c;
+        if (c == '\n')
+            indentedOcrStats += "  ";
+    }
+
+    str::print("  \"ocr_stats\": {}\n}\n", indentedOcrStats);
+}
+
+
+void printStageStats(
+    std::string_view name, const DpsoOcrStageStats& s)
+{
+    str::print(
+        "  {} {} {} {} {} {} {}\n",
+        str::justifyLeft(std::string{name}, 18),
+        str::justifyRight(str::toStr(s.count), 7),
+        str::justifyRight(str::format("{}", int(s.meanMs + 0.5)), 8),
+        str::justifyRight(str::format("{}", int(s.p50Ms + 0.5)), 8),
+        str::justifyRight(str::format("{}", int(s.p90Ms + 0.5)), 8),
+        str::justifyRight(str::format("{}", int(s.p99Ms + 0.5)), 8),
+        str::justifyRight(str::format("{}", int(s.maxMs + 0.5)), 8));
+}
+
+
+void printTextReport(
+    DpsoOcr* ocr,
+    const Options& options,
+    const DpsoOcrEngineInfo& engineInfo,
+    const Report& report)
+{
+    std::string langCodes;
+    for (const auto& langCode : options.langCodes) {
+        if (!langCodes.empty())
+            langCodes += '+';
+        langCodes += langCode;
+    }
+
+    str::print(
+        "Engine: {} {}\n"
+        "Languages: {}\n"
+        "Workers: {}, depth: {}\n"
+        "\n"
+        "Jobs: {} in {} s\n"
+        "Throughput: {} jobs/s, {} Mpx/s\n"
+        "Peak RSS: {} MiB\n"
+        "\n",
+        engineInfo.name,
+        engineInfo.version,
+        langCodes,
+        options.numWorkers == 0
+            ? std::string{"auto"} : str::toStr(options.numWorkers),
+        options.queueDepth,
+        report.numJobs,
+        report.wallTimeS,
+        report.numJobs / report.wallTimeS,
+        report.numPixels / report.wallTimeS / 1e6,
+        report.peakRssKb / 1024);
+
+    DpsoOcrStats stats;
+    dpsoOcrGetStats(ocr, &stats);
+
+    str::print(
+        "  {} {} {} {} {} {} {}\n",
+        str::justifyLeft("Stage (ms)", 18),
+        str::justifyRight("count", 7),
+        str::justifyRight("mean", 8),
+        str::justifyRight("p50", 8),
+        str::justifyRight("p90", 8),
+        str::justifyRight("p99", 8),
+        str::justifyRight("max", 8));
+
+    printStageStats("Queue wait", stats.queueWait);
+    printStageStats("Preprocessing", stats.preprocessing);
+    printStageStats("Recognition wait", stats.recognitionWait);
+    printStageStats("Language loading", stats.langLoading);
+    printStageStats("Recognition", stats.recognition);
+    printStageStats("Result drain", stats.resultDrain);
+    printStageStats("Total", stats.total);
+
+    const auto& l = report.latency;
+    printStageStats(
+        "Client latency",
+        {
+            report.numJobs,
+            l.meanMs, l.p50Ms, l.p90Ms, l.p99Ms, l.maxMs});
+
+    if (stats.numFailedJobs > 0)
+        str::print("\n{} jobs failed\n", stats.numFailedJobs);
+}
+
+
+}
+
+
+int main(int argc, char* argv[])
+{
+    auto options = parseArgs(argc, argv);
+
+    const auto images = loadImages(options.imagePaths);
+
+    const auto engineIdx = findEngineIdx(options.engineId);
+    DpsoOcrEngineInfo engineInfo;
+    dpsoOcrGetEngineInfo(engineIdx, &engineInfo);
+
+    dpso::OcrUPtr ocr{
+        dpsoOcrCreateEx(
+            engineIdx, options.dataDir.c_str(), options.numWorkers)};
+    if (!ocr)
+        exitWithError(
+            str::format("dpsoOcrCreateEx(): {}", dpsoGetError()));
+
+    activateLangs(ocr.get(), options.langCodes);
+
+    const auto report = run(ocr.get(), options, images);
+
+    if (options.json)
+        printJsonReport(ocr.get(), options, engineInfo, report);
+    else
+        printTextReport(ocr.get(), options, engineInfo, report);
+}
@@ -4,6 +4,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
 #include "dpso_ocr/dpso_ocr.h"
 #include "dpso_sys/dpso_sys.h"
 #include "dpso_utils/dpso_utils.h"
@@ -98,7 +102,8 @@ static void checkHotkeyActions(DpsoSys* sys, DpsoOcr* ocr)
     if (dpsoRectIsEmpty(&screenRect))
         return;
 
-    DpsoImg* screenshot = dpsoTakeScreenshot(sys, &screenRect);
+    DpsoImg* screenshot = dpsoTakeScreenshot(
+        sys, &screenRect, DpsoPxFormatGrayscale);
     if (!screenshot) {
         fprintf(stderr, "dpsoTakeScreenshot(): %s\n", dpsoGetError());
         return;
@@ -120,6 +125,54 @@ static void sigintHandler(int signum)
 }
 
 
+/*
+ * Wait till the system or the OCR has updates, or the next
+ * dpsoSysUpdate() is due.
+ *
+ * If both descriptors are available, we only wake up when there's
+ * something to do. Otherwise, dpsoSysUpdate() has to be called
+ * periodically to handle hotkeys, but waiting on the OCR
+ * notification descriptor still lets us report the progress and
+ * results without the polling delay.
+ */
+static void waitForUpdates(DpsoSys* sys, DpsoOcr* ocr)
+{
+    const int timeoutMs = 1000 / 60;
+
+#ifndef _WIN32
+    struct pollfd pfds[2] = {
+        {dpsoSysGetEventFd(sys), POLLIN, 0},
+        {dpsoOcrGetNotifyFd(ocr), POLLIN, 0},
+    };
+
+    if (pfds[1].fd != -1) {
+        int pollTimeoutMs = timeoutMs;
+        if (pfds[0].fd != -1) {
+            if (dpsoKeyManagerGetLastHotkeyAction(
+                    dpsoSysGetKeyManager(sys)) != dpsoNoHotkeyAction)
+                /* Handling the hotkey could read new events without
+                 * making the descriptor readable; see
+                 * dpsoSysGetEventFd(). */
+                pollTimeoutMs = 0;
+            else if (!dpsoSelectionGetIsEnabled(
+                    dpsoSysGetSelection(sys)))
+                /* The selection follows the mouse by polling. */
+                pollTimeoutMs = -1;
+        }
+
+        poll(pfds, 2, pollTimeoutMs);
+        dpsoOcrClearNotifyFd(ocr);
+        return;
+    }
+#else
+    (void)sys;
+    (void)ocr;
+#endif
+
+    dpsoSleep(timeoutMs);
+}
+
+
 int main(void)
 {
     DpsoSys* sys = dpsoSysCreate();
@@ -168,7 +221,7 @@ int main(void)
         checkResults(ocr);
         checkHotkeyActions(sys, ocr);
 
-        dpsoSleep(1000 / 60);
+        waitForUpdates(sys, ocr);
     }
 
     dpsoOcrDelete(ocr);
@@ -1,18 +1,29 @@
 #include "history.h"
 
 #include <algorithm>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "dpso_utils/error_set.h"
+#include "dpso_utils/mapped_file.h"
 #include "dpso_utils/os.h"
 #include "dpso_utils/str.h"
 #include "dpso_utils/stream/file_stream.h"
 #include "dpso_utils/stream/utils.h"
 
+#include "history_index.h"
+#include "history_search_index.h"
+#include "history_segments.h"
+#include "history_writer.h"
+
 
 using namespace dpso;
 
@@ -20,27 +31,114 @@ using namespace dpso;
 // Each entry in a history file consists of a timestamp, two line
 // feeds (\n\n), and the actual text. Entries are separated by a form
 // feed and a line feed (\f\n).
+//
+// The file is memory-mapped read-only, and the history only keeps
+// the offsets of the entries, which are persisted in HistoryIndex.
+// Since the strings in the mapping are not null-terminated,
+// dpsoHistoryGet() copies them. The copies are kept till the history
+// is modified, so only the entries that were actually requested take
+// memory.
+//
+// Appended entries are kept in memory till they are written to the
+// file, which happens in the background if there's a writer. They
+// are then moved to the index by absorbWrittenEntries(). Since this
+// requires remapping the file, appended entries are absorbed in
+// batches rather than one by one.
+//
+// When the file reaches the rotation limits, it's sealed as a
+// segment by HistorySegments and a new file is started. Entries of
+// the segments precede the entries of the file; the history file,
+// its index, and the pending entries only cover the active segment.
 
 
 struct DpsoHistory {
-    struct Entry {
+    struct PendingEntry {
+        HistoryIndex::Entry offsets;
         std::string timestamp;
         std::string text;
     };
 
     std::string filePath;
+    HistorySegments segments;
     std::optional<FileStream> file;
-    std::vector<Entry> entries;
+    // Null if the file is empty.
+    std::unique_ptr<os::MappedFile> mapping;
+    HistoryIndex index;
+    std::deque<PendingEntry> pendingEntries;
+    // Loaded on the first search. The mutex is only locked by
+    // dpsoHistorySearch(), since the rest of the routines that use
+    // the index modify the history.
+    mutable std::mutex searchIndexMutex;
+    mutable HistorySearchIndex searchIndex;
+
+    struct GotEntry {
+        std::string timestamp;
+        std::string text;
+    };
+
+    // Copies of the entries returned by dpsoHistoryGet(), by the
+    // entry index. Cleared when the history is modified.
+    mutable std::mutex gotEntriesMutex;
+    mutable std::unordered_map<std::size_t, GotEntry> gotEntries;
+
+    DpsoHistorySyncMode syncMode{dpsoHistorySyncModeEachEntry};
+    int syncPeriodMs{};
+    // Null in dpsoHistorySyncModeEachEntry and in the error state.
+    // Should be destroyed before the file.
+    std::unique_ptr<HistoryWriter> writer;
+
+    // 0 if not limited.
+    std::size_t maxSegmentSize{};
+    std::size_t maxSegmentEntries{};
+    bool compressSegments{};
+
+    explicit DpsoHistory(std::string_view filePath)
+        : filePath{filePath}
+        , segments{filePath}
+        , index{HistoryIndex::getFilePath(filePath)}
+        , searchIndex{HistorySearchIndex::getFilePath(filePath)}
+    {
+    }
 };
 
 
+static std::string_view getData(const os::MappedFile& mapping)
+{
+    return {
+        reinterpret_cast<const char*>(mapping.getData()),
+        mapping.getSize()};
+}
+
+
+static bool mapFile(
+    std::string_view filePath,
+    std::unique_ptr<os::MappedFile>& mapping)
+{
+    try {
+        auto newMapping = std::make_unique<os::MappedFile>(filePath);
+        if (!newMapping->getData())
+            newMapping.reset();
+
+        mapping = std::move(newMapping);
+    } catch (os::FileNotFoundError&) {
+        // dpsoHistoryOpen() will create the file.
+        mapping.reset();
+    } catch (os::Error& e) {
+        setError("os::MappedFile(): {}", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+
+// Parse entries that are not in the index yet.
 static bool createEntries(
     std::string_view data,
-    std::vector<DpsoHistory::Entry>& entries,
+    HistoryIndex& index,
     std::size_t& validDataSize)
 {
-    entries.clear();
-    validDataSize = 0;
+    validDataSize = index.getDataSize();
 
     // Note that we don't treat truncation as an error. Since the
     // history is append-only, we assume that the data is most likely
@@ -48,11 +146,39 @@ static bool createEntries(
     // power loss), so the best strategy is to restore successfully
     // written entries.
 
-    for (std::size_t pos{}; true;) {
+    for (auto pos = validDataSize; pos < data.size();) {
+        if (!index.getEntries().empty()) {
+            if (const auto c = data[pos]; c != '\f') {
+                setError(
+                    "Unexpected 0x{} instead of \\f at {}",
+                    str::toStr(static_cast<unsigned char>(c), 16),
+                    pos);
+                return false;
+            }
+
+            if (++pos == data.size())
+                // Truncated \f\n terminator.
+                break;
+
+            if (const auto c = data[pos]; c != '\n') {
+                setError(
+                    "Unexpected 0x{} instead of \\n at {} for "
+                    "text at {}",
+                    str::toStr(static_cast<unsigned char>(c), 16),
+                    pos, index.getEntries().back().textPos);
+                return false;
+            }
+
+            if (++pos == data.size())
+                // \f\n at the end of the file is a truncated
+                // subsequent entry.
+                break;
+        }
+
         const auto timestampPos = pos;
         pos = data.find('\n', pos);
         if (pos == data.npos)
-             // Either truncated timestamp or end of data.
+             // Truncated timestamp.
             break;
 
         const auto timestampLen = pos - timestampPos;
@@ -73,32 +199,10 @@ static bool createEntries(
         const auto textPos = ++pos;
         pos = std::min(data.find('\f', pos), data.size());
 
-        entries.push_back(
-            {
-                {data, timestampPos, timestampLen},
-                {data, textPos, pos - textPos}});
+        index.add(
+            {timestampPos, timestampLen, textPos, pos - textPos});
 
         validDataSize = pos;
-
-        if (pos < data.size()) {
-            if (++pos == data.size())
-                // Truncated \f\n terminator.
-                break;
-
-            if (const auto c = data[pos]; c != '\n') {
-                setError(
-                    "Unexpected 0x{} instead of \\n at {} for "
-                    "text at {}",
-                    str::toStr(static_cast<unsigned char>(c), 16),
-                    pos, textPos);
-                return false;
-            }
-
-            if (++pos == data.size())
-                // \f\n at the end of the file is a truncated
-                // subsequent entry.
-                break;
-        }
     }
 
     return true;
@@ -139,23 +243,28 @@ static void openSync(
 
 DpsoHistory* dpsoHistoryOpen(const char* filePath)
 {
-    auto history = std::make_unique<DpsoHistory>();
-    history->filePath = filePath;
+    auto history = std::make_unique<DpsoHistory>(filePath);
 
-    std::string data;
-    try {
-        data = os::loadData(history->filePath);
-    } catch (os::FileNotFoundError&) {
-    } catch (os::Error& e) {
-        setError("os::loadData(): {}", e.what());
+    if (!history->segments.load())
+        return nullptr;
+
+    if (!mapFile(history->filePath, history->mapping))
         return nullptr;
-    }
+
+    const auto data =
+        history->mapping
+            ? getData(*history->mapping) : std::string_view{};
+
+    history->index.load(data);
 
     std::size_t validDataSize{};
-    if (!createEntries(data, history->entries, validDataSize))
+    if (!createEntries(data, history->index, validDataSize))
         return nullptr;
 
-    if (validDataSize != data.size())
+    if (validDataSize != data.size()) {
+        // The file should not be truncated while mapped.
+        history->mapping.reset();
+
         try {
             os::resizeFile(history->filePath, validDataSize);
         } catch (os::Error& e) {
@@ -163,24 +272,193 @@ DpsoHistory* dpsoHistoryOpen(const char* filePath)
             return nullptr;
         }
 
+        if (!mapFile(history->filePath, history->mapping))
+            return nullptr;
+    }
+
     openSync(
         history->file, history->filePath, FileStream::Mode::append);
     if (!history->file)
         return nullptr;
 
+    history->index.save(
+        history->mapping
+            ? getData(*history->mapping) : std::string_view{});
+
     return history.release();
 }
 
 
+static std::size_t getEntryEnd(const HistoryIndex::Entry& e)
+{
+    return e.textPos + e.textLen;
+}
+
+
+// Size of the data of all entries, including pending ones.
+static std::size_t getDataSize(const DpsoHistory& history)
+{
+    return history.pendingEntries.empty()
+        ? history.index.getDataSize()
+        : getEntryEnd(history.pendingEntries.back().offsets);
+}
+
+
+// Size of the data that is written to the file.
+static std::size_t getWrittenSize(const DpsoHistory& history)
+{
+    return history.writer
+        ? history.writer->getWrittenSize() : getDataSize(history);
+}
+
+
+static void startWriter(DpsoHistory& history)
+{
+    if (history.syncMode == dpsoHistorySyncModeEachEntry
+            || !history.file)
+        return;
+
+    std::optional<std::chrono::milliseconds> syncInterval;
+    if (history.syncMode == dpsoHistorySyncModePeriodic)
+        syncInterval = std::chrono::milliseconds{
+            history.syncPeriodMs};
+
+    history.writer = std::make_unique<HistoryWriter>(
+        *history.file, getDataSize(history), syncInterval);
+}
+
+
+static void setErrorState(DpsoHistory& history)
+{
+    history.writer.reset();
+    history.file.reset();
+}
+
+
+// Pending entries are absorbed when their data reaches this size.
+const std::size_t maxPendingDataSize = 64 * 1024;
+
+
+// Move pending entries that are written to the file to the index.
+// The entries stay pending if the file can't be remapped; this is
+// not an error, since they are still available from memory.
+static void absorbWrittenEntries(
+    DpsoHistory& history, std::size_t writtenSize)
+{
+    auto& pendingEntries = history.pendingEntries;
+    if (pendingEntries.empty()
+            || getEntryEnd(pendingEntries.front().offsets)
+                > writtenSize)
+        return;
+
+    std::unique_ptr<os::MappedFile> newMapping;
+    if (!mapFile(history.filePath, newMapping) || !newMapping)
+        return;
+
+    const auto mappedSize = std::min(
+        newMapping->getSize(), writtenSize);
+
+    if (getEntryEnd(pendingEntries.front().offsets) > mappedSize)
+        return;
+
+    while (!pendingEntries.empty()
+            && getEntryEnd(pendingEntries.front().offsets)
+                <= mappedSize) {
+        history.index.add(pendingEntries.front().offsets);
+        pendingEntries.pop_front();
+    }
+
+    history.mapping = std::move(newMapping);
+    history.index.save(getData(*history.mapping));
+}
+
+
 void dpsoHistoryClose(DpsoHistory* history)
 {
+    if (!history)
+        return;
+
+    if (history->file) {
+        // Absorb the remaining entries so that the next
+        // dpsoHistoryOpen() finds them in the index. The writer
+        // flushes the data on destruction; absorbWrittenEntries()
+        // only takes the entries that actually made it to the file.
+        history->writer.reset();
+        absorbWrittenEntries(*history, getDataSize(*history));
+    }
+
+    history->searchIndex.save();
+
     delete history;
 }
 
 
+static std::size_t getNumActiveEntries(const DpsoHistory& history)
+{
+    return history.index.getEntries().size()
+        + history.pendingEntries.size();
+}
+
+
 int dpsoHistoryCount(const DpsoHistory* history)
 {
-    return history ? history->entries.size() : 0;
+    return history
+        ? history->segments.getNumEntries()
+            + getNumActiveEntries(*history)
+        : 0;
+}
+
+
+// Seal the history file if it has reached the rotation limits.
+static bool rotate(DpsoHistory& history)
+{
+    const auto numActiveEntries = getNumActiveEntries(history);
+    if (numActiveEntries == 0
+            || ((history.maxSegmentSize == 0
+                    || getDataSize(history) < history.maxSegmentSize)
+                && (history.maxSegmentEntries == 0
+                    || numActiveEntries
+                        < history.maxSegmentEntries)))
+        return true;
+
+    if (history.writer && !history.writer->flush()) {
+        setErrorState(history);
+        return false;
+    }
+
+    absorbWrittenEntries(history, getWrittenSize(history));
+
+    // The entries stay pending if the file can't be remapped; we
+    // will try again on the next append.
+    if (!history.pendingEntries.empty())
+        return true;
+
+    // The file should not be moved while open or mapped.
+    history.writer.reset();
+    history.file.reset();
+    history.mapping.reset();
+
+    if (!history.segments.seal(
+            numActiveEntries, history.compressSegments)) {
+        // Keep the entries readable in the error state.
+        try {
+            history.mapping = std::make_unique<os::MappedFile>(
+                history.filePath);
+        } catch (os::Error&) {
+        }
+
+        return false;
+    }
+
+    history.index.clear();
+
+    openSync(
+        history.file, history.filePath, FileStream::Mode::write);
+    if (!history.file)
+        return false;
+
+    startWriter(history);
+    return true;
 }
 
 
@@ -202,40 +480,207 @@ bool dpsoHistoryAppend(
         return false;
     }
 
-    DpsoHistory::Entry e{entry->timestamp, entry->text};
+    if (history->writer) {
+        const auto error = history->writer->getError();
+        if (!error.empty()) {
+            setError("{}", error);
+            setErrorState(*history);
+            return false;
+        }
+    }
+
+    history->gotEntries.clear();
+
+    if (!rotate(*history))
+        return false;
 
-    std::replace(e.timestamp.begin(), e.timestamp.end(), '\n', ' ');
-    std::replace(e.text.begin(), e.text.end(), '\f', ' ');
+    std::string timestamp{entry->timestamp};
+    std::string text{entry->text};
 
-    auto& file = *history->file;
+    std::replace(timestamp.begin(), timestamp.end(), '\n', ' ');
+    std::replace(text.begin(), text.end(), '\f', ' ');
 
-    try {
-        if (!history->entries.empty())
-            write(file, "\f\n");
-
-        write(file, e.timestamp);
-        write(file, "\n\n");
-        write(file, e.text);
-    } catch (StreamError& e) {
-        setError("write(file, ...): {}", e.what());
-        history->file.reset();
+    const auto isFirst = getNumActiveEntries(*history) == 0;
+
+    HistoryIndex::Entry offsets{};
+    offsets.timestampPos = getDataSize(*history) + (isFirst ? 0 : 2);
+    offsets.timestampLen = timestamp.size();
+    offsets.textPos = offsets.timestampPos + offsets.timestampLen + 2;
+    offsets.textLen = text.size();
+
+    std::string data;
+    data.reserve(getEntryEnd(offsets) - getDataSize(*history));
+    if (!isFirst)
+        data += "\f\n";
+    data += timestamp;
+    data += "\n\n";
+    data += text;
+
+    if (history->writer)
+        history->writer->write(data);
+    else {
+        auto& file = *history->file;
+
+        try {
+            write(file, data);
+        } catch (StreamError& e) {
+            setError("write(file, ...): {}", e.what());
+            setErrorState(*history);
+            return false;
+        }
+
+        try {
+            file.sync();
+        } catch (os::Error& e) {
+            setError("FileStream::sync(): {}", e.what());
+            setErrorState(*history);
+            return false;
+        }
+    }
+
+    history->searchIndex.add(text);
+
+    history->pendingEntries.push_back(
+        {offsets, std::move(timestamp), std::move(text)});
+
+    if (getDataSize(*history) - history->index.getDataSize()
+            >= maxPendingDataSize)
+        absorbWrittenEntries(*history, getWrittenSize(*history));
+
+    return true;
+}
+
+
+bool dpsoHistorySetSyncMode(
+    DpsoHistory* history, DpsoHistorySyncMode mode, int periodMs)
+{
+    if (!history) {
+        setError("history is null");
         return false;
     }
 
-    try {
-        file.sync();
-    } catch (os::Error& e) {
-        setError("FileStream::sync(): {}", e.what());
-        history->file.reset();
+    if (mode == dpsoHistorySyncModePeriodic && periodMs < 0) {
+        setError("periodMs < 0");
         return false;
     }
 
-    history->entries.push_back(std::move(e));
+    if (history->writer) {
+        const auto flushed = history->writer->flush();
+        absorbWrittenEntries(
+            *history, history->writer->getWrittenSize());
+        history->writer.reset();
+
+        if (!flushed) {
+            setErrorState(*history);
+            return false;
+        }
+    }
+
+    history->syncMode = mode;
+    history->syncPeriodMs = periodMs;
+    startWriter(*history);
 
     return true;
 }
 
 
+bool dpsoHistoryFlush(DpsoHistory* history)
+{
+    if (!history) {
+        setError("history is null");
+        return false;
+    }
+
+    if (!history->file) {
+        setError("History is in the error state");
+        return false;
+    }
+
+    if (!history->writer)
+        return true;
+
+    if (!history->writer->flush()) {
+        setErrorState(*history);
+        return false;
+    }
+
+    absorbWrittenEntries(*history, history->writer->getWrittenSize());
+    return true;
+}
+
+
+bool dpsoHistorySetRotation(
+    DpsoHistory* history,
+    int maxSegmentSize,
+    int maxSegmentEntries,
+    bool compress)
+{
+    if (!history) {
+        setError("history is null");
+        return false;
+    }
+
+    if (maxSegmentSize < 0) {
+        setError("maxSegmentSize < 0");
+        return false;
+    }
+
+    if (maxSegmentEntries < 0) {
+        setError("maxSegmentEntries < 0");
+        return false;
+    }
+
+    history->maxSegmentSize = maxSegmentSize;
+    history->maxSegmentEntries = maxSegmentEntries;
+    history->compressSegments = compress;
+
+    return true;
+}
+
+
+struct EntryView {
+    std::string_view timestamp;
+    std::string_view text;
+};
+
+
+// The views are valid till the history is modified. The entries of
+// the segments are copied to the buffers.
+static EntryView getEntry(
+    const DpsoHistory& history,
+    std::size_t idx,
+    std::string& timestampBuffer,
+    std::string& textBuffer)
+{
+    const auto numSealedEntries = history.segments.getNumEntries();
+    if (idx < numSealedEntries) {
+        history.segments.getEntry(idx, timestampBuffer, textBuffer);
+        return {timestampBuffer, textBuffer};
+    }
+
+    idx -= numSealedEntries;
+
+    const auto& entries = history.index.getEntries();
+    if (idx >= entries.size()) {
+        const auto& pendingEntry =
+            history.pendingEntries[idx - entries.size()];
+        return {pendingEntry.timestamp, pendingEntry.text};
+    }
+
+    // The mapping is null if it can't be restored after a failed
+    // rotation.
+    if (!history.mapping)
+        return {};
+
+    const auto& e = entries[idx];
+    const auto data = getData(*history.mapping);
+
+    return {
+        data.substr(e.timestampPos, e.timestampLen),
+        data.substr(e.textPos, e.textLen)};
+}
+
+
 void dpsoHistoryGet(
     const DpsoHistory* history, int idx, DpsoHistoryEntry* entry)
 {
@@ -244,14 +689,67 @@ void dpsoHistoryGet(
 
     if (!history
             || idx < 0
-            || static_cast<std::size_t>(idx)
-                >= history->entries.size()) {
+            || idx >= dpsoHistoryCount(history)) {
         *entry = {"", ""};
         return;
     }
 
-    const auto& e = history->entries[idx];
-    *entry = {e.timestamp.c_str(), e.text.c_str()};
+    const std::lock_guard guard{history->gotEntriesMutex};
+
+    auto& gotEntries = history->gotEntries;
+    const auto [iter, inserted] = gotEntries.try_emplace(idx);
+    auto& gotEntry = iter->second;
+
+    if (inserted) {
+        std::string timestampBuffer;
+        std::string textBuffer;
+        const auto e = getEntry(
+            *history, idx, timestampBuffer, textBuffer);
+
+        gotEntry.timestamp = e.timestamp;
+        gotEntry.text = e.text;
+    }
+
+    *entry = {gotEntry.timestamp.c_str(), gotEntry.text.c_str()};
+}
+
+
+int dpsoHistorySearch(
+    const DpsoHistory* history,
+    const char* query,
+    int* indices,
+    int maxIndices)
+{
+    if (!history || !query)
+        return 0;
+
+    // Not dpsoHistoryGet(), which would keep copies of all entries.
+    std::string timestampBuffer;
+    std::string textBuffer;
+    const auto getText = [&](std::size_t idx)
+    {
+        return getEntry(
+            *history, idx, timestampBuffer, textBuffer).text;
+    };
+
+    const std::lock_guard guard{history->searchIndexMutex};
+
+    auto& searchIndex = history->searchIndex;
+    if (!searchIndex.getIsLoaded())
+        searchIndex.load(dpsoHistoryCount(history), getText);
+
+    std::vector<std::size_t> foundIndices;
+    searchIndex.find(query, getText, foundIndices);
+
+    if (indices)
+        for (int i{};
+                i < maxIndices
+                    && static_cast<std::size_t>(i)
+                        < foundIndices.size();
+                ++i)
+            indices[i] = foundIndices[i];
+
+    return foundIndices.size();
 }
 
 
@@ -264,11 +762,19 @@ bool dpsoHistoryClear(DpsoHistory* history)
 
     // Note that we allow clearing while in the error state.
 
-    history->file.reset();
-    history->entries.clear();
+    setErrorState(*history);
+    history->mapping.reset();
+    history->pendingEntries.clear();
+    history->gotEntries.clear();
+    history->searchIndex.clear();
+
+    const auto segmentsCleared = history->segments.clear();
 
     openSync(
         history->file, history->filePath, FileStream::Mode::write);
 
-    return history->file.has_value();
+    history->index.clear();
+    startWriter(*history);
+
+    return segmentsCleared && history->file.has_value();
 }
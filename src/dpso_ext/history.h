@@ -18,9 +18,10 @@ typedef struct DpsoHistoryEntry {
  * History.
  *
  * Editing the history will result in immediate modification of the
- * underlying file. In case of IO error, the history is set to the
- * error state: it becomes read-only, and all further modification
- * attempts except dpsoHistoryClear() will be rejected.
+ * underlying file, unless a background sync mode is set with
+ * dpsoHistorySetSyncMode(). In case of IO error, the history is set
+ * to the error state: it becomes read-only, and all further
+ * modification attempts except dpsoHistoryClear() will be rejected.
  */
 typedef struct DpsoHistory DpsoHistory;
 
@@ -35,9 +36,107 @@ typedef struct DpsoHistory DpsoHistory;
 DpsoHistory* dpsoHistoryOpen(const char* filePath);
 
 
+/**
+ * Close history.
+ *
+ * In a background sync mode, waits till all entries are written and
+ * synced; IO errors are ignored. Use dpsoHistoryFlush() before
+ * closing if you need to handle them.
+ */
 void dpsoHistoryClose(DpsoHistory* history);
 
 
+typedef enum {
+    /**
+     * dpsoHistoryAppend() writes and syncs the entry before
+     * returning. This is the default.
+     */
+    dpsoHistorySyncModeEachEntry,
+
+    /**
+     * Entries are written and synced in the background in batches,
+     * at most once per the given period.
+     */
+    dpsoHistorySyncModePeriodic,
+
+    /**
+     * Entries are written in the background as soon as possible, but
+     * only synced by dpsoHistoryFlush() and dpsoHistoryClose().
+     */
+    dpsoHistorySyncModeOnClose
+} DpsoHistorySyncMode;
+
+
+/**
+ * Set when appended entries are synced to the storage device.
+ *
+ * In the background modes, dpsoHistoryAppend() only queues the entry
+ * and returns immediately; the entry is available via
+ * dpsoHistoryGet() right away. IO errors that happen in the
+ * background are reported by the next call to dpsoHistoryAppend() or
+ * dpsoHistoryFlush().
+ *
+ * periodMs is only used by dpsoHistorySyncModePeriodic.
+ *
+ * Switching from a background mode flushes the history.
+ *
+ * On failure, sets an error message (dpsoGetError()) and returns
+ * false. Reasons include:
+ *   * history is null
+ *   * periodMs < 0
+ *   * IO error when flushing
+ */
+bool dpsoHistorySetSyncMode(
+    DpsoHistory* history, DpsoHistorySyncMode mode, int periodMs);
+
+
+/**
+ * Wait till all appended entries are written and synced.
+ *
+ * Does nothing in dpsoHistorySyncModeEachEntry.
+ *
+ * On failure, sets an error message (dpsoGetError()) and returns
+ * false. Reasons include:
+ *   * history is null
+ *   * IO error
+ *   * History is in the error state
+ */
+bool dpsoHistoryFlush(DpsoHistory* history);
+
+
+/**
+ * Set when the history file is sealed as a segment.
+ *
+ * Before appending an entry, the history file is sealed if it has at
+ * least maxSegmentSize bytes or maxSegmentEntries entries; 0 disables
+ * the corresponding limit. Sealing moves the file to
+ * "<filePath>.<number>", lists it in "<filePath>.segments", and
+ * starts a new empty history file. If compress is true, the sealed
+ * segment is then compressed to "<filePath>.<number>.lz". Only
+ * moving the file happens in dpsoHistoryAppend(); updating the list
+ * and compression are done in the background.
+ *
+ * Segments are transparent to dpsoHistoryCount(), dpsoHistoryGet(),
+ * and dpsoHistorySearch(). dpsoHistoryOpen() only reads the list of
+ * segments; a segment is read when one of its entries is requested,
+ * and only one segment is kept in memory. dpsoHistoryClear() removes
+ * all segments.
+ *
+ * Rotation is disabled by default. In a background sync mode,
+ * sealing flushes the history.
+ *
+ * On failure, sets an error message (dpsoGetError()) and returns
+ * false. Reasons include:
+ *   * history is null
+ *   * maxSegmentSize < 0 or maxSegmentEntries < 0
+ */
+bool dpsoHistorySetRotation(
+    DpsoHistory* history,
+    int maxSegmentSize,
+    int maxSegmentEntries,
+    bool compress);
+
+
 /**
  * Get the number of history entries.
  */
@@ -66,11 +165,43 @@ bool dpsoHistoryAppend(
  * The function fills the entry with pointers to strings that remain
  * valid till the next call to a routine that modifies the history,
  * like dpsoHistoryAppend() or dpsoHistoryClear().
+ *
+ * The function can be called from multiple threads at the same time,
+ * as long as the history is not modified.
  */
 void dpsoHistoryGet(
     const DpsoHistory* history, int idx, DpsoHistoryEntry* entry);
 
 
+/**
+ * Search history entries by text.
+ *
+ * Finds entries whose texts contain the query, ignoring the case of
+ * ASCII letters. An empty query matches all entries. The indices of
+ * the found entries are written to the indices array in ascending
+ * order, i.e., from the oldest entry; at most maxIndices are written.
+ * indices can be null if maxIndices is 0.
+ *
+ * Returns the total number of found entries, which can be greater
+ * than maxIndices. Returns 0 if history or query is null.
+ *
+ * The first search loads or builds a search index, which is then
+ * kept up to date by dpsoHistoryAppend() and saved to a file next to
+ * the history by dpsoHistoryClose(), so subsequent searches don't
+ * need to scan all entries. Queries shorter than 3 bytes still scan
+ * all entries.
+ *
+ * Like dpsoHistoryGet(), the function can be called from multiple
+ * threads at the same time, as long as the history is not modified.
+ * Concurrent searches are serialized.
+ */
+int dpsoHistorySearch(
+    const DpsoHistory* history,
+    const char* query,
+    int* indices,
+    int maxIndices);
+
+
 /**
  * Clear the history.
  *
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace dpso {
+
+
+// 32-bit FNV-1a, used to validate history index files.
+const std::uint32_t initialHistoryChecksum = 2166136261;
+
+
+inline std::uint32_t updateHistoryChecksum(
+    std::uint32_t checksum, const void* data, std::size_t size)
+{
+    const auto* bytes = static_cast<const std::uint8_t*>(data);
+    for (std::size_t i{}; i < size; ++i) {
+        checksum ^= bytes[i];
+        checksum *= 16777619;
+    }
+
+    return checksum;
+}
+
+
+}
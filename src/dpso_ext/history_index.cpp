@@ -0,0 +1,259 @@
+#include "history_index.h"
+
+#include <cstring>
+#include <limits>
+#include <memory>
+
+#include "dpso_utils/byte_order.h"
+#include "dpso_utils/mapped_file.h"
+#include "dpso_utils/os.h"
+#include "dpso_utils/stream/utils.h"
+
+#include "history_checksum.h"
+
+
+// The index file starts with a signature, followed by a record for
+// each history entry. A record consists of 4 little-endian 32-bit
+// fields:
+//
+//   * Timestamp length
+//   * Text length
+//   * Checksum of the entry data, from the start of the timestamp to
+//     the end of the text
+//   * Checksum of the previous fields, chained from the previous
+//     record
+//
+// Entry positions are derived from the lengths. Because of the
+// chained checksums, any whole-record prefix of the file is a valid
+// index of a history prefix, so the file doesn't need to be synced:
+// if the tail is lost or damaged, it's truncated, and the missing
+// entries are parsed from the history. The index is validated
+// against the history by the data size and the checksum of the last
+// indexed entry.
+
+
+namespace dpso {
+namespace {
+
+
+const char signature[] = "DPSOHIX1";
+const auto signatureSize = sizeof(signature) - 1;
+
+const std::size_t recordSize = 16;
+const std::size_t recordChecksumPos = 12;
+
+
+std::uint32_t loadU32(const std::uint8_t* data)
+{
+    std::uint32_t v;
+    load<ByteOrder::little>(v, data);
+    return v;
+}
+
+
+std::uint32_t getEntryChecksum(
+    const HistoryIndex::Entry& e, std::string_view data)
+{
+    return updateHistoryChecksum(
+        initialHistoryChecksum,
+        data.data() + e.timestampPos,
+        e.textPos + e.textLen - e.timestampPos);
+}
+
+
+}
+
+
+std::string HistoryIndex::getFilePath(
+    std::string_view historyFilePath)
+{
+    return std::string{historyFilePath} + ".idx";
+}
+
+
+HistoryIndex::HistoryIndex(std::string_view filePath)
+    : filePath{filePath}
+    , rewriteFile{true}
+    , failed{}
+    , numSavedEntries{}
+    , checksum{initialHistoryChecksum}
+{
+}
+
+
+HistoryIndex::~HistoryIndex() = default;
+
+
+void HistoryIndex::load(std::string_view data)
+{
+    file.reset();
+    entries.clear();
+    rewriteFile = true;
+    failed = false;
+    numSavedEntries = 0;
+    checksum = initialHistoryChecksum;
+
+    std::unique_ptr<os::MappedFile> mapping;
+    try {
+        mapping = std::make_unique<os::MappedFile>(filePath);
+    } catch (os::Error&) {
+        return;
+    }
+
+    const auto* fileData = mapping->getData();
+    const auto fileSize = mapping->getSize();
+
+    if (fileSize < signatureSize
+            || std::memcmp(fileData, signature, signatureSize) != 0)
+        return;
+
+    entries.reserve((fileSize - signatureSize) / recordSize);
+
+    auto newChecksum = checksum;
+    std::uint32_t lastEntryChecksum{};
+
+    for (auto pos = signatureSize;
+            fileSize - pos >= recordSize;
+            pos += recordSize) {
+        const auto* record = fileData + pos;
+
+        const auto expectedChecksum = updateHistoryChecksum(
+            newChecksum, record, recordChecksumPos);
+        if (loadU32(record + recordChecksumPos) != expectedChecksum)
+            break;
+
+        Entry e{};
+        e.timestampPos = getDataSize() + (entries.empty() ? 0 : 2);
+        e.timestampLen = loadU32(record);
+        e.textPos = e.timestampPos + e.timestampLen + 2;
+        e.textLen = loadU32(record + 4);
+
+        if (e.textPos + e.textLen > data.size())
+            break;
+
+        entries.push_back(e);
+        newChecksum = expectedChecksum;
+        lastEntryChecksum = loadU32(record + 8);
+    }
+
+    if (!entries.empty()
+            && getEntryChecksum(entries.back(), data)
+                != lastEntryChecksum) {
+        entries.clear();
+        return;
+    }
+
+    const auto validFileSize =
+        signatureSize + entries.size() * recordSize;
+
+    // The file should not be truncated while mapped.
+    mapping.reset();
+
+    if (validFileSize != fileSize)
+        try {
+            os::resizeFile(filePath, validFileSize);
+        } catch (os::Error&) {
+            entries.clear();
+            return;
+        }
+
+    rewriteFile = false;
+    numSavedEntries = entries.size();
+    checksum = newChecksum;
+}
+
+
+std::size_t HistoryIndex::getDataSize() const
+{
+    if (entries.empty())
+        return 0;
+
+    const auto& e = entries.back();
+    return e.textPos + e.textLen;
+}
+
+
+void HistoryIndex::add(const Entry& entry)
+{
+    entries.push_back(entry);
+}
+
+
+void HistoryIndex::save(std::string_view data)
+{
+    if (failed
+            || (!rewriteFile && numSavedEntries == entries.size()))
+        return;
+
+    std::string records;
+    auto newChecksum =
+        rewriteFile ? initialHistoryChecksum : checksum;
+
+    for (auto i = rewriteFile ? 0 : numSavedEntries;
+            i < entries.size();
+            ++i) {
+        const auto& e = entries[i];
+
+        const auto maxLen = std::numeric_limits<std::uint32_t>::max();
+        if (e.timestampLen > maxLen || e.textLen > maxLen) {
+            failed = true;
+            file.reset();
+            return;
+        }
+
+        std::uint8_t record[recordSize];
+        store<ByteOrder::little>(
+            static_cast<std::uint32_t>(e.timestampLen), record);
+        store<ByteOrder::little>(
+            static_cast<std::uint32_t>(e.textLen), record + 4);
+        store<ByteOrder::little>(
+            getEntryChecksum(e, data), record + 8);
+
+        newChecksum = updateHistoryChecksum(
+            newChecksum, record, recordChecksumPos);
+        store<ByteOrder::little>(
+            newChecksum, record + recordChecksumPos);
+
+        records.append(
+            reinterpret_cast<const char*>(record), recordSize);
+    }
+
+    try {
+        if (rewriteFile) {
+            file.reset();
+            file.emplace(filePath, FileStream::Mode::write);
+            write(*file, {signature, signatureSize});
+        } else if (!file)
+            file.emplace(filePath, FileStream::Mode::append);
+
+        write(*file, records);
+    } catch (os::Error&) {
+        failed = true;
+    } catch (StreamError&) {
+        failed = true;
+    }
+
+    if (failed) {
+        file.reset();
+        return;
+    }
+
+    rewriteFile = false;
+    numSavedEntries = entries.size();
+    checksum = newChecksum;
+}
+
+
+void HistoryIndex::clear()
+{
+    entries.clear();
+    rewriteFile = true;
+    failed = false;
+    numSavedEntries = 0;
+    checksum = initialHistoryChecksum;
+
+    save({});
+}
+
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dpso_utils/stream/file_stream.h"
+
+
+namespace dpso {
+
+
+// Offsets of history entries, persisted in a sidecar file.
+//
+// The index lets the history skip parsing the entries it covers on
+// open. It's only an optimization: IO errors are ignored, and a
+// missing, damaged, or stale file is rebuilt from the history data.
+class HistoryIndex {
+public:
+    struct Entry {
+        std::size_t timestampPos;
+        std::size_t timestampLen;
+        std::size_t textPos;
+        std::size_t textLen;
+    };
+
+    static std::string getFilePath(std::string_view historyFilePath);
+
+    explicit HistoryIndex(std::string_view filePath);
+    ~HistoryIndex();
+
+    HistoryIndex(const HistoryIndex&) = delete;
+    HistoryIndex& operator=(const HistoryIndex&) = delete;
+
+    HistoryIndex(HistoryIndex&&) = delete;
+    HistoryIndex& operator=(HistoryIndex&&) = delete;
+
+    // Load entries from the file. data is the history file data; the
+    // function only reads the last indexed entry from it to validate
+    // the index. The loaded entries may cover only a prefix of the
+    // data; the caller should parse the rest and add() the entries.
+    void load(std::string_view data);
+
+    const std::vector<Entry>& getEntries() const
+    {
+        return entries;
+    }
+
+    // Size of the history data covered by the entries.
+    std::size_t getDataSize() const;
+
+    // Add an entry to memory. Call save() to write it to the file.
+    void add(const Entry& entry);
+
+    // Write the entries added since the last save. data is the
+    // history file data, which must contain all the entries.
+    void save(std::string_view data);
+
+    // Remove all entries, including the ones in the file.
+    void clear();
+private:
+    std::string filePath;
+    std::vector<Entry> entries;
+
+    std::optional<FileStream> file;
+    // Whether the file should be recreated on the next save().
+    bool rewriteFile;
+    // Whether the file is abandoned due to an IO error.
+    bool failed;
+    std::size_t numSavedEntries;
+    // Checksum of the saved records.
+    std::uint32_t checksum;
+};
+
+
+}
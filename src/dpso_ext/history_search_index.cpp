@@ -0,0 +1,384 @@
+#include "history_search_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "dpso_utils/byte_order.h"
+#include "dpso_utils/os.h"
+
+#include "history_checksum.h"
+
+
+// The index file consists of little-endian 32-bit values:
+//
+//   * Number of entries
+//   * Checksum of the text of the last entry
+//   * Number of trigrams
+//   * For each trigram:
+//     * Trigram
+//     * Number of entries that contain it
+//     * Entry indices; each one is stored as a LEB128-encoded
+//       difference from the previous index, or from 0 for the first
+//       one
+//   * Checksum of all the previous data
+//
+// The data is preceded by a signature. The file is rewritten as a
+// whole; entries appended after the last save are indexed again on
+// the next load.
+
+
+namespace dpso {
+namespace {
+
+
+const char signature[] = "DPSOHSX1";
+const auto signatureSize = sizeof(signature) - 1;
+
+
+char toLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+}
+
+
+// Add unique trigrams of the text in ascending order.
+void getTrigrams(
+    std::string_view text, std::vector<std::uint32_t>& trigrams)
+{
+    trigrams.clear();
+    if (text.size() < 3)
+        return;
+
+    std::uint32_t trigram{};
+    for (std::size_t i{}; i < text.size(); ++i) {
+        trigram =
+            ((trigram << 8) & 0xffffff)
+            | static_cast<std::uint8_t>(toLowerAscii(text[i]));
+        if (i >= 2)
+            trigrams.push_back(trigram);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(
+        std::unique(trigrams.begin(), trigrams.end()),
+        trigrams.end());
+}
+
+
+bool containsIgnoreCase(std::string_view str, std::string_view substr)
+{
+    return std::search(
+        str.begin(), str.end(),
+        substr.begin(), substr.end(),
+        [](char a, char b)
+        {
+            return toLowerAscii(a) == toLowerAscii(b);
+        }) != str.end()
+        || substr.empty();
+}
+
+
+std::uint32_t getTextChecksum(std::string_view text)
+{
+    return updateHistoryChecksum(
+        initialHistoryChecksum, text.data(), text.size());
+}
+
+
+void appendU32(std::string& data, std::uint32_t v)
+{
+    char buf[4];
+    store<ByteOrder::little>(v, buf);
+    data.append(buf, sizeof(buf));
+}
+
+
+void appendVarint(std::string& data, std::uint32_t v)
+{
+    while (v >= 0x80) {
+        data += static_cast<char>((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+
+    data += static_cast<char>(v);
+}
+
+
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : data{data}
+    {
+    }
+
+    bool readU32(std::uint32_t& v)
+    {
+        if (data.size() - pos < 4)
+            return false;
+
+        load<ByteOrder::little>(v, data.data() + pos);
+        pos += 4;
+        return true;
+    }
+
+    bool readVarint(std::uint32_t& v)
+    {
+        v = 0;
+        for (int shift{}; shift < 32; shift += 7) {
+            if (pos == data.size())
+                return false;
+
+            const auto b = static_cast<std::uint8_t>(data[pos++]);
+            v |= static_cast<std::uint32_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool getIsAtEnd() const
+    {
+        return pos == data.size();
+    }
+private:
+    std::string_view data;
+    std::size_t pos{};
+};
+
+
+}
+
+
+std::string HistorySearchIndex::getFilePath(
+    std::string_view historyFilePath)
+{
+    return std::string{historyFilePath} + ".search";
+}
+
+
+HistorySearchIndex::HistorySearchIndex(std::string_view filePath)
+    : filePath{filePath}
+    , isLoaded{}
+    , isModified{}
+    , numEntries{}
+    , lastTextChecksum{}
+{
+}
+
+
+void HistorySearchIndex::load(
+    std::size_t numEntries, const TextGetter& getText)
+{
+    isLoaded = true;
+    isModified = false;
+
+    if (!loadFile()
+            || this->numEntries > numEntries
+            || (this->numEntries > 0
+                && getTextChecksum(getText(this->numEntries - 1))
+                    != lastTextChecksum)) {
+        isModified = true;
+        this->numEntries = 0;
+        postings.clear();
+    }
+
+    for (auto i = this->numEntries; i < numEntries; ++i)
+        add(getText(i));
+}
+
+
+bool HistorySearchIndex::loadFile()
+{
+    numEntries = 0;
+    postings.clear();
+
+    std::string data;
+    try {
+        data = os::loadData(filePath);
+    } catch (os::Error&) {
+        return false;
+    }
+
+    if (data.size() < signatureSize + 4
+            || data.compare(0, signatureSize, signature) != 0)
+        return false;
+
+    const auto bodySize = data.size() - signatureSize - 4;
+
+    std::uint32_t checksum;
+    Reader{{data.data() + signatureSize + bodySize, 4}}.readU32(
+        checksum);
+    if (updateHistoryChecksum(
+            initialHistoryChecksum, data.data(), data.size() - 4)
+                != checksum)
+        return false;
+
+    Reader reader{{data.data() + signatureSize, bodySize}};
+
+    std::uint32_t fileNumEntries;
+    std::uint32_t numTrigrams;
+    if (!reader.readU32(fileNumEntries)
+            || !reader.readU32(lastTextChecksum)
+            || !reader.readU32(numTrigrams))
+        return false;
+
+    for (std::uint32_t i{}; i < numTrigrams; ++i) {
+        std::uint32_t trigram;
+        std::uint32_t numIndices;
+        if (!reader.readU32(trigram) || !reader.readU32(numIndices))
+            return false;
+
+        auto& indices = postings[trigram];
+        if (!indices.empty() || numIndices > fileNumEntries) {
+            postings.clear();
+            return false;
+        }
+
+        indices.reserve(numIndices);
+
+        std::uint32_t idx{};
+        for (std::uint32_t j{}; j < numIndices; ++j) {
+            std::uint32_t delta;
+            if (!reader.readVarint(delta)
+                    || (j > 0 && delta == 0)
+                    || delta >= fileNumEntries - idx) {
+                postings.clear();
+                return false;
+            }
+
+            idx += delta;
+            indices.push_back(idx);
+        }
+    }
+
+    if (!reader.getIsAtEnd()) {
+        postings.clear();
+        return false;
+    }
+
+    numEntries = fileNumEntries;
+    return true;
+}
+
+
+void HistorySearchIndex::add(std::string_view text)
+{
+    if (!isLoaded)
+        return;
+
+    std::vector<std::uint32_t> trigrams;
+    getTrigrams(text, trigrams);
+
+    for (auto trigram : trigrams)
+        postings[trigram].push_back(numEntries);
+
+    ++numEntries;
+    lastTextChecksum = getTextChecksum(text);
+    isModified = true;
+}
+
+
+void HistorySearchIndex::find(
+    std::string_view query,
+    const TextGetter& getText,
+    std::vector<std::size_t>& indices) const
+{
+    if (query.size() < 3) {
+        for (std::size_t i{}; i < numEntries; ++i)
+            if (containsIgnoreCase(getText(i), query))
+                indices.push_back(i);
+
+        return;
+    }
+
+    std::vector<std::uint32_t> trigrams;
+    getTrigrams(query, trigrams);
+
+    std::vector<const std::vector<std::uint32_t>*> lists;
+    for (auto trigram : trigrams) {
+        const auto iter = postings.find(trigram);
+        if (iter == postings.end())
+            return;
+
+        lists.push_back(&iter->second);
+    }
+
+    std::sort(
+        lists.begin(), lists.end(),
+        [](const auto* a, const auto* b)
+        {
+            return a->size() < b->size();
+        });
+
+    auto candidates = *lists[0];
+    std::vector<std::uint32_t> intersection;
+    for (std::size_t i = 1; i < lists.size() && !candidates.empty();
+            ++i) {
+        intersection.clear();
+        std::set_intersection(
+            candidates.begin(), candidates.end(),
+            lists[i]->begin(), lists[i]->end(),
+            std::back_inserter(intersection));
+        candidates.swap(intersection);
+    }
+
+    // Trigrams can be in the text in a different order, so we need
+    // to check the candidates.
+    for (auto idx : candidates)
+        if (containsIgnoreCase(getText(idx), query))
+            indices.push_back(idx);
+}
+
+
+void HistorySearchIndex::save()
+{
+    if (!isLoaded || !isModified)
+        return;
+
+    std::string data{signature, signatureSize};
+    appendU32(data, numEntries);
+    appendU32(data, lastTextChecksum);
+    appendU32(data, postings.size());
+
+    for (const auto& [trigram, indices] : postings) {
+        appendU32(data, trigram);
+        appendU32(data, indices.size());
+
+        std::uint32_t prevIdx{};
+        for (auto idx : indices) {
+            appendVarint(data, idx - prevIdx);
+            prevIdx = idx;
+        }
+    }
+
+    appendU32(
+        data,
+        updateHistoryChecksum(
+            initialHistoryChecksum, data.data(), data.size()));
+
+    try {
+        os::saveData(filePath, data);
+    } catch (os::Error&) {
+        return;
+    }
+
+    isModified = false;
+}
+
+
+void HistorySearchIndex::clear()
+{
+    isLoaded = false;
+    isModified = false;
+    numEntries = 0;
+    postings.clear();
+
+    try {
+        os::removeFile(filePath);
+    } catch (os::Error&) {
+    }
+}
+
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace dpso {
+
+
+// Trigram index for substring search over history texts.
+//
+// For each trigram (3 consecutive bytes, with ASCII letters in lower
+// case), the index keeps the ascending list of entries whose texts
+// contain it. A query is answered by intersecting the lists of its
+// trigrams and checking the remaining candidates.
+//
+// save() stores the index next to the history. load() only trusts
+// the file if it covers no more entries than the history has and the
+// checksum of the last covered text still matches, so a file left
+// from a cleared or replaced history is discarded. Failing to read
+// or write the file only costs a rebuild from the texts on the next
+// load.
+class HistorySearchIndex {
+public:
+    using TextGetter = std::function<std::string_view(std::size_t)>;
+
+    static std::string getFilePath(std::string_view historyFilePath);
+
+    explicit HistorySearchIndex(std::string_view filePath);
+
+    bool getIsLoaded() const
+    {
+        return isLoaded;
+    }
+
+    // Load the index from the file and add the history entries that
+    // it doesn't cover. getText() returns the text of the entry with
+    // the given index.
+    void load(std::size_t numEntries, const TextGetter& getText);
+
+    // Add text of the next entry. Does nothing if the index is not
+    // loaded.
+    void add(std::string_view text);
+
+    // Find entries with texts containing the query, ignoring the case
+    // of ASCII letters. The indices are added in ascending order. The
+    // index should be loaded.
+    void find(
+        std::string_view query,
+        const TextGetter& getText,
+        std::vector<std::size_t>& indices) const;
+
+    // Save the index to the file if it has changed since loading.
+    void save();
+
+    // Unload the index and remove the file.
+    void clear();
+private:
+    std::string filePath;
+    bool isLoaded;
+    bool isModified;
+
+    std::size_t numEntries;
+    // Checksum of the text of the last entry. Used to validate the
+    // file against the history.
+    std::uint32_t lastTextChecksum;
+    std::unordered_map<std::uint32_t, std::vector<std::uint32_t>>
+        postings;
+
+    bool loadFile();
+};
+
+
+}
@@ -0,0 +1,569 @@
+#include "history_segments.h"
+
+#include <algorithm>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include "dpso_utils/byte_order.h"
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/lz.h"
+#include "dpso_utils/os.h"
+#include "dpso_utils/str.h"
+
+#include "history_checksum.h"
+
+
+// The manifest file starts with a signature, followed by a record
+// for each segment and a checksum of all the previous data. A record
+// consists of 3 little-endian 32-bit fields:
+//
+//   * Segment number
+//   * Number of entries
+//   * Flags: 1 if the segment is compressed
+//
+// A compressed segment file starts with a signature, followed by the
+// 64-bit size of the original data, the 32-bit checksum of the
+// original data (both little-endian), and the lz::compress() output.
+
+
+namespace dpso {
+namespace {
+
+
+const char manifestSignature[] = "DPSOHSG1";
+const auto manifestSignatureSize = sizeof(manifestSignature) - 1;
+
+const std::size_t manifestRecordSize = 12;
+
+const char compressedSignature[] = "DPSOHLZ1";
+const auto compressedSignatureSize = sizeof(compressedSignature) - 1;
+
+const std::size_t compressedHeaderSize = compressedSignatureSize + 12;
+
+
+std::uint32_t loadU32(const char* data)
+{
+    std::uint32_t v;
+    load<ByteOrder::little>(v, data);
+    return v;
+}
+
+
+void appendU32(std::string& data, std::uint32_t v)
+{
+    char buf[4];
+    store<ByteOrder::little>(v, buf);
+    data.append(buf, sizeof(buf));
+}
+
+
+std::uint32_t getChecksum(std::string_view data)
+{
+    return updateHistoryChecksum(
+        initialHistoryChecksum, data.data(), data.size());
+}
+
+
+bool decompressSegment(std::string_view data, std::string& result)
+{
+    if (data.size() < compressedHeaderSize
+            || data.compare(
+                0,
+                compressedSignatureSize,
+                compressedSignature) != 0)
+        return false;
+
+    std::uint64_t size;
+    load<ByteOrder::little>(
+        size, data.data() + compressedSignatureSize);
+
+    const auto checksum = loadU32(
+        data.data() + compressedSignatureSize + 8);
+
+    if (size > result.max_size())
+        return false;
+
+    // lz::decompress() rejects sizes that the data can't expand to,
+    // but a damaged header can still request more than we can
+    // allocate.
+    try {
+        return lz::decompress(
+                data.substr(compressedHeaderSize), size, result)
+            && getChecksum(result) == checksum;
+    } catch (std::bad_alloc&) {
+        return false;
+    } catch (std::length_error&) {
+        return false;
+    }
+}
+
+
+// Parse the entries of a segment. Returns false if the data is
+// damaged.
+template<typename Entries>
+bool parseEntries(std::string_view data, Entries& entries)
+{
+    entries.clear();
+
+    for (std::size_t pos{}; pos < data.size();) {
+        const auto timestampPos = pos;
+        const auto timestampEnd = data.find('\n', pos);
+        if (timestampEnd == data.npos
+                || data.compare(timestampEnd, 2, "\n\n") != 0)
+            return false;
+
+        const auto textPos = timestampEnd + 2;
+        const auto textEnd = std::min(
+            data.find('\f', textPos), data.size());
+        if (textEnd < data.size()
+                && (data.compare(textEnd, 2, "\f\n") != 0
+                    || textEnd + 2 == data.size()))
+            return false;
+
+        entries.push_back({
+            timestampPos,
+            timestampEnd - timestampPos,
+            textPos,
+            textEnd - textPos});
+
+        pos = textEnd + 2;
+    }
+
+    return true;
+}
+
+
+}
+
+
+std::string HistorySegments::getManifestFilePath(
+    std::string_view historyFilePath)
+{
+    return std::string{historyFilePath} + ".segments";
+}
+
+
+HistorySegments::HistorySegments(std::string_view historyFilePath)
+    : historyFilePath{historyFilePath}
+    , manifestFilePath{getManifestFilePath(historyFilePath)}
+    , numEntries{}
+    , loadedFirstEntryIdx{}
+    , isSealing{}
+    , terminate{}
+{
+}
+
+
+HistorySegments::~HistorySegments()
+{
+    if (!sealThread.joinable())
+        return;
+
+    {
+        const std::lock_guard guard{mutex};
+        terminate = true;
+    }
+
+    sealCondVar.notify_one();
+    sealThread.join();
+}
+
+
+std::string HistorySegments::getSegmentFilePath(
+    const Segment& segment, bool compressed) const
+{
+    return str::format(
+        "{}.{}{}",
+        historyFilePath, segment.number, compressed ? ".lz" : "");
+}
+
+
+bool HistorySegments::load()
+{
+    cancelSealing();
+
+    {
+        const std::lock_guard guard{mutex};
+        unloadSegment();
+        segments.clear();
+    }
+
+    numEntries = 0;
+
+    if (!loadManifest())
+        return false;
+
+    // If sealing was interrupted, the uncompressed file may remain
+    // after updating the manifest, and the compressed file may
+    // remain if the manifest was not updated.
+    for (const auto& segment : segments)
+        try {
+            os::removeFile(
+                getSegmentFilePath(segment, !segment.isCompressed));
+        } catch (os::Error&) {
+        }
+
+    auto isModified = false;
+
+    while (true) {
+        Segment segment{
+            segments.empty() ? 1 : segments.back().number + 1,
+            0,
+            false};
+
+        const auto filePath = getSegmentFilePath(segment, false);
+
+        std::string data;
+        try {
+            data = os::loadData(filePath);
+        } catch (os::FileNotFoundError&) {
+            break;
+        } catch (os::Error& e) {
+            setError("os::loadData(\"{}\"): {}", filePath, e.what());
+            return false;
+        }
+
+        std::vector<LoadedEntry> entries;
+        if (!parseEntries(data, entries)) {
+            setError("Segment \"{}\" is damaged", filePath);
+            return false;
+        }
+
+        // The compressed file may be incomplete.
+        try {
+            os::removeFile(getSegmentFilePath(segment, true));
+        } catch (os::Error&) {
+        }
+
+        segment.numEntries = entries.size();
+        segments.push_back(segment);
+        numEntries += segment.numEntries;
+        isModified = true;
+    }
+
+    if (isModified)
+        saveManifest();
+
+    return true;
+}
+
+
+bool HistorySegments::loadManifest()
+{
+    std::string data;
+    try {
+        data = os::loadData(manifestFilePath);
+    } catch (os::FileNotFoundError&) {
+        return true;
+    } catch (os::Error& e) {
+        setError(
+            "os::loadData(\"{}\"): {}", manifestFilePath, e.what());
+        return false;
+    }
+
+    if (data.size() < manifestSignatureSize + 4
+            || (data.size() - manifestSignatureSize - 4)
+                % manifestRecordSize != 0
+            || data.compare(
+                0,
+                manifestSignatureSize,
+                manifestSignature) != 0
+            || getChecksum({data.data(), data.size() - 4})
+                != loadU32(data.data() + data.size() - 4)) {
+        setError("Manifest \"{}\" is damaged", manifestFilePath);
+        return false;
+    }
+
+    for (auto pos = manifestSignatureSize;
+            pos < data.size() - 4;
+            pos += manifestRecordSize) {
+        const auto* record = data.data() + pos;
+
+        const Segment segment{
+            loadU32(record),
+            loadU32(record + 4),
+            (loadU32(record + 8) & 1) != 0};
+
+        if (!segments.empty()
+                && segment.number <= segments.back().number) {
+            setError(
+                "Manifest \"{}\" has unordered segment numbers",
+                manifestFilePath);
+            segments.clear();
+            numEntries = 0;
+            return false;
+        }
+
+        segments.push_back(segment);
+        numEntries += segment.numEntries;
+    }
+
+    return true;
+}
+
+
+bool HistorySegments::saveManifest() const
+{
+    std::string data{manifestSignature, manifestSignatureSize};
+
+    {
+        const std::lock_guard guard{mutex};
+
+        for (const auto& segment : segments) {
+            appendU32(data, segment.number);
+            appendU32(data, segment.numEntries);
+            appendU32(data, segment.isCompressed ? 1 : 0);
+        }
+    }
+
+    appendU32(data, getChecksum(data));
+
+    try {
+        os::saveData(manifestFilePath, data);
+    } catch (os::Error&) {
+        return false;
+    }
+
+    return true;
+}
+
+
+bool HistorySegments::seal(std::size_t numEntries, bool compress)
+{
+    const Segment segment{
+        segments.empty() ? 1 : segments.back().number + 1,
+        numEntries,
+        false};
+
+    try {
+        os::replace(
+            historyFilePath, getSegmentFilePath(segment, false));
+    } catch (os::Error& e) {
+        setError("os::replace(): {}", e.what());
+        return false;
+    }
+
+    {
+        const std::lock_guard guard{mutex};
+        segments.push_back(segment);
+        sealTasks.push_back({segment.number, compress});
+    }
+
+    this->numEntries += numEntries;
+
+    if (!sealThread.joinable())
+        sealThread = std::thread{
+            &HistorySegments::sealThreadLoop, this};
+
+    sealCondVar.notify_one();
+    return true;
+}
+
+
+bool HistorySegments::compressSegment(const Segment& segment) const
+{
+    try {
+        const auto data = os::loadData(
+            getSegmentFilePath(segment, false));
+
+        std::string compressedData{
+            compressedSignature, compressedSignatureSize};
+
+        char buf[8];
+        store<ByteOrder::little>(
+            static_cast<std::uint64_t>(data.size()), buf);
+        compressedData.append(buf, sizeof(buf));
+
+        appendU32(compressedData, getChecksum(data));
+        compressedData += lz::compress(data);
+
+        os::saveData(
+            getSegmentFilePath(segment, true), compressedData);
+    } catch (os::Error&) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void HistorySegments::sealThreadLoop()
+{
+    std::unique_lock lock{mutex};
+    while (true) {
+        sealCondVar.wait(
+            lock, [&]{ return terminate || !sealTasks.empty(); });
+
+        // Finish the pending sealing before terminating.
+        if (sealTasks.empty())
+            break;
+
+        const auto task = sealTasks.front();
+        sealTasks.pop_front();
+        isSealing = true;
+
+        lock.unlock();
+        finishSealing(task);
+        lock.lock();
+
+        isSealing = false;
+        sealDoneCondVar.notify_all();
+    }
+}
+
+
+void HistorySegments::finishSealing(const SealTask& task)
+{
+    // The segment can't be removed while we are sealing it, since
+    // clear() and load() wait for us.
+    Segment segment{task.segmentNumber, 0, false};
+
+    const auto isCompressed =
+        task.compress && compressSegment(segment);
+
+    if (isCompressed) {
+        const std::lock_guard guard{mutex};
+
+        const auto iter = std::find_if(
+            segments.begin(), segments.end(),
+            [&](const Segment& s)
+            {
+                return s.number == segment.number;
+            });
+        if (iter != segments.end())
+            iter->isCompressed = true;
+    }
+
+    // A reader that loaded the segment before the flag was set
+    // already has its data, so the uncompressed file can go.
+    if (saveManifest() && isCompressed)
+        try {
+            os::removeFile(getSegmentFilePath(segment, false));
+        } catch (os::Error&) {
+        }
+}
+
+
+void HistorySegments::cancelSealing()
+{
+    std::unique_lock lock{mutex};
+    sealTasks.clear();
+    sealDoneCondVar.wait(lock, [&]{ return !isSealing; });
+}
+
+
+void HistorySegments::loadSegment(
+    std::size_t segmentIdx, std::size_t firstEntryIdx) const
+{
+    unloadSegment();
+
+    loadedSegmentIdx = segmentIdx;
+    loadedFirstEntryIdx = firstEntryIdx;
+
+    const auto& segment = segments[segmentIdx];
+
+    std::string data;
+    try {
+        data = os::loadData(
+            getSegmentFilePath(segment, segment.isCompressed));
+    } catch (os::Error&) {
+        return;
+    }
+
+    if (segment.isCompressed) {
+        if (!decompressSegment(data, loadedData)) {
+            loadedData.clear();
+            return;
+        }
+    } else
+        loadedData = std::move(data);
+
+    if (!parseEntries(loadedData, loadedEntries)
+            || loadedEntries.size() != segment.numEntries) {
+        loadedData.clear();
+        loadedEntries.clear();
+    }
+}
+
+
+void HistorySegments::unloadSegment() const
+{
+    loadedSegmentIdx.reset();
+    loadedData.clear();
+    loadedData.shrink_to_fit();
+    loadedEntries.clear();
+    loadedEntries.shrink_to_fit();
+    loadedFirstEntryIdx = 0;
+}
+
+
+void HistorySegments::getEntry(
+    std::size_t idx, std::string& timestamp, std::string& text) const
+{
+    const std::lock_guard guard{mutex};
+
+    if (!loadedSegmentIdx
+            || idx < loadedFirstEntryIdx
+            || idx - loadedFirstEntryIdx
+                >= segments[*loadedSegmentIdx].numEntries) {
+        std::size_t segmentIdx{};
+        std::size_t firstEntryIdx{};
+        while (idx - firstEntryIdx >= segments[segmentIdx].numEntries)
+            firstEntryIdx += segments[segmentIdx++].numEntries;
+
+        loadSegment(segmentIdx, firstEntryIdx);
+    }
+
+    const auto entryIdx = idx - loadedFirstEntryIdx;
+    if (entryIdx >= loadedEntries.size()) {
+        timestamp.clear();
+        text.clear();
+        return;
+    }
+
+    const auto& e = loadedEntries[entryIdx];
+    timestamp.assign(loadedData, e.timestampPos, e.timestampLen);
+    text.assign(loadedData, e.textPos, e.textLen);
+}
+
+
+bool HistorySegments::clear()
+{
+    cancelSealing();
+
+    {
+        const std::lock_guard guard{mutex};
+        unloadSegment();
+    }
+
+    // Remove the newest segments first, so that the remaining ones
+    // stay consistent with the manifest on failure.
+    while (!segments.empty()) {
+        const auto& segment = segments.back();
+
+        try {
+            os::removeFile(getSegmentFilePath(segment, false));
+            os::removeFile(getSegmentFilePath(segment, true));
+        } catch (os::Error& e) {
+            setError("os::removeFile(): {}", e.what());
+            saveManifest();
+            return false;
+        }
+
+        numEntries -= segment.numEntries;
+        segments.pop_back();
+    }
+
+    try {
+        os::removeFile(manifestFilePath);
+    } catch (os::Error& e) {
+        setError("os::removeFile(): {}", e.what());
+        return false;
+    }
+
+    return true;
+}
+
+
+}
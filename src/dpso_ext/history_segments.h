@@ -0,0 +1,153 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace dpso {
+
+
+// Sealed segments of the history.
+//
+// Sealing moves the history file to "<history file>.<number>", with
+// numbers starting from 1, and optionally compresses it to
+// "<history file>.<number>.lz". The segments are listed in the
+// manifest file along with the number of entries, so that the
+// entries can be counted without reading the segments.
+//
+// Only the move happens in seal(). Compression and updating the
+// manifest are done by a background thread, so that sealing doesn't
+// stall the thread that appends entries.
+//
+// Only one segment is kept in memory at a time; it's loaded on
+// demand by getEntry(), which can be called from multiple threads.
+class HistorySegments {
+public:
+    static std::string getManifestFilePath(
+        std::string_view historyFilePath);
+
+    explicit HistorySegments(std::string_view historyFilePath);
+
+    // Waits till the background thread finishes sealing.
+    ~HistorySegments();
+
+    HistorySegments(const HistorySegments&) = delete;
+    HistorySegments& operator=(const HistorySegments&) = delete;
+
+    HistorySegments(HistorySegments&&) = delete;
+    HistorySegments& operator=(HistorySegments&&) = delete;
+
+    // Load the manifest. A segment that is not in the manifest
+    // because sealing was interrupted is added to it.
+    //
+    // On failure, sets an error message (dpsoGetError()) and returns
+    // false.
+    bool load();
+
+    // Total number of entries in all segments.
+    std::size_t getNumEntries() const
+    {
+        return numEntries;
+    }
+
+    // Seal the history file that contains numEntries entries. The
+    // file should be closed. A new history file is not created.
+    //
+    // The entries of the segment are available right away.
+    // Compression and updating the manifest happen in the background;
+    // failing them is not an error: the segment stays uncompressed,
+    // and the manifest is fixed by the next load().
+    //
+    // On failure, sets an error message (dpsoGetError()) and returns
+    // false; the history file is left intact in this case.
+    bool seal(std::size_t numEntries, bool compress);
+
+    // idx should be less than getNumEntries(). If the segment can't
+    // be loaded, the strings are empty.
+    void getEntry(
+        std::size_t idx,
+        std::string& timestamp,
+        std::string& text) const;
+
+    // Remove all segments and the manifest. Sealing that has not
+    // started in the background yet is canceled.
+    //
+    // On failure, sets an error message (dpsoGetError()) and returns
+    // false; the segments that are not removed remain available.
+    bool clear();
+private:
+    struct Segment {
+        std::uint32_t number;
+        std::size_t numEntries;
+        bool isCompressed;
+    };
+
+    struct LoadedEntry {
+        std::size_t timestampPos;
+        std::size_t timestampLen;
+        std::size_t textPos;
+        std::size_t textLen;
+    };
+
+    std::string historyFilePath;
+    std::string manifestFilePath;
+
+    struct SealTask {
+        std::uint32_t segmentNumber;
+        bool compress;
+    };
+
+    // Protects the loaded segment and the sealing state. The
+    // background thread only accesses the segments with the mutex
+    // locked, and seal() locks it to add a segment. The rest of the
+    // methods that modify the segments first wait till the
+    // background thread is idle.
+    mutable std::mutex mutex;
+
+    std::vector<Segment> segments;
+    std::size_t numEntries;
+
+    // Index of the segment in loadedData. If the segment can't be
+    // loaded, loadedEntries is empty.
+    mutable std::optional<std::size_t> loadedSegmentIdx;
+    mutable std::string loadedData;
+    mutable std::vector<LoadedEntry> loadedEntries;
+    // Index of the first entry of the loaded segment.
+    mutable std::size_t loadedFirstEntryIdx;
+
+    std::condition_variable sealCondVar;
+    std::condition_variable sealDoneCondVar;
+    std::deque<SealTask> sealTasks;
+    bool isSealing;
+    bool terminate;
+    // Started by the first seal().
+    std::thread sealThread;
+
+    std::string getSegmentFilePath(
+        const Segment& segment, bool compressed) const;
+    bool loadManifest();
+    bool saveManifest() const;
+    bool compressSegment(const Segment& segment) const;
+
+    void sealThreadLoop();
+    void finishSealing(const SealTask& task);
+    // Cancel the pending sealing and wait till the current one is
+    // done.
+    void cancelSealing();
+
+    // Should be called with the mutex locked.
+    void loadSegment(
+        std::size_t segmentIdx, std::size_t firstEntryIdx) const;
+    void unloadSegment() const;
+};
+
+
+}
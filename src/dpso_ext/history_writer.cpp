@@ -0,0 +1,170 @@
+#include "history_writer.h"
+
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/os.h"
+#include "dpso_utils/str.h"
+
+
+namespace dpso {
+
+
+HistoryWriter::HistoryWriter(
+        FileStream& file,
+        std::size_t fileSize,
+        std::optional<std::chrono::milliseconds> syncInterval)
+    : file{file}
+    , syncInterval{syncInterval}
+    , queuedSize{fileSize}
+    , writtenSize{fileSize}
+    , syncedSize{fileSize}
+    , syncRequestSize{fileSize}
+    , terminate{}
+    , thread{&HistoryWriter::threadLoop, this}
+{
+}
+
+
+HistoryWriter::~HistoryWriter()
+{
+    {
+        const std::lock_guard guard{mutex};
+        syncRequestSize = queuedSize;
+        terminate = true;
+    }
+
+    queueCondVar.notify_one();
+    thread.join();
+}
+
+
+void HistoryWriter::write(std::string_view data)
+{
+    {
+        const std::lock_guard guard{mutex};
+        if (!error.empty())
+            return;
+
+        queue += data;
+        queuedSize += data.size();
+    }
+
+    queueCondVar.notify_one();
+}
+
+
+std::size_t HistoryWriter::getWrittenSize() const
+{
+    const std::lock_guard guard{mutex};
+    return writtenSize;
+}
+
+
+std::string HistoryWriter::getError() const
+{
+    const std::lock_guard guard{mutex};
+    return error;
+}
+
+
+bool HistoryWriter::flush()
+{
+    std::unique_lock lock{mutex};
+
+    const auto targetSize = queuedSize;
+    if (syncRequestSize < targetSize)
+        syncRequestSize = targetSize;
+
+    queueCondVar.notify_one();
+    writtenCondVar.wait(
+        lock,
+        [&]
+        {
+            return syncedSize >= targetSize || !error.empty();
+        });
+
+    if (!error.empty()) {
+        setError("{}", error);
+        return false;
+    }
+
+    return true;
+}
+
+
+void HistoryWriter::threadLoop()
+{
+    std::chrono::steady_clock::time_point lastSyncTime;
+
+    std::unique_lock lock{mutex};
+    while (true) {
+        queueCondVar.wait(
+            lock,
+            [&]
+            {
+                return terminate
+                    || (error.empty()
+                        && (!queue.empty()
+                            || syncRequestSize > syncedSize));
+            });
+
+        if (!error.empty()
+                || (queue.empty() && syncRequestSize <= syncedSize))
+            break;
+
+        // Let more data accumulate till the end of the sync
+        // interval, unless a sync is requested explicitly.
+        if (syncInterval && syncRequestSize <= syncedSize)
+            queueCondVar.wait_until(
+                lock,
+                lastSyncTime + *syncInterval,
+                [&]
+                {
+                    return terminate || syncRequestSize > syncedSize;
+                });
+
+        const auto data = std::move(queue);
+        queue.clear();
+
+        const auto dataEndSize = queuedSize;
+        const auto needSync =
+            syncInterval || syncRequestSize > syncedSize;
+
+        lock.unlock();
+
+        std::string newError;
+        try {
+            file.write(data.data(), data.size());
+            if (!needSync)
+                file.flush();
+        } catch (StreamError& e) {
+            newError = str::format("write(file, ...): {}", e.what());
+        }
+
+        if (newError.empty() && needSync) {
+            try {
+                file.sync();
+            } catch (os::Error& e) {
+                newError = str::format(
+                    "FileStream::sync(): {}", e.what());
+            }
+
+            lastSyncTime = std::chrono::steady_clock::now();
+        }
+
+        lock.lock();
+
+        if (newError.empty()) {
+            writtenSize = dataEndSize;
+            if (needSync)
+                syncedSize = dataEndSize;
+        } else {
+            error = newError;
+            queue.clear();
+        }
+
+        writtenCondVar.notify_all();
+    }
+}
+
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "dpso_utils/stream/file_stream.h"
+
+
+namespace dpso {
+
+
+// Group-commit writer for the history file.
+//
+// Data is queued by write() and written by a background thread,
+// which takes everything queued so far with a single write, so a
+// burst of entries costs one write and one sync.
+//
+// After an IO error, the writer discards all data; getError() can be
+// used to detect this.
+class HistoryWriter {
+public:
+    // fileSize is the current size of the file. If syncInterval is
+    // set, the written data is synced at most once per interval,
+    // which also delays the writes. Otherwise, the data is written
+    // as soon as possible but only synced by flush() and the
+    // destructor.
+    HistoryWriter(
+        FileStream& file,
+        std::size_t fileSize,
+        std::optional<std::chrono::milliseconds> syncInterval);
+
+    // Flushes the data, ignoring errors.
+    ~HistoryWriter();
+
+    HistoryWriter(const HistoryWriter&) = delete;
+    HistoryWriter& operator=(const HistoryWriter&) = delete;
+
+    HistoryWriter(HistoryWriter&&) = delete;
+    HistoryWriter& operator=(HistoryWriter&&) = delete;
+
+    void write(std::string_view data);
+
+    // File size including the data written so far. The data may not
+    // be synced yet, but is visible to other readers of the file.
+    std::size_t getWrittenSize() const;
+
+    // Empty if there were no IO errors.
+    std::string getError() const;
+
+    // Wait till all the data is written and synced.
+    //
+    // On failure, sets an error message (dpsoGetError()) and returns
+    // false.
+    bool flush();
+private:
+    FileStream& file;
+    const std::optional<std::chrono::milliseconds> syncInterval;
+
+    mutable std::mutex mutex;
+    std::condition_variable queueCondVar;
+    std::condition_variable writtenCondVar;
+
+    std::string queue;
+    std::size_t queuedSize;
+    std::size_t writtenSize;
+    std::size_t syncedSize;
+    // Size to sync regardless of syncInterval.
+    std::size_t syncRequestSize;
+    std::string error;
+    bool terminate;
+
+    std::thread thread;
+
+    void threadLoop();
+};
+
+
+}
@@ -3,6 +3,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <utility>
 
 #include "dpso_utils/error_set.h"
 
@@ -15,21 +16,23 @@ struct DpsoImg {
     int w;
     int h;
     int pitch;
-    std::unique_ptr<std::uint8_t[]> data;
+    std::uint8_t* data;
+    // Keeps the data alive.
+    std::shared_ptr<void> dataHolder;
 };
 
 
-DpsoImg* dpsoImgCreate(
-    DpsoPxFormat pxFormat, int w, int h, int pitch)
+static bool checkParams(
+    DpsoPxFormat pxFormat, int w, int h, int& pitch)
 {
     if (w < 1) {
         setError("w < 1");
-        return {};
+        return false;
     }
 
     if (h < 1) {
         setError("h < 1");
-        return {};
+        return false;
     }
 
     const auto minPitch = w * dpsoPxFormatGetBytesPerPx(pxFormat);
@@ -40,18 +43,59 @@ DpsoImg* dpsoImgCreate(
         setError(
             "pitch < {} (w * {})",
             minPitch, dpsoPxFormatGetBytesPerPx(pxFormat));
+        return false;
+    }
+
+    return true;
+}
+
+
+DpsoImg* dpsoImgCreate(
+    DpsoPxFormat pxFormat, int w, int h, int pitch)
+{
+    if (!checkParams(pxFormat, w, h, pitch))
+        return {};
+
+    // We don't use std::make_unique so that the array is not
+    // value-initialized.
+    std::shared_ptr<std::uint8_t[]> data{
+        new std::uint8_t[static_cast<std::size_t>(pitch) * h]};
+
+    return new DpsoImg{pxFormat, w, h, pitch, data.get(), data};
+}
+
+
+DpsoImg* dpsoImgCreateFromData(
+    DpsoPxFormat pxFormat,
+    int w,
+    int h,
+    int pitch,
+    uint8_t* data,
+    DpsoImgReleaseFn releaseFn,
+    void* userData)
+{
+    if (!data) {
+        setError("data is null");
         return {};
     }
 
+    // Check before creating the holder, since the callback should not
+    // be called on failure.
+    if (!checkParams(pxFormat, w, h, pitch))
+        return {};
+
+    // Unlike unique_ptr, shared_ptr calls the deleter even if the
+    // pointer (userData) is null.
+    std::shared_ptr<void> dataHolder{
+        userData,
+        [releaseFn](void* userData)
+        {
+            if (releaseFn)
+                releaseFn(userData);
+        }};
+
     return new DpsoImg{
-        pxFormat,
-        w,
-        h,
-        pitch,
-        // We don't use std::make_unique so that the array is not
-        // value-initialized.
-        std::unique_ptr<std::uint8_t[]>{
-            new std::uint8_t[static_cast<std::size_t>(pitch) * h]}};
+        pxFormat, w, h, pitch, data, std::move(dataHolder)};
 }
 
 
@@ -87,11 +131,39 @@ int dpsoImgGetPitch(const DpsoImg* img)
 
 const uint8_t* dpsoImgGetConstData(const DpsoImg* img)
 {
-    return img ? img->data.get() : nullptr;
+    return img ? img->data : nullptr;
 }
 
 
 uint8_t* dpsoImgGetData(DpsoImg* img)
 {
-    return img ? img->data.get() : nullptr;
+    return img ? img->data : nullptr;
+}
+
+
+namespace dpso::img {
+
+
+ImgUPtr createImg(
+    DpsoPxFormat pxFormat,
+    int w,
+    int h,
+    int pitch,
+    std::uint8_t* data,
+    std::shared_ptr<void> dataHolder)
+{
+    if (!data) {
+        setError("data is null");
+        return {};
+    }
+
+    if (!checkParams(pxFormat, w, h, pitch))
+        return {};
+
+    return ImgUPtr{
+        new DpsoImg{
+            pxFormat, w, h, pitch, data, std::move(dataHolder)}};
+}
+
+
 }
@@ -30,6 +30,43 @@ DpsoImg* dpsoImgCreate(
     DpsoPxFormat pxFormat, int w, int h, int pitch);
 
 
+/**
+ * Function to release external pixel data of an image.
+ *
+ * See dpsoImgCreateFromData().
+ */
+typedef void (*DpsoImgReleaseFn)(void* userData);
+
+
+/**
+ * Create an image over existing pixel data.
+ *
+ * Unlike dpsoImgCreate(), the image doesn't allocate its own storage
+ * but uses the data directly, so you don't have to copy a frame you
+ * already have in memory. The pitch has the same meaning as in
+ * dpsoImgCreate().
+ *
+ * The data should remain valid till the image is deleted, at which
+ * point releaseFn (if not null) is called with userData. Keep in
+ * mind that the image may be deleted in a background thread: for
+ * example, dpsoOcrQueueJob() takes ownership of the image and
+ * deletes it as soon as the job no longer needs it, which is usually
+ * long before the result is ready. releaseFn should therefore be
+ * safe to call from any thread.
+ *
+ * On failure, sets an error message (dpsoGetError()) and returns
+ * null. releaseFn is not called in this case.
+ */
+DpsoImg* dpsoImgCreateFromData(
+    DpsoPxFormat pxFormat,
+    int w,
+    int h,
+    int pitch,
+    uint8_t* data,
+    DpsoImgReleaseFn releaseFn,
+    void* userData);
+
+
 void dpsoImgDelete(DpsoImg* img);
 
 
@@ -46,6 +83,7 @@ uint8_t* dpsoImgGetData(DpsoImg* img);
 }
 
 
+#include <cstdint>
 #include <memory>
 
 
@@ -63,6 +101,22 @@ struct ImgDeleter {
 using ImgUPtr = std::unique_ptr<DpsoImg, ImgDeleter>;
 
 
+// Create an image that uses external pixel data instead of allocating
+// its own. The image keeps a reference to dataHolder, which should
+// keep the data valid, till the image is deleted. The pitch has the
+// same meaning as in dpsoImgCreate().
+//
+// On failure, sets an error message (dpsoGetError()) and returns
+// null.
+ImgUPtr createImg(
+    DpsoPxFormat pxFormat,
+    int w,
+    int h,
+    int pitch,
+    std::uint8_t* data,
+    std::shared_ptr<void> dataHolder);
+
+
 }
 
 
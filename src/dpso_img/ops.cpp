@@ -3,16 +3,39 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdlib>
+#include <iterator>
 #include <vector>
 
+#include "dpso_utils/thread_pool.h"
+
+#include "upscale_fixed_point.h"
+
 
 namespace dpso::img {
 
 
-static std::uint8_t rgbToGray(
-    std::uint8_t r, std::uint8_t g, std::uint8_t b)
+ChannelOffsets getChannelOffsets(DpsoPxFormat pxFormat)
 {
-    return (r * 2126 + g * 7152 + b * 722) / 10000;
+    switch (pxFormat) {
+    case DpsoPxFormatGrayscale:
+        return {0, 0, 0, -1};
+    case DpsoPxFormatRgb:
+        return {0, 1, 2, -1};
+    case DpsoPxFormatBgr:
+        return {2, 1, 0, -1};
+    case DpsoPxFormatRgba:
+        return {0, 1, 2, 3};
+    case DpsoPxFormatBgra:
+        return {2, 1, 0, 3};
+    case DpsoPxFormatArgb:
+        return {1, 2, 3, 0};
+    case DpsoPxFormatAbgr:
+        return {3, 2, 1, 0};
+    }
+
+    assert(false);
+    return {0, 0, 0, -1};
 }
 
 
@@ -71,25 +94,171 @@ void toGray(
 }
 
 
-struct Upscale::Impl {
-    struct Filter {
-        static constexpr auto size{4};
+void convertPxFormat(
+    const std::uint8_t* src, int srcPitch, DpsoPxFormat srcPxFormat,
+    std::uint8_t* dst, int dstPitch, DpsoPxFormat dstPxFormat,
+    int w, int h)
+{
+    if (dstPxFormat == DpsoPxFormatGrayscale) {
+        toGray(src, srcPitch, srcPxFormat, dst, dstPitch, w, h);
+        return;
+    }
+
+    const auto srcBpp = dpsoPxFormatGetBytesPerPx(srcPxFormat);
+    const auto dstBpp = dpsoPxFormatGetBytesPerPx(dstPxFormat);
+    const auto srcOffsets = getChannelOffsets(srcPxFormat);
+    const auto dstOffsets = getChannelOffsets(dstPxFormat);
+
+    for (int y{}; y < h; ++y) {
+        const auto* srcPx = src + y * srcPitch;
+        auto* dstPx = dst + y * dstPitch;
+
+        for (int x{}; x < w; ++x) {
+            dstPx[dstOffsets.r] = srcPx[srcOffsets.r];
+            dstPx[dstOffsets.g] = srcPx[srcOffsets.g];
+            dstPx[dstOffsets.b] = srcPx[srcOffsets.b];
+            if (dstOffsets.a != -1)
+                dstPx[dstOffsets.a] =
+                    srcOffsets.a != -1 ? srcPx[srcOffsets.a] : 255;
+
+            srcPx += srcBpp;
+            dstPx += dstBpp;
+        }
+    }
+}
+
+
+// In parallel mode, images are split into bands of rows. Smaller
+// images are not worth the overhead of distributing the work.
+const auto minBandNumPx = 128 * 1024;
+
 
-        int idx[size];
-        float weights[size];
+static int getNumBands(const ThreadPool* threadPool, int w, int h)
+{
+    if (!threadPool)
+        return 1;
+
+    const auto numPx = static_cast<std::int64_t>(w) * h;
+    return static_cast<int>(
+        std::clamp<std::int64_t>(
+            numPx / minBandNumPx,
+            1,
+            std::min(threadPool->getConcurrency(), h)));
+}
+
+
+// Call fn(bandIdx, y0, y1) for each band of rows [y0, y1).
+template<typename Fn>
+static void forEachBand(
+    ThreadPool* threadPool, int numBands, int h, Fn fn)
+{
+    const auto getBandY = [=](int bandIdx)
+    {
+        return static_cast<int>(
+            static_cast<std::int64_t>(h) * bandIdx / numBands);
     };
 
-    std::vector<Filter> filters;
-    std::vector<float> tmp;
+    if (numBands == 1) {
+        fn(0, 0, h);
+        return;
+    }
 
-    void fillFilters(int srcSize, int dstSize);
-    void scale(
-        const std::uint8_t* src, int srcW, int srcH, int srcPitch,
-        std::uint8_t* dst, int dstW, int dstH, int dstPitch);
+    threadPool->parallelFor(
+        numBands,
+        [&](int bandIdx)
+        {
+            fn(bandIdx, getBandY(bandIdx), getBandY(bandIdx + 1));
+        });
+}
+
+
+void toGray(
+    const std::uint8_t* src, int srcPitch, DpsoPxFormat srcPxFormat,
+    std::uint8_t* dst, int dstPitch,
+    int w, int h,
+    ThreadPool* threadPool)
+{
+    forEachBand(
+        threadPool, getNumBands(threadPool, w, h), h,
+        [&](int, int y0, int y1)
+        {
+            toGray(
+                src + y0 * srcPitch, srcPitch, srcPxFormat,
+                dst + y0 * dstPitch, dstPitch,
+                w, y1 - y0);
+        });
+}
+
+
+int estimateTextLineHeight(
+    const std::uint8_t* src, int srcPitch, int w, int h)
+{
+    if (w < 1 || h < 1 || srcPitch < w)
+        return 0;
+
+    int hist[256]{};
+    for (int y{}; y < h; ++y) {
+        const auto* srcRow = src + y * srcPitch;
+        for (int x{}; x < w; ++x)
+            ++hist[srcRow[x]];
+    }
+
+    const int bg = std::max_element(std::begin(hist), std::end(hist))
+        - std::begin(hist);
+
+    // The threshold is high enough to ignore subtle background
+    // gradients and low enough to catch antialiased glyph edges.
+    const auto inkThreshold = 48;
+    // Ignore rows with just a few stray pixels, like noise or thin
+    // vertical lines of table borders.
+    const auto minInkPx = std::max(1, w / 200);
+
+    std::vector<int> lineHeights;
+    int lineHeight{};
+
+    for (int y{}; y < h; ++y) {
+        const auto* srcRow = src + y * srcPitch;
+
+        int numInkPx{};
+        for (int x{}; x < w; ++x)
+            numInkPx += std::abs(srcRow[x] - bg) > inkThreshold;
+
+        if (numInkPx >= minInkPx)
+            ++lineHeight;
+        else if (lineHeight > 0) {
+            lineHeights.push_back(lineHeight);
+            lineHeight = 0;
+        }
+    }
+
+    if (lineHeight > 0)
+        lineHeights.push_back(lineHeight);
+
+    if (lineHeights.empty())
+        return 0;
+
+    const auto median = lineHeights.begin() + lineHeights.size() / 2;
+    std::nth_element(lineHeights.begin(), median, lineHeights.end());
+    return *median;
+}
+
+
+namespace {
+
+
+struct CatmullRomFilter {
+    static constexpr auto size{4};
+
+    int idx[size];
+    float weights[size];
 };
 
 
-void Upscale::Impl::fillFilters(int srcSize, int dstSize)
+}
+
+
+static void fillFilters(
+    std::vector<CatmullRomFilter>& filters, int srcSize, int dstSize)
 {
     filters.resize(dstSize);
 
@@ -127,49 +296,253 @@ void Upscale::Impl::fillFilters(int srcSize, int dstSize)
 }
 
 
-void Upscale::Impl::scale(
-    const std::uint8_t* src, int srcW, int srcH, int srcPitch,
-    std::uint8_t* dst, int dstW, int dstH, int dstPitch)
+static void hScaleRow(
+    const std::uint8_t* srcRow,
+    float* dstRow,
+    const CatmullRomFilter* filters,
+    int dstW)
 {
-    tmp.resize(dstW * srcH);
+    for (int x{}; x < dstW; ++x) {
+        const auto& filter = filters[x];
+        auto sum = 0.0f;
 
-    fillFilters(srcW, dstW);
+        for (int k{}; k < CatmullRomFilter::size; ++k)
+            sum += srcRow[filter.idx[k]] * filter.weights[k];
+
+        dstRow[x] = sum;
+    }
+}
 
-    for (int y{}; y < srcH; ++y) {
-        const auto* srcRow = src + y * srcPitch;
-        auto* tmpRow = tmp.data() + y * dstW;
 
-        for (int x{}; x < dstW; ++x) {
-            const auto& filter = filters[x];
-            auto sum = 0.0f;
+static void vScaleRow(
+    const float* const* srcRows,
+    const CatmullRomFilter& filter,
+    std::uint8_t* dstRow,
+    int dstW)
+{
+    for (int x{}; x < dstW; ++x) {
+        // Start with 0.5 for rounding via cast at the end.
+        auto sum = 0.5f;
 
-            for (int k{}; k < Filter::size; ++k)
-                sum += srcRow[filter.idx[k]] * filter.weights[k];
+        for (int k{}; k < CatmullRomFilter::size; ++k)
+            sum += srcRows[k][x] * filter.weights[k];
 
-            tmpRow[x] = sum;
-        }
+        dstRow[x] = std::clamp<int>(sum, 0, 255);
     }
+}
+
+
+void upscaleReference(
+    const std::uint8_t* src, int srcW, int srcH, int srcPitch,
+    std::uint8_t* dst, int dstW, int dstH, int dstPitch)
+{
+    std::vector<CatmullRomFilter> filters;
+    std::vector<float> tmp(dstW * srcH);
 
-    fillFilters(srcH, dstH);
+    fillFilters(filters, srcW, dstW);
+
+    for (int y{}; y < srcH; ++y)
+        hScaleRow(
+            src + y * srcPitch,
+            tmp.data() + y * dstW,
+            filters.data(),
+            dstW);
+
+    fillFilters(filters, srcH, dstH);
 
     for (int y{}; y < dstH; ++y) {
         const auto& filter = filters[y];
-        auto* dstRow = dst + y * dstPitch;
 
-        const float* tmpRows[Filter::size];
-        for (int k{}; k < Filter::size; ++k)
+        const float* tmpRows[CatmullRomFilter::size];
+        for (int k{}; k < CatmullRomFilter::size; ++k)
             tmpRows[k] = tmp.data() + filter.idx[k] * dstW;
 
-        for (int x{}; x < dstW; ++x) {
-            // Start with 0.5 for rounding via cast at the end.
-            auto sum = 0.5f;
+        vScaleRow(tmpRows, filter, dst + y * dstPitch, dstW);
+    }
+}
+
+
+namespace {
+
+
+// CatmullRomFilter converted for upscale_fixed_point.h.
+class FixedPointFilters {
+public:
+    void fill(int srcSize, int dstSize)
+    {
+        fillFilters(floatFilters, srcSize, dstSize);
+
+        indices.resize(dstSize * upscaleNumTaps);
+        weights.resize(dstSize * upscaleNumTaps);
+
+        for (int i{}; i < dstSize; ++i) {
+            const auto& filter = floatFilters[i];
+            auto* idx = indices.data() + i * upscaleNumTaps;
+            auto* w = weights.data() + i * upscaleNumTaps;
+
+            for (int k{}; k < upscaleNumTaps; ++k) {
+                idx[k] = filter.idx[k];
+                w[k] = toUpscaleWeight(filter.weights[k]);
+            }
+
+            // Like in fillFilters(), the weight of the center pixel
+            // absorbs the rounding error.
+            normalizeUpscaleWeights(w, 1);
+        }
+    }
+
+    const int* getIndices(int i) const
+    {
+        return indices.data() + i * upscaleNumTaps;
+    }
+
+    const std::int16_t* getWeights(int i) const
+    {
+        return weights.data() + i * upscaleNumTaps;
+    }
+private:
+    std::vector<CatmullRomFilter> floatFilters;
+    std::vector<int> indices;
+    std::vector<std::int16_t> weights;
+};
 
-            for (int k{}; k < Filter::size; ++k)
-                sum += tmpRows[k][x] * filter.weights[k];
 
-            dstRow[x] = std::clamp<int>(sum, 0, 255);
+// Horizontal pass of Upscale. For integer scale factors (the usual
+// case for OCR), the polyphase version is used.
+class HUpscale {
+public:
+    void reset(int srcW, int dstW)
+    {
+        this->srcW = srcW;
+        this->dstW = dstW;
+
+        filters.fill(srcW, dstW);
+
+        scale = dstW % srcW == 0 ? dstW / srcW : 0;
+        if (scale == 0)
+            return;
+
+        // The filter of output pixel p has the same weights as that
+        // of scale * i + p for any i. We can't take the offsets from
+        // the filter indices since they are clamped; the formula is
+        // the same as in fillFilters().
+        phaseOffsets.resize(scale);
+        for (int p{}; p < scale; ++p)
+            phaseOffsets[p] = static_cast<int>(
+                std::floor((p + 0.5f) / scale - 0.5f));
+    }
+
+    // paddedRow is a scratch buffer. The function is thread-safe as
+    // long as each thread uses its own buffer.
+    void scaleRow(
+        const std::uint8_t* srcRow,
+        std::int16_t* dstRow,
+        std::vector<std::uint8_t>& paddedRow) const
+    {
+        if (scale == 0) {
+            upscaleHRow(
+                srcRow,
+                filters.getIndices(0),
+                filters.getWeights(0),
+                dstRow,
+                dstW);
+            return;
         }
+
+        // Replicate the edge pixels instead of clamping the indices.
+        paddedRow.resize(srcW + 4);
+        auto* padded = paddedRow.data();
+        padded[0] = padded[1] = srcRow[0];
+        std::copy_n(srcRow, srcW, padded + 2);
+        padded[srcW + 2] = padded[srcW + 3] = srcRow[srcW - 1];
+
+        upscaleHRowPolyphase(
+            padded + 2,
+            srcW,
+            scale,
+            phaseOffsets.data(),
+            filters.getWeights(0),
+            dstRow);
     }
+private:
+    int srcW;
+    int dstW;
+    // 0 if not integer.
+    int scale;
+    FixedPointFilters filters;
+    std::vector<int> phaseOffsets;
+};
+
+
+}
+
+
+struct Upscale::Impl {
+    HUpscale hUpscale;
+    FixedPointFilters vFilters;
+    std::vector<std::int16_t> tmp;
+    // Scratch buffers for HUpscale::scaleRow(), one per band.
+    std::vector<std::vector<std::uint8_t>> paddedRows;
+    ThreadPool* threadPool{};
+
+    void scale(
+        const std::uint8_t* src, int srcW, int srcH, int srcPitch,
+        std::uint8_t* dst, int dstW, int dstH, int dstPitch);
+};
+
+
+void Upscale::Impl::scale(
+    const std::uint8_t* src, int srcW, int srcH, int srcPitch,
+    std::uint8_t* dst, int dstW, int dstH, int dstPitch)
+{
+    if (srcW == dstW && srcH == dstH) {
+        for (int y{}; y < srcH; ++y)
+            std::copy_n(src + y * srcPitch, srcW, dst + y * dstPitch);
+        return;
+    }
+
+    tmp.resize(dstW * srcH);
+
+    hUpscale.reset(srcW, dstW);
+    vFilters.fill(srcH, dstH);
+
+    // Since tmp holds all horizontally scaled rows, the bands of the
+    // vertical pass don't need to recompute the rows above and below
+    // them that the filter taps reach.
+
+    const auto numHBands = getNumBands(threadPool, dstW, srcH);
+    if (paddedRows.size() < static_cast<std::size_t>(numHBands))
+        paddedRows.resize(numHBands);
+
+    forEachBand(
+        threadPool, numHBands, srcH,
+        [&](int bandIdx, int y0, int y1)
+        {
+            for (auto y = y0; y < y1; ++y)
+                hUpscale.scaleRow(
+                    src + y * srcPitch,
+                    tmp.data() + y * dstW,
+                    paddedRows[bandIdx]);
+        });
+
+    forEachBand(
+        threadPool, getNumBands(threadPool, dstW, dstH), dstH,
+        [&](int, int y0, int y1)
+        {
+            for (auto y = y0; y < y1; ++y) {
+                const auto* idx = vFilters.getIndices(y);
+
+                const std::int16_t* tmpRows[upscaleNumTaps];
+                for (int k{}; k < upscaleNumTaps; ++k)
+                    tmpRows[k] = tmp.data() + idx[k] * dstW;
+
+                upscaleVRow(
+                    tmpRows,
+                    vFilters.getWeights(y),
+                    dst + y * dstPitch,
+                    dstW);
+            }
+        });
 }
 
 
@@ -182,6 +555,12 @@ Upscale::Upscale()
 Upscale::~Upscale() = default;
 
 
+void Upscale::setThreadPool(ThreadPool* threadPool)
+{
+    impl->threadPool = threadPool;
+}
+
+
 void Upscale::operator()(
     const std::uint8_t* src, int srcW, int srcH, int srcPitch,
     std::uint8_t* dst, int dstW, int dstH, int dstPitch)
@@ -193,40 +572,51 @@ void Upscale::operator()(
 namespace {
 
 
+// When computing the average value of the moving blur kernel, we
+// replace the division with multiplication using a UQ8.24 fixed point
+// format to help the compiler vectorize the loops. 24 is the maximum
+// number fraction bits (N) that fits in a 32-bit unsigned integer:
+//
+// sum * reciprocal(kernelSize)
+// = (255 * kernelSize) * (2^N / kernelSize)
+// = 255 * 2^N
+//
+// Which, with N = 24, gives 4'278'190'080.
+using Fp24 = std::uint32_t;
+
+
+Fp24 u8ToFp24(std::uint8_t i)
+{
+    return Fp24{i} << 24;
+}
+
+
+std::uint8_t fp24ToU8(Fp24 fp)
+{
+    return fp >> 24;
+}
+
+
+Fp24 getKernelSizeRecip(int radius)
+{
+    return u8ToFp24(1) / (1 + radius * 2);
+}
+
+
 class BoxBlur {
 public:
+    // threadPool can be null.
     void operator()(
         const std::uint8_t* src, int srcPitch,
         std::uint8_t* dst, int dstPitch,
         int w, int h,
         int radius,
-        int numIters);
+        int numIters,
+        ThreadPool* threadPool);
 private:
-    // When computing the average value of the moving blur kernel, we
-    // replace the division with multiplication using a UQ8.24 fixed
-    // point format to help the compiler vectorize the loops. 24 is
-    // the maximum number fraction bits (N) that fits in a 32-bit
-    // unsigned integer:
-    //
-    // sum * reciprocal(kernelSize)
-    // = (255 * kernelSize) * (2^N / kernelSize)
-    // = 255 * 2^N
-    //
-    // Which, with N = 24, gives 4'278'190'080.
-    using Fp24 = std::uint32_t;
-
-    static Fp24 u8ToFp24(std::uint8_t i)
-    {
-        return Fp24{i} << 24;
-    }
-
-    static std::uint8_t fp24ToU8(Fp24 fp)
-    {
-        return fp >> 24;
-    }
-
     std::vector<std::uint8_t> tmp;
-    std::vector<int> sums;
+    // Column sums of vPass(), one vector per band.
+    std::vector<std::vector<int>> bandSums;
 
     static void hPass(
         const std::uint8_t* src, int srcPitch,
@@ -234,11 +624,14 @@ private:
         int w, int h,
         int radius);
 
-    void vPass(
+    // Vertical pass for the rows [y0, y1) of the h-row image.
+    static void vPass(
         const std::uint8_t* src, int srcPitch,
         std::uint8_t* dst, int dstPitch,
         int w, int h,
-        int radius);
+        int radius,
+        int y0, int y1,
+        std::vector<int>& sums);
 };
 
 
@@ -250,7 +643,8 @@ void BoxBlur::operator()(
     std::uint8_t* dst, int dstPitch,
     int w, int h,
     int radius,
-    int numIters)
+    int numIters,
+    ThreadPool* threadPool)
 {
     assert(srcPitch >= w);
     assert(dstPitch >= w);
@@ -262,13 +656,40 @@ void BoxBlur::operator()(
     const auto tmpPitch = w;
     tmp.resize(tmpPitch * h);
 
+    const auto numBands = getNumBands(threadPool, w, h);
+    if (bandSums.size() < static_cast<std::size_t>(numBands))
+        bandSums.resize(numBands);
+
     const auto* curSrc = src;
     auto curSrcPitch = srcPitch;
 
+    // Each pass reads the whole result of the previous one, so a
+    // band of vPass() can take the rows of its window from the
+    // neighboring bands.
     for (int i{}; i < numIters; ++i) {
-        hPass(
-            curSrc, curSrcPitch, tmp.data(), tmpPitch, w, h, radius);
-        vPass(tmp.data(), tmpPitch, dst, dstPitch, w, h, radius);
+        forEachBand(
+            threadPool, numBands, h,
+            [&](int, int y0, int y1)
+            {
+                hPass(
+                    curSrc + y0 * curSrcPitch, curSrcPitch,
+                    tmp.data() + y0 * tmpPitch, tmpPitch,
+                    w, y1 - y0,
+                    radius);
+            });
+
+        forEachBand(
+            threadPool, numBands, h,
+            [&](int bandIdx, int y0, int y1)
+            {
+                vPass(
+                    tmp.data(), tmpPitch,
+                    dst, dstPitch,
+                    w, h,
+                    radius,
+                    y0, y1,
+                    bandSums[bandIdx]);
+            });
 
         curSrc = dst;
         curSrcPitch = dstPitch;
@@ -276,19 +697,13 @@ void BoxBlur::operator()(
 }
 
 
-void BoxBlur::hPass(
-    const std::uint8_t* src, int srcPitch,
-    std::uint8_t* dst, int dstPitch,
-    int w, int h,
+static void hBlurRow(
+    const std::uint8_t* srcRow,
+    std::uint8_t* dstRow,
+    int w,
     int radius)
 {
-    assert(srcPitch >= w);
-    assert(dstPitch >= w);
-    assert(w > 0);
-    assert(h > 0);
-    assert(radius > 0);
-
-    const auto kernelSizeRecip = u8ToFp24(1) / (1 + radius * 2);
+    const auto kernelSizeRecip = getKernelSizeRecip(radius);
 
     // To avoid calling min/max() for each pixel, we split the line
     // into 4 ordered ranges based on when the sliding window detaches
@@ -310,28 +725,40 @@ void BoxBlur::hPass(
     const auto clampedAddIdx = [=](int) { return w - 1; };
     const auto addIdx = [=](int x) { return x + radius + 1; };
 
-    for (int y{}; y < h; ++y) {
-        const auto* srcRow = src + y * srcPitch;
-        auto* dstRow = dst + y * dstPitch;
+    auto sum = srcRow[0] * (radius + 1);
+    for (int i{1}; i <= radius; ++i)
+        sum += srcRow[std::min(i, w - 1)];
 
-        auto sum = srcRow[0] * (radius + 1);
-        for (int i{1}; i <= radius; ++i)
-            sum += srcRow[std::min(i, w - 1)];
+    const auto processRange =
+    [&](int begin, int end, auto getSubIdx, auto getAddIdx)
+    {
+        for (auto x = begin; x < end; ++x) {
+            dstRow[x] = fp24ToU8(sum * kernelSizeRecip);
+            sum += srcRow[getAddIdx(x)] - srcRow[getSubIdx(x)];
+        }
+    };
 
-        const auto processRange =
-        [&](int begin, int end, auto getSubIdx, auto getAddIdx)
-        {
-            for (auto x = begin; x < end; ++x) {
-                dstRow[x] = fp24ToU8(sum * kernelSizeRecip);
-                sum += srcRow[getAddIdx(x)] - srcRow[getSubIdx(x)];
-            }
-        };
+    processRange(0, p1, clampedSubIdx, addIdx);
+    processRange(p1, p2, clampedSubIdx, clampedAddIdx);
+    processRange(p2, p3, subIdx, addIdx);
+    processRange(p3, w, subIdx, clampedAddIdx);
+}
 
-        processRange(0, p1, clampedSubIdx, addIdx);
-        processRange(p1, p2, clampedSubIdx, clampedAddIdx);
-        processRange(p2, p3, subIdx, addIdx);
-        processRange(p3, w, subIdx, clampedAddIdx);
-    }
+
+void BoxBlur::hPass(
+    const std::uint8_t* src, int srcPitch,
+    std::uint8_t* dst, int dstPitch,
+    int w, int h,
+    int radius)
+{
+    assert(srcPitch >= w);
+    assert(dstPitch >= w);
+    assert(w > 0);
+    assert(h > 0);
+    assert(radius > 0);
+
+    for (int y{}; y < h; ++y)
+        hBlurRow(src + y * srcPitch, dst + y * dstPitch, w, radius);
 }
 
 
@@ -339,20 +766,23 @@ void BoxBlur::vPass(
     const std::uint8_t* src, int srcPitch,
     std::uint8_t* dst, int dstPitch,
     int w, int h,
-    int radius)
+    int radius,
+    int y0, int y1,
+    std::vector<int>& sumsVec)
 {
     assert(srcPitch >= w);
     assert(dstPitch >= w);
     assert(w > 0);
     assert(h > 0);
     assert(radius > 0);
+    assert(y0 >= 0 && y0 < y1 && y1 <= h);
 
     // For better cache locality, the vertical pass operates on the
     // entire rows, making the algorithm about 4 times faster than
     // the naive variant (similar to the horizontal pass) that
     // processes individual columns.
 
-    sums.resize(w);
+    sumsVec.resize(w);
 
     // If the sums vector comes from outside the function (either as
     // a reference parameter or via the implicit "this"), accessing
@@ -362,22 +792,24 @@ void BoxBlur::vPass(
     // standard "restrict" qualifier to make things explicit, it's
     // crucial to access the vector data via a local pointer variable
     // rather than directly via operator[].
-    auto* sums = this->sums.data();
+    auto* sums = sumsVec.data();
 
-    const auto kernelSizeRecip = u8ToFp24(1) / (1 + radius * 2);
+    const auto kernelSizeRecip = getKernelSizeRecip(radius);
 
-    const auto* row0 = src;
+    // Initialize the window of row y0, which may include rows of the
+    // previous band.
+    const auto* firstRow = src + std::max(y0 - radius, 0) * srcPitch;
     for (int x{}; x < w; ++x)
-        sums[x] = row0[x] * (radius + 1);
+        sums[x] = firstRow[x];
 
-    for (int y{1}; y <= radius; ++y) {
-        const auto* row = src + std::min(y, h - 1) * srcPitch;
+    for (auto y = y0 - radius + 1; y <= y0 + radius; ++y) {
+        const auto* row = src + std::clamp(y, 0, h - 1) * srcPitch;
 
         for (int x{}; x < w; ++x)
             sums[x] += row[x];
     }
 
-    for (int y{}; y < h; ++y) {
+    for (auto y = y0; y < y1; ++y) {
         auto* dstRow = dst + y * dstPitch;
 
         const auto* addRow =
@@ -394,6 +826,7 @@ void BoxBlur::vPass(
 
 struct UnsharpMask::Impl {
     BoxBlur boxBlur;
+    ThreadPool* threadPool{};
 };
 
 
@@ -406,6 +839,24 @@ UnsharpMask::UnsharpMask()
 UnsharpMask::~UnsharpMask() = default;
 
 
+void UnsharpMask::setThreadPool(ThreadPool* threadPool)
+{
+    impl->threadPool = threadPool;
+}
+
+
+static void unsharpRow(
+    const std::uint8_t* srcRow,
+    const std::uint8_t* blurredRow,
+    std::uint8_t* dstRow,
+    int w)
+{
+    for (int x{}; x < w; ++x)
+        dstRow[x] = std::clamp(
+            srcRow[x] + (srcRow[x] - blurredRow[x]), 0, 255);
+}
+
+
 static void unsharp(
     const std::uint8_t* src, int srcPitch,
     const std::uint8_t* blurred, int blurredPitch,
@@ -416,15 +867,12 @@ static void unsharp(
     assert(blurredPitch >= w);
     assert(dstPitch >= w);
 
-    for (int y{}; y < h; ++y) {
-        const auto* srcRow = src + y * srcPitch;
-        const auto* blurredRow = blurred + y * blurredPitch;
-        auto* dstRow = dst + y * dstPitch;
-
-        for (int x{}; x < w; ++x)
-            dstRow[x] = std::clamp(
-                srcRow[x] + (srcRow[x] - blurredRow[x]), 0, 255);
-    }
+    for (int y{}; y < h; ++y)
+        unsharpRow(
+            src + y * srcPitch,
+            blurred + y * blurredPitch,
+            dst + y * dstPitch,
+            w);
 }
 
 
@@ -446,13 +894,379 @@ void UnsharpMask::operator()(
         dst, dstPitch,
         w, h,
         radius,
-        2);
+        2,
+        impl->threadPool);
 
-    unsharp(
-        src, srcPitch,
-        dst, dstPitch,
-        dst, dstPitch,
-        w, h);
+    forEachBand(
+        impl->threadPool, getNumBands(impl->threadPool, w, h), h,
+        [&](int, int y0, int y1)
+        {
+            unsharp(
+                src + y0 * srcPitch, srcPitch,
+                dst + y0 * dstPitch, dstPitch,
+                dst + y0 * dstPitch, dstPitch,
+                w, y1 - y0);
+        });
+}
+
+
+namespace {
+
+
+// Ring buffer of image rows.
+template<typename T>
+class RowRing {
+public:
+    // firstY is the index of the first row to be added.
+    void reset(int w, int numRows, int firstY)
+    {
+        this->w = w;
+        capacity = numRows;
+        data.resize(static_cast<std::size_t>(w) * numRows);
+        this->firstY = firstY;
+        endY = firstY;
+    }
+
+    // Return the index of the next row to be added.
+    int getEndY() const
+    {
+        return endY;
+    }
+
+    T* getRow(int y)
+    {
+        // The row must be added and not overwritten yet.
+        assert(y < endY && y >= std::max(firstY, endY - capacity));
+        return data.data()
+            + static_cast<std::size_t>(y % capacity) * w;
+    }
+
+    T* addRow()
+    {
+        return data.data()
+            + static_cast<std::size_t>(endY++ % capacity) * w;
+    }
+private:
+    std::vector<T> data;
+    int w;
+    int capacity;
+    int firstY;
+    int endY;
+};
+
+
+// Streaming version of BoxBlur::vPass() that produces one row at a
+// time, requiring only the rows in the current window.
+class VBlur {
+public:
+    // firstY is the index of the first row to produce.
+    void reset(int w, int h, int radius, int firstY)
+    {
+        this->w = w;
+        this->h = h;
+        this->radius = radius;
+        sums.resize(w);
+        this->firstY = firstY;
+        nextY = firstY;
+    }
+
+    int getNextY() const
+    {
+        return nextY;
+    }
+
+    // Return the index of the first source row needed to produce
+    // rows starting from firstY.
+    int getFirstRequiredRow() const
+    {
+        return std::max(firstY - radius, 0);
+    }
+
+    // Return the number of source rows needed to produce rows up to
+    // (but not including) y.
+    int getNumRequiredRows(int y) const
+    {
+        return std::min(y + radius, h);
+    }
+
+    void produceRow(RowRing<std::uint8_t>& src, std::uint8_t* dstRow)
+    {
+        // See BoxBlur::vPass() for why we use a local pointer.
+        auto* sums = this->sums.data();
+
+        if (nextY == firstY) {
+            const auto* row0 = src.getRow(getFirstRequiredRow());
+            for (int x{}; x < w; ++x)
+                sums[x] = row0[x];
+
+            const auto windowY1 = nextY + radius;
+            for (auto y = nextY - radius + 1; y <= windowY1; ++y) {
+                const auto* row = src.getRow(std::clamp(y, 0, h - 1));
+
+                for (int x{}; x < w; ++x)
+                    sums[x] += row[x];
+            }
+        } else {
+            const auto* addRow = src.getRow(
+                std::min(nextY + radius, h - 1));
+            const auto* subRow = src.getRow(
+                std::max(nextY - radius - 1, 0));
+
+            for (int x{}; x < w; ++x)
+                sums[x] += addRow[x] - subRow[x];
+        }
+
+        const auto kernelSizeRecip = getKernelSizeRecip(radius);
+        for (int x{}; x < w; ++x)
+            dstRow[x] = fp24ToU8(sums[x] * kernelSizeRecip);
+
+        ++nextY;
+    }
+private:
+    int w;
+    int h;
+    int radius;
+    std::vector<int> sums;
+    int firstY;
+    int nextY;
+};
+
+
+// State of Preprocess for a band of destination rows.
+struct PreprocessBand {
+    std::vector<std::uint8_t> grayRow;
+    // Scratch buffer for HUpscale::scaleRow().
+    std::vector<std::uint8_t> paddedRow;
+
+    // Horizontally upscaled source rows.
+    RowRing<std::int16_t> hScaled;
+    RowRing<std::uint8_t> scaled;
+    // Two iterations of the box blur, as in UnsharpMask.
+    RowRing<std::uint8_t> hBlurred1;
+    RowRing<std::uint8_t> vBlurred1;
+    RowRing<std::uint8_t> hBlurred2;
+    VBlur vBlur1;
+    VBlur vBlur2;
+};
+
+
+}
+
+
+struct Preprocess::Impl {
+    struct Args {
+        const std::uint8_t* src;
+        int srcPitch;
+        DpsoPxFormat srcPxFormat;
+        int srcW;
+        int srcH;
+        std::uint8_t* dst;
+        int dstPitch;
+        int dstW;
+        int dstH;
+        int radius;
+    };
+
+    HUpscale hUpscale;
+    FixedPointFilters vFilters;
+    std::vector<PreprocessBand> bands;
+    ThreadPool* threadPool{};
+
+    // Produce the destination rows [y0, y1).
+    void processBand(
+        const Args& args, PreprocessBand& band, int y0, int y1);
+};
+
+
+void Preprocess::Impl::processBand(
+    const Args& args, PreprocessBand& band, int y0, int y1)
+{
+    const auto dstW = args.dstW;
+    const auto dstH = args.dstH;
+    const auto radius = args.radius;
+
+    // The stripe height is chosen so that the ring buffers take about
+    // the size of a typical L2 cache. The ring buffers of the
+    // destination rows hold the stripe plus the windows of both blur
+    // iterations: a row of the second vertical pass needs radius rows
+    // ahead from the second horizontal pass, which in turn needs
+    // radius rows ahead from the first vertical pass, plus a row
+    // behind each window to subtract. The first stripe of a band that
+    // doesn't start at the top of the image also needs the same
+    // number of rows behind the band.
+    const auto cacheSize = 256 * 1024;
+    // 4 u8 rings plus the 16-bit ring, which has fewer rows.
+    const auto bytesPerRow = dstW * 8;
+    const auto ringExtraRows = radius * 4 + 2;
+    const auto stripeH = std::min(
+        std::max(cacheSize / bytesPerRow - ringExtraRows, 8),
+        y1 - y0);
+    const auto ringH = stripeH + ringExtraRows;
+
+    // Source rows needed for ringH destination rows, plus the filter
+    // taps.
+    const auto hScaledRingH = static_cast<int>(
+        (static_cast<std::int64_t>(ringH) * args.srcH + dstH - 1)
+            / dstH)
+        + upscaleNumTaps + 1;
+
+    auto& hScaled = band.hScaled;
+    auto& scaled = band.scaled;
+    auto& hBlurred1 = band.hBlurred1;
+    auto& vBlurred1 = band.vBlurred1;
+    auto& hBlurred2 = band.hBlurred2;
+    auto& vBlur1 = band.vBlur1;
+    auto& vBlur2 = band.vBlur2;
+
+    // Find the first row of each stage, going backwards.
+    vBlur2.reset(dstW, dstH, radius, y0);
+    const auto firstHBlurred2 = vBlur2.getFirstRequiredRow();
+    const auto firstVBlurred1 = firstHBlurred2;
+    vBlur1.reset(dstW, dstH, radius, firstVBlurred1);
+    const auto firstHBlurred1 = vBlur1.getFirstRequiredRow();
+    const auto firstScaled = firstHBlurred1;
+    const auto firstHScaled = vFilters.getIndices(firstScaled)[0];
+
+    hScaled.reset(dstW, hScaledRingH, firstHScaled);
+    scaled.reset(dstW, ringH, firstScaled);
+    hBlurred1.reset(dstW, ringH, firstHBlurred1);
+    vBlurred1.reset(dstW, ringH, firstVBlurred1);
+    hBlurred2.reset(dstW, ringH, firstHBlurred2);
+
+    if (args.srcPxFormat != DpsoPxFormatGrayscale)
+        band.grayRow.resize(args.srcW);
+
+    for (auto stripeY0 = y0; stripeY0 < y1; stripeY0 += stripeH) {
+        const auto stripeY1 = std::min(stripeY0 + stripeH, y1);
+
+        // Work out how many rows each stage should have to produce
+        // the destination rows [stripeY0, stripeY1), going backwards.
+        const auto numHBlurred2 = vBlur2.getNumRequiredRows(stripeY1);
+        const auto numVBlurred1 = numHBlurred2;
+        const auto numHBlurred1 = vBlur1.getNumRequiredRows(
+            numVBlurred1);
+        const auto numScaled = numHBlurred1;
+        const auto numHScaled =
+            vFilters.getIndices(numScaled - 1)[upscaleNumTaps - 1]
+            + 1;
+
+        // Now produce them, going forward.
+
+        while (hScaled.getEndY() < numHScaled) {
+            const auto y = hScaled.getEndY();
+
+            const std::uint8_t* srcRow = args.src + y * args.srcPitch;
+            if (args.srcPxFormat != DpsoPxFormatGrayscale) {
+                toGray(
+                    srcRow, args.srcPitch, args.srcPxFormat,
+                    band.grayRow.data(), args.srcW,
+                    args.srcW, 1);
+                srcRow = band.grayRow.data();
+            }
+
+            hUpscale.scaleRow(
+                srcRow, hScaled.addRow(), band.paddedRow);
+        }
+
+        while (scaled.getEndY() < numScaled) {
+            const auto y = scaled.getEndY();
+            const auto* idx = vFilters.getIndices(y);
+
+            const std::int16_t* hScaledRows[upscaleNumTaps];
+            for (int k{}; k < upscaleNumTaps; ++k)
+                hScaledRows[k] = hScaled.getRow(idx[k]);
+
+            upscaleVRow(
+                hScaledRows,
+                vFilters.getWeights(y),
+                scaled.addRow(),
+                dstW);
+        }
+
+        while (hBlurred1.getEndY() < numHBlurred1) {
+            const auto* srcRow = scaled.getRow(hBlurred1.getEndY());
+            hBlurRow(srcRow, hBlurred1.addRow(), dstW, radius);
+        }
+
+        while (vBlurred1.getEndY() < numVBlurred1)
+            vBlur1.produceRow(hBlurred1, vBlurred1.addRow());
+
+        while (hBlurred2.getEndY() < numHBlurred2) {
+            const auto* srcRow = vBlurred1.getRow(
+                hBlurred2.getEndY());
+            hBlurRow(srcRow, hBlurred2.addRow(), dstW, radius);
+        }
+
+        for (auto y = stripeY0; y < stripeY1; ++y) {
+            auto* dstRow = args.dst + y * args.dstPitch;
+
+            vBlur2.produceRow(hBlurred2, dstRow);
+            unsharpRow(scaled.getRow(y), dstRow, dstRow, dstW);
+        }
+    }
+}
+
+
+Preprocess::Preprocess()
+    : impl{std::make_unique<Impl>()}
+{
+}
+
+
+Preprocess::~Preprocess() = default;
+
+
+void Preprocess::setThreadPool(ThreadPool* threadPool)
+{
+    impl->threadPool = threadPool;
+}
+
+
+void Preprocess::operator()(
+    const std::uint8_t* src,
+    int srcPitch,
+    DpsoPxFormat srcPxFormat,
+    int srcW,
+    int srcH,
+    std::uint8_t* dst,
+    int dstPitch,
+    int dstW,
+    int dstH,
+    int unsharpMaskRadius)
+{
+    if (srcW < 1
+            || srcH < 1
+            || srcPitch
+                < srcW * dpsoPxFormatGetBytesPerPx(srcPxFormat)
+            || dstW < srcW
+            || dstH < srcH
+            || dstPitch < dstW
+            || unsharpMaskRadius < 1)
+        return;
+
+    const Impl::Args args{
+        src, srcPitch, srcPxFormat, srcW, srcH,
+        dst, dstPitch, dstW, dstH,
+        unsharpMaskRadius};
+
+    impl->hUpscale.reset(srcW, dstW);
+    impl->vFilters.fill(srcH, dstH);
+
+    // Each band recomputes the rows above it that the blur windows
+    // and the upscale filter taps reach, so bands much taller than
+    // the blur radius keep the overhead low.
+    const auto numBands = std::min(
+        getNumBands(impl->threadPool, dstW, dstH),
+        std::max(1, dstH / (unsharpMaskRadius * 16)));
+    if (impl->bands.size() < static_cast<std::size_t>(numBands))
+        impl->bands.resize(numBands);
+
+    forEachBand(
+        impl->threadPool, numBands, dstH,
+        [&](int bandIdx, int y0, int y1)
+        {
+            impl->processBand(args, impl->bands[bandIdx], y0, y1);
+        });
 }
 
 
@@ -6,6 +6,11 @@
 #include "px_format.h"
 
 
+namespace dpso {
+class ThreadPool;
+}
+
+
 namespace dpso::img {
 
 
@@ -23,14 +28,70 @@ T getMaskRightShift(T mask)
 }
 
 
+inline std::uint8_t rgbToGray(
+    std::uint8_t r, std::uint8_t g, std::uint8_t b)
+{
+    return (r * 2126 + g * 7152 + b * 722) / 10000;
+}
+
+
+// Byte offsets of the channels within a pixel. For formats without
+// alpha, a is -1. For DpsoPxFormatGrayscale, r, g, and b are all 0.
+struct ChannelOffsets {
+    int r;
+    int g;
+    int b;
+    int a;
+};
+
+
+ChannelOffsets getChannelOffsets(DpsoPxFormat pxFormat);
+
+
 void toGray(
     const std::uint8_t* src, int srcPitch, DpsoPxFormat srcPxFormat,
     std::uint8_t* dst, int dstPitch,
     int w, int h);
 
 
+// Convert between arbitrary pixel formats. Conversion to grayscale
+// is the same as toGray(). Alpha is copied if both formats have it;
+// otherwise, it's set to 255.
+void convertPxFormat(
+    const std::uint8_t* src, int srcPitch, DpsoPxFormat srcPxFormat,
+    std::uint8_t* dst, int dstPitch, DpsoPxFormat dstPxFormat,
+    int w, int h);
+
+
+// Parallel version of toGray(). Images too small to benefit from
+// parallelization, as well as a null threadPool, use the serial path.
+//
+// Upscale, UnsharpMask, and Preprocess can use a thread pool in the
+// same way via setThreadPool(). In all cases, the result is identical
+// to that of the serial version.
+void toGray(
+    const std::uint8_t* src, int srcPitch, DpsoPxFormat srcPxFormat,
+    std::uint8_t* dst, int dstPitch,
+    int w, int h,
+    ThreadPool* threadPool);
+
+
+// Estimate the height of text lines in a grayscale image, in pixels.
+//
+// The function uses the horizontal projection profile: rows that
+// contain pixels noticeably different from the background (the most
+// frequent value) are considered to belong to text lines, and the
+// result is the median height of such runs of rows. Returns 0 if no
+// text was detected.
+int estimateTextLineHeight(
+    const std::uint8_t* src, int srcPitch, int w, int h);
+
+
 // As the name implies, the class is designed for scaling images up.
 // Scaling down is technically possible, but the quality will be poor.
+//
+// The Catmull-Rom filter is computed in fixed point with SIMD where
+// available; see upscale_fixed_point.h.
 class Upscale {
 public:
     Upscale();
@@ -42,6 +103,11 @@ public:
     Upscale(Upscale&&) = delete;
     Upscale& operator=(Upscale&&) = delete;
 
+    // Split the work into bands of rows over the thread pool. Null
+    // (the default) disables parallel processing. The pool should
+    // outlive the Upscale.
+    void setThreadPool(ThreadPool* threadPool);
+
     void operator()(
         const std::uint8_t* src, int srcW, int srcH, int srcPitch,
         std::uint8_t* dst, int dstW, int dstH, int dstPitch);
@@ -51,6 +117,13 @@ private:
 };
 
 
+// Floating-point version of Upscale, kept as a reference for tests.
+// The results may differ from Upscale by 1 due to rounding.
+void upscaleReference(
+    const std::uint8_t* src, int srcW, int srcH, int srcPitch,
+    std::uint8_t* dst, int dstW, int dstH, int dstPitch);
+
+
 class UnsharpMask {
 public:
     UnsharpMask();
@@ -62,6 +135,9 @@ public:
     UnsharpMask(UnsharpMask&&) = delete;
     UnsharpMask& operator=(UnsharpMask&&) = delete;
 
+    // See Upscale::setThreadPool().
+    void setThreadPool(ThreadPool* threadPool);
+
     void operator()(
         const std::uint8_t* src, int srcPitch,
         std::uint8_t* dst, int dstPitch,
@@ -73,4 +149,47 @@ private:
 };
 
 
+// Combined toGray(), Upscale, and UnsharpMask.
+//
+// The result is identical to calling the operations one after
+// another, but instead of making a full pass over the image for each
+// of them, the image is processed in horizontal stripes small enough
+// to fit in the CPU cache. Rows that later stages still need (the
+// vertical filter taps of Upscale and the windows of the box blur)
+// are kept in ring buffers between stripes, so intermediate images
+// never round-trip through the main memory.
+//
+// Only upscaling is supported: dstW and dstH should not be less than
+// srcW and srcH, respectively.
+class Preprocess {
+public:
+    Preprocess();
+    ~Preprocess();
+
+    Preprocess(const Preprocess&) = delete;
+    Preprocess& operator=(const Preprocess&) = delete;
+
+    Preprocess(Preprocess&&) = delete;
+    Preprocess& operator=(Preprocess&&) = delete;
+
+    // See Upscale::setThreadPool().
+    void setThreadPool(ThreadPool* threadPool);
+
+    void operator()(
+        const std::uint8_t* src,
+        int srcPitch,
+        DpsoPxFormat srcPxFormat,
+        int srcW,
+        int srcH,
+        std::uint8_t* dst,
+        int dstPitch,
+        int dstW,
+        int dstH,
+        int unsharpMaskRadius);
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+
 }
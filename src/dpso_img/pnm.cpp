@@ -1,8 +1,13 @@
 #include "pnm.h"
 
 #include <array>
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/mapped_file.h"
+#include "dpso_utils/os_error.h"
 #include "dpso_utils/str.h"
 #include "dpso_utils/stream/file_stream.h"
 #include "dpso_utils/stream/utils.h"
@@ -97,4 +102,182 @@ void savePnm(
 }
 
 
+namespace {
+
+
+struct PnmHeader {
+    DpsoPxFormat pxFormat;
+    int w;
+    int h;
+    std::size_t dataOffset;
+};
+
+
+class PnmHeaderParser {
+public:
+    explicit PnmHeaderParser(std::string_view data)
+        : data{data}
+    {
+    }
+
+    // On failure, sets an error message and returns false.
+    bool parse(PnmHeader& header);
+private:
+    std::string_view data;
+    std::size_t pos{};
+
+    void skipSpaceAndComments();
+    bool parseInt(std::string_view name, int maxValue, int& value);
+};
+
+
+bool PnmHeaderParser::parse(PnmHeader& header)
+{
+    if (data.size() < 2 || data[0] != 'P') {
+        setError("Not a PNM file");
+        return false;
+    }
+
+    if (data[1] == '5')
+        header.pxFormat = DpsoPxFormatGrayscale;
+    else if (data[1] == '6')
+        header.pxFormat = DpsoPxFormatRgb;
+    else {
+        setError(
+            "Unsupported PNM type P{}; only binary PGM (P5) and PPM "
+            "(P6) are supported",
+            data[1]);
+        return false;
+    }
+
+    pos = 2;
+
+    // Keeps w * h * bpp within int, which the image operations use
+    // for sizes.
+    const auto maxSize = 1 << 14;
+
+    int maxVal;
+    if (!parseInt("width", maxSize, header.w)
+            || !parseInt("height", maxSize, header.h)
+            || !parseInt("maximum value", 65535, maxVal))
+        return false;
+
+    if (header.w < 1 || header.h < 1) {
+        setError("Invalid size {}x{}", header.w, header.h);
+        return false;
+    }
+
+    if (maxVal != 255) {
+        setError(
+            "Unsupported maximum value {}; only 255 is supported",
+            maxVal);
+        return false;
+    }
+
+    // The maximum value is followed by a single whitespace.
+    if (pos == data.size() || !str::isSpace(data[pos])) {
+        setError("No whitespace after the maximum value");
+        return false;
+    }
+
+    header.dataOffset = pos + 1;
+    return true;
+}
+
+
+void PnmHeaderParser::skipSpaceAndComments()
+{
+    while (pos < data.size())
+        if (str::isSpace(data[pos]))
+            ++pos;
+        else if (data[pos] == '#')
+            while (pos < data.size()
+                    && data[pos] != '\n'
+                    && data[pos] != '\r')
+                ++pos;
+        else
+            break;
+}
+
+
+bool PnmHeaderParser::parseInt(
+    std::string_view name, int maxValue, int& value)
+{
+    const auto oldPos = pos;
+    skipSpaceAndComments();
+
+    if (pos == oldPos) {
+        setError("No whitespace before the {}", name);
+        return false;
+    }
+
+    if (pos == data.size()
+            || data[pos] < '0' || data[pos] > '9') {
+        setError("No {}", name);
+        return false;
+    }
+
+    value = 0;
+    for (; pos < data.size() && data[pos] >= '0' && data[pos] <= '9';
+            ++pos) {
+        value = value * 10 + (data[pos] - '0');
+        if (value > maxValue) {
+            setError("The {} exceeds {}", name, maxValue);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+}
+
+
+ImgUPtr loadPnm(std::string_view filePath)
+{
+    std::shared_ptr<os::MappedFile> file;
+
+    try {
+        // The image data is writable.
+        file = std::make_shared<os::MappedFile>(
+            filePath, os::MappedFile::Mode::copyOnWrite);
+    } catch (os::Error& e) {
+        setError("Can't open file: {}", e.what());
+        return {};
+    }
+
+    const std::string_view data{
+        reinterpret_cast<const char*>(file->getData()),
+        file->getSize()};
+
+    PnmHeader header;
+    if (!PnmHeaderParser{data}.parse(header))
+        return {};
+
+    const auto bpp = dpsoPxFormatGetBytesPerPx(header.pxFormat);
+    const auto pitch = header.w * bpp;
+    const auto dataSize = static_cast<std::size_t>(pitch) * header.h;
+
+    if (data.size() - header.dataOffset < dataSize) {
+        setError(
+            "Pixel data is truncated: expected {} bytes, got {}",
+            dataSize, data.size() - header.dataOffset);
+        return {};
+    }
+
+    // PNM rows are not padded, and the pixel formats of P5 and P6
+    // match DpsoPxFormatGrayscale and DpsoPxFormatRgb, so the image
+    // can use the mapped data as is.
+    auto* pixels = file->getWritableData() + header.dataOffset;
+    return createImg(
+        header.pxFormat,
+        header.w,
+        header.h,
+        pitch,
+        pixels,
+        std::move(file));
+}
+
+
 }
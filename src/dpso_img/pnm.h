@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <string_view>
 
+#include "img.h"
 #include "px_format.h"
 
 
@@ -21,4 +22,18 @@ void savePnm(
     int pitch);
 
 
+// Load a binary PGM (P5) or PPM (P6) image with 8 bits per channel.
+// The pixel format is DpsoPxFormatGrayscale or DpsoPxFormatRgb,
+// respectively.
+//
+// The file is memory-mapped, and the image uses the mapped pixels
+// directly instead of copying them. Pages are only read from the
+// disk when accessed, and modifying the image doesn't change the
+// file. The file is unmapped when the image is deleted.
+//
+// On failure, sets an error message (dpsoGetError()) and returns
+// null.
+ImgUPtr loadPnm(std::string_view filePath);
+
+
 }
@@ -0,0 +1,391 @@
+#include "upscale_fixed_point.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define DPSO_IMG_SSE2 1
+#endif
+
+// AVX2 is enabled per function with the target attribute, which is
+// only supported by GCC and Clang.
+#if DPSO_IMG_SSE2 \
+    && (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DPSO_IMG_AVX2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DPSO_IMG_NEON 1
+#endif
+
+
+namespace dpso::img {
+
+
+std::int16_t toUpscaleWeight(float weight)
+{
+    return std::lround(weight * (1 << upscaleWeightFracBits));
+}
+
+
+void normalizeUpscaleWeights(std::int16_t* weights, int adjustIdx)
+{
+    int sum{};
+    for (int k{}; k < upscaleNumTaps; ++k)
+        if (k != adjustIdx)
+            sum += weights[k];
+
+    weights[adjustIdx] = (1 << upscaleWeightFracBits) - sum;
+}
+
+
+const auto hShift = upscaleWeightFracBits - upscaleTmpFracBits;
+const auto vShift = upscaleWeightFracBits + upscaleTmpFracBits;
+
+
+static std::int16_t hSum(
+    const std::uint8_t* px0,
+    const std::uint8_t* px1,
+    const std::uint8_t* px2,
+    const std::uint8_t* px3,
+    const std::int16_t* weights)
+{
+    const auto sum =
+        *px0 * weights[0]
+        + *px1 * weights[1]
+        + *px2 * weights[2]
+        + *px3 * weights[3];
+
+    return (sum + (1 << (hShift - 1))) >> hShift;
+}
+
+
+void upscaleHRow(
+    const std::uint8_t* srcRow,
+    const int* indices,
+    const std::int16_t* weights,
+    std::int16_t* dstRow,
+    int dstW)
+{
+    for (int x{}; x < dstW; ++x) {
+        const auto* idx = indices + x * upscaleNumTaps;
+
+        dstRow[x] = hSum(
+            srcRow + idx[0],
+            srcRow + idx[1],
+            srcRow + idx[2],
+            srcRow + idx[3],
+            weights + x * upscaleNumTaps);
+    }
+}
+
+
+// With a compile-time scale, the compiler can unroll the inner loop.
+template<int scale>
+static void upscaleHRowPolyphase(
+    const std::uint8_t* paddedSrcRow,
+    int srcW,
+    const int* offsets,
+    const std::int16_t* weights,
+    std::int16_t* dstRow)
+{
+    for (int i{}; i < srcW; ++i)
+        for (int p{}; p < scale; ++p) {
+            const auto* px = paddedSrcRow + i + offsets[p] - 1;
+
+            dstRow[i * scale + p] = hSum(
+                px, px + 1, px + 2, px + 3,
+                weights + p * upscaleNumTaps);
+        }
+}
+
+
+void upscaleHRowPolyphase(
+    const std::uint8_t* paddedSrcRow,
+    int srcW,
+    int scale,
+    const int* offsets,
+    const std::int16_t* weights,
+    std::int16_t* dstRow)
+{
+    switch (scale) {
+    case 2:
+        upscaleHRowPolyphase<2>(
+            paddedSrcRow, srcW, offsets, weights, dstRow);
+        return;
+    case 3:
+        upscaleHRowPolyphase<3>(
+            paddedSrcRow, srcW, offsets, weights, dstRow);
+        return;
+    case 4:
+        upscaleHRowPolyphase<4>(
+            paddedSrcRow, srcW, offsets, weights, dstRow);
+        return;
+    }
+
+    for (int i{}; i < srcW; ++i)
+        for (int p{}; p < scale; ++p) {
+            const auto* px = paddedSrcRow + i + offsets[p] - 1;
+
+            dstRow[i * scale + p] = hSum(
+                px, px + 1, px + 2, px + 3,
+                weights + p * upscaleNumTaps);
+        }
+}
+
+
+static std::uint8_t vSum(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    int x)
+{
+    const auto sum =
+        srcRows[0][x] * weights[0]
+        + srcRows[1][x] * weights[1]
+        + srcRows[2][x] * weights[2]
+        + srcRows[3][x] * weights[3];
+
+    return std::clamp((sum + (1 << (vShift - 1))) >> vShift, 0, 255);
+}
+
+
+void upscaleVRowScalar(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w)
+{
+    for (int x{}; x < w; ++x)
+        dstRow[x] = vSum(srcRows, weights, x);
+}
+
+
+// The SIMD versions interleave the rows in pairs and use multiply-add
+// instructions to compute two taps at once in 32-bit precision.
+
+
+#if DPSO_IMG_SSE2
+
+
+// Pack two weights for a multiply-add of 16-bit pairs.
+static std::int32_t packWeights(std::int16_t lo, std::int16_t hi)
+{
+    const std::uint32_t hiBits = static_cast<std::uint16_t>(hi);
+    return static_cast<std::int32_t>(
+        hiBits << 16 | static_cast<std::uint16_t>(lo));
+}
+
+
+static void upscaleVRowSse2(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w)
+{
+    const auto w01 = _mm_set1_epi32(
+        packWeights(weights[0], weights[1]));
+    const auto w23 = _mm_set1_epi32(
+        packWeights(weights[2], weights[3]));
+    const auto round = _mm_set1_epi32(1 << (vShift - 1));
+
+    const auto sum = [&](__m128i r01, __m128i r23)
+    {
+        return _mm_srai_epi32(
+            _mm_add_epi32(
+                _mm_add_epi32(
+                    _mm_madd_epi16(r01, w01),
+                    _mm_madd_epi16(r23, w23)),
+                round),
+            vShift);
+    };
+
+    int x{};
+    for (; x + 8 <= w; x += 8) {
+        const auto load = [&](int k)
+        {
+            return _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(srcRows[k] + x));
+        };
+
+        const auto r0 = load(0);
+        const auto r1 = load(1);
+        const auto r2 = load(2);
+        const auto r3 = load(3);
+
+        const auto lo = sum(
+            _mm_unpacklo_epi16(r0, r1), _mm_unpacklo_epi16(r2, r3));
+        const auto hi = sum(
+            _mm_unpackhi_epi16(r0, r1), _mm_unpackhi_epi16(r2, r3));
+
+        const auto px16 = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(
+            reinterpret_cast<__m128i*>(dstRow + x),
+            _mm_packus_epi16(px16, px16));
+    }
+
+    for (; x < w; ++x)
+        dstRow[x] = vSum(srcRows, weights, x);
+}
+
+
+#endif
+
+
+#if DPSO_IMG_AVX2
+
+
+__attribute__((target("avx2")))
+static void upscaleVRowAvx2(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w)
+{
+    // Lambdas don't inherit the target attribute, so everything is
+    // spelled out in the loop.
+
+    const auto w01 = _mm256_set1_epi32(
+        packWeights(weights[0], weights[1]));
+    const auto w23 = _mm256_set1_epi32(
+        packWeights(weights[2], weights[3]));
+    const auto round = _mm256_set1_epi32(1 << (vShift - 1));
+
+    int x{};
+    for (; x + 16 <= w; x += 16) {
+        const auto r0 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(srcRows[0] + x));
+        const auto r1 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(srcRows[1] + x));
+        const auto r2 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(srcRows[2] + x));
+        const auto r3 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(srcRows[3] + x));
+
+        const auto lo = _mm256_srai_epi32(
+            _mm256_add_epi32(
+                _mm256_add_epi32(
+                    _mm256_madd_epi16(
+                        _mm256_unpacklo_epi16(r0, r1), w01),
+                    _mm256_madd_epi16(
+                        _mm256_unpacklo_epi16(r2, r3), w23)),
+                round),
+            vShift);
+        const auto hi = _mm256_srai_epi32(
+            _mm256_add_epi32(
+                _mm256_add_epi32(
+                    _mm256_madd_epi16(
+                        _mm256_unpackhi_epi16(r0, r1), w01),
+                    _mm256_madd_epi16(
+                        _mm256_unpackhi_epi16(r2, r3), w23)),
+                round),
+            vShift);
+
+        // Unpacking and packing work within 128-bit lanes, so the
+        // pixels stay in order in each lane. The final packing puts
+        // the 8 pixels of each lane into its lower 64 bits, and the
+        // permutation moves them together.
+        const auto px16 = _mm256_packs_epi32(lo, hi);
+        const auto px8 = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(px16, px16), 0xd8);
+
+        _mm_storeu_si128(
+            reinterpret_cast<__m128i*>(dstRow + x),
+            _mm256_castsi256_si128(px8));
+    }
+
+    for (; x < w; ++x)
+        dstRow[x] = vSum(srcRows, weights, x);
+}
+
+
+#endif
+
+
+#if DPSO_IMG_NEON
+
+
+static void upscaleVRowNeon(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w)
+{
+    const auto round = vdupq_n_s32(1 << (vShift - 1));
+
+    const auto sum = [&](
+        int16x4_t r0, int16x4_t r1, int16x4_t r2, int16x4_t r3)
+    {
+        auto acc = vmlal_n_s16(round, r0, weights[0]);
+        acc = vmlal_n_s16(acc, r1, weights[1]);
+        acc = vmlal_n_s16(acc, r2, weights[2]);
+        acc = vmlal_n_s16(acc, r3, weights[3]);
+
+        return vqmovn_s32(vshrq_n_s32(acc, vShift));
+    };
+
+    int x{};
+    for (; x + 8 <= w; x += 8) {
+        const auto r0 = vld1q_s16(srcRows[0] + x);
+        const auto r1 = vld1q_s16(srcRows[1] + x);
+        const auto r2 = vld1q_s16(srcRows[2] + x);
+        const auto r3 = vld1q_s16(srcRows[3] + x);
+
+        const auto px16 = vcombine_s16(
+            sum(
+                vget_low_s16(r0), vget_low_s16(r1),
+                vget_low_s16(r2), vget_low_s16(r3)),
+            sum(
+                vget_high_s16(r0), vget_high_s16(r1),
+                vget_high_s16(r2), vget_high_s16(r3)));
+
+        vst1_u8(dstRow + x, vqmovun_s16(px16));
+    }
+
+    for (; x < w; ++x)
+        dstRow[x] = vSum(srcRows, weights, x);
+}
+
+
+#endif
+
+
+using VRowFn = void (*)(
+    const std::int16_t* const*,
+    const std::int16_t*,
+    std::uint8_t*,
+    int);
+
+
+static VRowFn selectVRowFn()
+{
+    #if DPSO_IMG_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return upscaleVRowAvx2;
+    #endif
+
+    #if DPSO_IMG_SSE2
+    return upscaleVRowSse2;
+    #elif DPSO_IMG_NEON
+    return upscaleVRowNeon;
+    #else
+    return upscaleVRowScalar;
+    #endif
+}
+
+
+void upscaleVRow(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w)
+{
+    static const auto fn = selectVRowFn();
+    fn(srcRows, weights, dstRow, w);
+}
+
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Fixed-point row kernels for Upscale.
+//
+// Upscale filters use 4 taps with weights in Q14 format. The
+// horizontal pass produces intermediate values in Q6 format, which
+// leaves enough headroom in 16 bits for the overshoot of the
+// Catmull-Rom filter, and the vertical pass combines 4 intermediate
+// rows into the final 8-bit pixels.
+
+
+namespace dpso::img {
+
+
+const auto upscaleNumTaps = 4;
+const auto upscaleWeightFracBits = 14;
+const auto upscaleTmpFracBits = 6;
+
+
+// Return the weight in Q14 format.
+std::int16_t toUpscaleWeight(float weight);
+
+
+// Make the sum of the weights exactly 1.0 by adjusting the weight at
+// the given index.
+void normalizeUpscaleWeights(std::int16_t* weights, int adjustIdx);
+
+
+// Horizontal pass with arbitrary source indices for each of dstW
+// output values.
+void upscaleHRow(
+    const std::uint8_t* srcRow,
+    const int* indices,
+    const std::int16_t* weights,
+    std::int16_t* dstRow,
+    int dstW);
+
+
+// Horizontal pass for the integer scale factor.
+//
+// With an integer scale, output pixel scale * i + p uses source
+// pixels starting from i + offsets[p] with the weights of phase p,
+// so there's no need for per-pixel indices. The source row must be
+// padded so that it's valid to read 2 pixels before the start and 2
+// pixels after the end.
+void upscaleHRowPolyphase(
+    const std::uint8_t* paddedSrcRow,
+    int srcW,
+    int scale,
+    const int* offsets,
+    const std::int16_t* weights,
+    std::int16_t* dstRow);
+
+
+// Vertical pass: dstRow[x] is the weighted sum of srcRows[k][x].
+//
+// The function uses the best SIMD instruction set available at run
+// time.
+void upscaleVRow(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w);
+
+
+// Scalar version of upscaleVRow(). The result is identical.
+void upscaleVRowScalar(
+    const std::int16_t* const* srcRows,
+    const std::int16_t* weights,
+    std::uint8_t* dstRow,
+    int w);
+
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <stdexcept>
@@ -44,6 +45,10 @@ public:
 
         Status status;
         std::string text;
+
+        // Time recognize() spent on loading language data. Zero if
+        // the data was already loaded by a previous call.
+        std::chrono::steady_clock::duration langLoadingTime{};
     };
 
     // Returns false to terminate OCR.
@@ -67,6 +72,13 @@ public:
     // Throws RecognizerError
     virtual void reloadLangs() = 0;
 
+    // Release any data that recognize() caches between calls, like
+    // loaded language models. Called when the language files are
+    // about to be modified.
+    virtual void clearCache() = 0;
+
+    // Can be called from several threads at the same time, but not
+    // concurrently with reloadLangs() and clearCache().
     virtual Result recognize(
         const Image& image,
         const std::vector<int>& langIndices,
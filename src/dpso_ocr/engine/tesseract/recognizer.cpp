@@ -1,6 +1,10 @@
 #include "engine/tesseract/recognizer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -8,6 +12,7 @@
 #include <tesseract/ocrclass.h>
 
 #include "dpso_utils/os.h"
+#include "dpso_utils/scope_exit.h"
 #include "dpso_utils/str.h"
 
 #include "engine/recognizer_error.h"
@@ -20,6 +25,151 @@ namespace dpso::ocr::tesseract {
 namespace {
 
 
+// Cache of initialized TessBaseAPI instances.
+//
+// TessBaseAPI::Init() loads traineddata for all requested languages,
+// which usually takes longer than the recognition itself. The cache
+// keeps a few recently used instances keyed by the "+"-separated
+// language string so that repeated jobs with the same languages skip
+// Init() entirely.
+//
+// A TessBaseAPI can only run one recognition at a time, so
+// concurrent calls take instances out of the cache and put them back
+// when done. The cache is shared by all threads, and its limit
+// applies to the total number of instances, including the taken
+// ones: it's maxEntries or the number of taken instances, whichever
+// is larger.
+class TessCache {
+public:
+    struct Entry {
+        std::string tessLangsStr;
+        std::unique_ptr<::tesseract::TessBaseAPI> tess;
+    };
+
+    // Take an instance initialized for tessLangsStr. The tess field
+    // of the result is null if TessBaseAPI::Init() failed. initTime
+    // is set to the time spent in Init(), which is zero if the
+    // instance was cached.
+    Entry take(
+        const std::string& sysDataDir,
+        const std::string& tessLangsStr,
+        std::chrono::steady_clock::duration& initTime);
+
+    // Return an instance obtained from take().
+    void put(Entry entry);
+
+    // Must not be called while instances are taken.
+    void clear();
+private:
+    static const std::size_t maxEntries{3};
+
+    std::mutex mutex;
+
+    // Idle instances. The most recently used entry is at the front.
+    std::vector<Entry> entries;
+    std::size_t numTaken{};
+
+    // Release the least recently used idle instances to fit the
+    // limit, but keep at least minNumIdle of them.
+    void trim(std::size_t minNumIdle);
+};
+
+
+TessCache::Entry TessCache::take(
+    const std::string& sysDataDir,
+    const std::string& tessLangsStr,
+    std::chrono::steady_clock::duration& initTime)
+{
+    initTime = {};
+
+    {
+        const std::lock_guard guard{mutex};
+
+        const auto iter = std::find_if(
+            entries.begin(), entries.end(),
+            [&](const Entry& entry)
+            {
+                return entry.tessLangsStr == tessLangsStr;
+            });
+
+        ++numTaken;
+
+        if (iter != entries.end()) {
+            auto entry = std::move(*iter);
+            entries.erase(iter);
+            return entry;
+        }
+
+        // Free the memory before loading the new data.
+        trim(0);
+    }
+
+    const auto initStartTime = std::chrono::steady_clock::now();
+
+    auto tess = std::make_unique<::tesseract::TessBaseAPI>();
+    const auto initFailed =
+        tess->Init(sysDataDir.c_str(), tessLangsStr.c_str()) != 0;
+
+    initTime = std::chrono::steady_clock::now() - initStartTime;
+
+    if (initFailed) {
+        const std::lock_guard guard{mutex};
+        --numTaken;
+        return {tessLangsStr, nullptr};
+    }
+
+    // Silence "Estimating resolution as ..." and any other debug
+    // messages that Tesseract prints to stderr by default.
+    #ifdef NDEBUG
+    tess->SetVariable(
+        "debug_file",
+        #ifdef __unix__
+        "/dev/null"
+        #elif defined(_WIN32)
+        "nul"
+        #else
+        "" // Default value; Tesseract will print to stderr.
+        #endif
+        );
+    #endif
+
+    return {tessLangsStr, std::move(tess)};
+}
+
+
+void TessCache::put(Entry entry)
+{
+    assert(entry.tess);
+
+    const std::lock_guard guard{mutex};
+
+    assert(numTaken > 0);
+    --numTaken;
+
+    entries.insert(entries.begin(), std::move(entry));
+    trim(1);
+}
+
+
+void TessCache::clear()
+{
+    const std::lock_guard guard{mutex};
+    assert(numTaken == 0);
+    entries.clear();
+}
+
+
+void TessCache::trim(std::size_t minNumIdle)
+{
+    const auto maxNumIdle = std::max(
+        numTaken < maxEntries ? maxEntries - numTaken : 0,
+        minNumIdle);
+
+    if (entries.size() > maxNumIdle)
+        entries.erase(entries.begin() + maxNumIdle, entries.end());
+}
+
+
 class Recognizer : public ocr::Recognizer {
 public:
     explicit Recognizer(std::string_view dataDir)
@@ -56,9 +206,16 @@ public:
 
     void reloadLangs() override
     {
+        // The language files might have changed.
+        tessCache.clear();
         reloadLangCodes();
     }
 
+    void clearCache() override
+    {
+        tessCache.clear();
+    }
+
     Result recognize(
         const Image& image,
         const std::vector<int>& langIndices,
@@ -66,7 +223,7 @@ public:
         const CancelChecker& cancelChecker) override;
 private:
     std::string dataDir;
-    ::tesseract::TessBaseAPI tess;
+    TessCache tessCache;
     std::vector<std::string> langCodes;
 
     void reloadLangCodes()
@@ -116,6 +273,68 @@ struct CancelData {
 };
 
 
+::tesseract::PageSegMode getPageSegMode(
+    OcrFeatures ocrFeatures,
+    std::size_t numLangs,
+    std::size_t numVerticalLangs)
+{
+    if (ocrFeatures & ocrFeatureTextSegmentation)
+        return ::tesseract::PSM_AUTO;
+
+    if (numVerticalLangs == 0)
+        // PSM_SINGLE_BLOCK implies horizontal text.
+        return ::tesseract::PSM_SINGLE_BLOCK;
+
+    if (numVerticalLangs == numLangs)
+        return ::tesseract::PSM_SINGLE_BLOCK_VERT_TEXT;
+
+    // When we have both vertical and horizontal languages, forcing
+    // segmentation is the best we can do: at least Tesseract will be
+    // able to pick the right language based on the actual
+    // orientation of the text in each block. Using a specific
+    // PSM_SINGLE_BLOCK_* instead will 100% break OCR of text with
+    // the opposite orientation.
+    return ::tesseract::PSM_AUTO;
+}
+
+
+Recognizer::Result recognizeWithTess(
+    ::tesseract::TessBaseAPI& tess,
+    const Recognizer::Image& image,
+    ::tesseract::PageSegMode pageSegMode,
+    const Recognizer::CancelChecker& cancelChecker)
+{
+    using Result = Recognizer::Result;
+
+    // Free the recognition results before returning, so that cached
+    // instances don't hold the image and page layout between jobs.
+    const ScopeExit clearTess{[&]{ tess.Clear(); }};
+
+    tess.SetPageSegMode(pageSegMode);
+
+    tess.SetImage(
+        image.data, image.width, image.height, 1, image.pitch);
+
+    CancelData cancelData{cancelChecker};
+    if (tess.Recognize(&cancelData.textDesc) != 0)
+        return {
+            Result::Status::error, "TessBaseAPI::Recognize() failed"};
+
+    if (cancelData.canceled)
+        return {Result::Status::terminated, ""};
+
+    std::unique_ptr<char[]> text{tess.GetUTF8Text()};
+    if (!text)
+        return {
+            Result::Status::error,
+            "TessBaseAPI::GetUTF8Text() returned null"};
+
+    const auto textLen = prettifyText(text.get());
+
+    return {Result::Status::success, {text.get(), textLen}};
+}
+
+
 Recognizer::Result Recognizer::recognize(
     const Image& image,
     const std::vector<int>& langIndices,
@@ -147,64 +366,27 @@ Recognizer::Result Recognizer::recognize(
                 + e.what()};
     }
 
-    if (tess.Init(sysDataDir.c_str(), tessLangsStr.c_str()) != 0)
-        return {Result::Status::error, "TessBaseAPI::Init() failed"};
-
-    // Silence "Estimating resolution as ..." and any other debug
-    // messages that Tesseract prints to stderr by default.
-    #ifdef NDEBUG
-    tess.SetVariable(
-        "debug_file",
-        #ifdef __unix__
-        "/dev/null"
-        #elif defined(_WIN32)
-        "nul"
-        #else
-        "" // Default value; Tesseract will print to stderr.
-        #endif
-        );
-    #endif
-
-    ::tesseract::PageSegMode pageSegMode;
-
-    if (ocrFeatures & ocrFeatureTextSegmentation)
-        pageSegMode = ::tesseract::PSM_AUTO;
-    else if (numVerticalLangs == 0)
-        // PSM_SINGLE_BLOCK implies horizontal text.
-        pageSegMode = ::tesseract::PSM_SINGLE_BLOCK;
-    else if (numVerticalLangs == langIndices.size())
-        pageSegMode = ::tesseract::PSM_SINGLE_BLOCK_VERT_TEXT;
-    else
-        // When we have both vertical and horizontal languages,
-        // forcing segmentation is the best we can do: at least
-        // Tesseract will be able to pick the right language based
-        // on the actual orientation of the text in each block.
-        // Using a specific PSM_SINGLE_BLOCK_* instead will 100%
-        // break OCR of text with the opposite orientation.
-        pageSegMode = ::tesseract::PSM_AUTO;
-
-    tess.SetPageSegMode(pageSegMode);
-
-    tess.SetImage(
-        image.data, image.width, image.height, 1, image.pitch);
-
-    CancelData cancelData{cancelChecker};
-    if (tess.Recognize(&cancelData.textDesc) != 0)
-        return {
-            Result::Status::error, "TessBaseAPI::Recognize() failed"};
-
-    if (cancelData.canceled)
-        return {Result::Status::terminated, ""};
-
-    std::unique_ptr<char[]> text{tess.GetUTF8Text()};
-    if (!text)
+    std::chrono::steady_clock::duration langLoadingTime;
+    auto cacheEntry = tessCache.take(
+        sysDataDir, tessLangsStr, langLoadingTime);
+    if (!cacheEntry.tess)
         return {
             Result::Status::error,
-            "TessBaseAPI::GetUTF8Text() returned null"};
+            "TessBaseAPI::Init() failed",
+            langLoadingTime};
 
-    const auto textLen = prettifyText(text.get());
+    const ScopeExit putToCache{
+        [&]{ tessCache.put(std::move(cacheEntry)); }};
 
-    return {Result::Status::success, {text.get(), textLen}};
+    auto result = recognizeWithTess(
+        *cacheEntry.tess,
+        image,
+        getPageSegMode(
+            ocrFeatures, langIndices.size(), numVerticalLangs),
+        cancelChecker);
+    result.langLoadingTime = langLoadingTime;
+
+    return result;
 }
 
 
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <memory>
+
+
+namespace dpso::ocr {
+
+
+// Waitable notification handle.
+//
+// On Unix-like systems, the handle is the read end of a pipe that
+// becomes readable after notify() and stays readable until clear().
+// Notifications are coalesced: no matter how many times notify() is
+// called, a single clear() makes the handle non-readable again.
+//
+// notify() is thread-safe and can be called from any thread. getFd()
+// and clear() are intended for the thread that waits for the handle.
+class Notifier {
+public:
+    Notifier();
+    ~Notifier();
+
+    Notifier(const Notifier&) = delete;
+    Notifier& operator=(const Notifier&) = delete;
+
+    Notifier(Notifier&&) = delete;
+    Notifier& operator=(Notifier&&) = delete;
+
+    // Returns -1 if the platform has no waitable file descriptors,
+    // or if the handle could not be created.
+    int getFd() const;
+
+    void notify();
+    void clear();
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+
+}
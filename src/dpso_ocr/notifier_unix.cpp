@@ -0,0 +1,96 @@
+#include "notifier.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace dpso::ocr {
+
+
+static bool setFlags(int fd)
+{
+    const auto fdFlags = fcntl(fd, F_GETFD);
+    const auto flFlags = fcntl(fd, F_GETFL);
+    return
+        fdFlags != -1
+        && flFlags != -1
+        && fcntl(fd, F_SETFD, fdFlags | FD_CLOEXEC) != -1
+        && fcntl(fd, F_SETFL, flFlags | O_NONBLOCK) != -1;
+}
+
+
+struct Notifier::Impl {
+    int readFd{-1};
+    int writeFd{-1};
+
+    Impl()
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+            return;
+
+        if (!setFlags(fds[0]) || !setFlags(fds[1])) {
+            close(fds[0]);
+            close(fds[1]);
+            return;
+        }
+
+        readFd = fds[0];
+        writeFd = fds[1];
+    }
+
+    ~Impl()
+    {
+        if (readFd != -1)
+            close(readFd);
+        if (writeFd != -1)
+            close(writeFd);
+    }
+};
+
+
+Notifier::Notifier()
+    : impl{std::make_unique<Impl>()}
+{
+}
+
+
+Notifier::~Notifier() = default;
+
+
+int Notifier::getFd() const
+{
+    return impl->readFd;
+}
+
+
+void Notifier::notify()
+{
+    if (impl->writeFd == -1)
+        return;
+
+    // EAGAIN means the pipe is full, which is fine since the read
+    // end is readable anyway.
+    const char c{};
+    while (write(impl->writeFd, &c, 1) == -1 && errno == EINTR);
+}
+
+
+void Notifier::clear()
+{
+    if (impl->readFd == -1)
+        return;
+
+    char buf[64];
+    while (true) {
+        const auto numRead = read(impl->readFd, buf, sizeof(buf));
+        if (numRead > 0
+                || (numRead == -1 && errno == EINTR))
+            continue;
+        break;
+    }
+}
+
+
+}
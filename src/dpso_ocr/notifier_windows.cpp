@@ -0,0 +1,33 @@
+#include "notifier.h"
+
+
+namespace dpso::ocr {
+
+
+struct Notifier::Impl {
+};
+
+
+Notifier::Notifier() = default;
+
+
+Notifier::~Notifier() = default;
+
+
+int Notifier::getFd() const
+{
+    return -1;
+}
+
+
+void Notifier::notify()
+{
+}
+
+
+void Notifier::clear()
+{
+}
+
+
+}
@@ -8,7 +8,10 @@
 #include <cstring>
 #include <ctime>
 #include <functional>
+#include <map>
+#include <optional>
 #include <queue>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <utility>
@@ -19,15 +22,19 @@
 
 #include "dpso_utils/error_set.h"
 #include "dpso_utils/geometry.h"
+#include "dpso_utils/metrics.h"
 #include "dpso_utils/str.h"
 #include "dpso_utils/strftime.h"
 #include "dpso_utils/synchronized.h"
-#include "dpso_utils/timing.h"
+#include "dpso_utils/thread_pool.h"
+#include "dpso_utils/trace.h"
 
 #include "data_lock.h"
 #include "engine/engine.h"
 #include "engine/recognizer.h"
 #include "engine/recognizer_error.h"
+#include "notifier.h"
+#include "result_cache.h"
 
 
 using namespace dpso;
@@ -49,16 +56,54 @@ struct Lang {
 
 
 struct Job {
+    std::size_t id;
     img::ImgUPtr image;
     std::vector<int> langIndices;
     ocr::OcrFeatures ocrFeatures;
     std::string timestamp;
+    metrics::Clock::time_point queueTime;
 };
 
 
 struct JobResult {
     ocr::Recognizer::Result ocrResult;
     std::string timestamp;
+    // Set when the result is moved to Link::results.
+    std::size_t jobId{};
+    metrics::Clock::time_point publishTime{};
+};
+
+
+// See DpsoOcrStats for the meaning of the metrics.
+struct Metrics {
+    metrics::Counter& numQueuedJobs;
+    metrics::Counter& numSucceededJobs;
+    metrics::Counter& numFailedJobs;
+    metrics::Counter& numTerminatedJobs;
+
+    metrics::Histogram& queueWait;
+    metrics::Histogram& preprocessing;
+    metrics::Histogram& recognitionWait;
+    metrics::Histogram& langLoading;
+    metrics::Histogram& recognition;
+    metrics::Histogram& resultDrain;
+    metrics::Histogram& total;
+
+    explicit Metrics(metrics::Registry& registry)
+        : numQueuedJobs{registry.getCounter("queued_jobs")}
+        , numSucceededJobs{registry.getCounter("succeeded_jobs")}
+        , numFailedJobs{registry.getCounter("failed_jobs")}
+        , numTerminatedJobs{registry.getCounter("terminated_jobs")}
+        , queueWait{registry.getHistogram("queue_wait_us")}
+        , preprocessing{registry.getHistogram("preprocessing_us")}
+        , recognitionWait{
+            registry.getHistogram("recognition_wait_us")}
+        , langLoading{registry.getHistogram("lang_loading_us")}
+        , recognition{registry.getHistogram("recognition_us")}
+        , resultDrain{registry.getHistogram("result_drain_us")}
+        , total{registry.getHistogram("total_us")}
+    {
+    }
 };
 
 
@@ -68,42 +113,129 @@ struct Link {
     std::condition_variable jobsDoneCondVar;
 
     std::queue<Job> jobQueue;
-    bool jobActive;
+    int numActiveJobs;
+    // Number of workers that have no jobs. A busy worker only takes
+    // a job from the queue if there are no idle workers, so that a
+    // burst of jobs is spread over all workers rather than queued
+    // behind busy recognizers.
+    int numIdleWorkers;
+
+    // Ids are assigned to jobs in the queue order. Since jobs can
+    // finish out of order when there are several workers, the results
+    // of jobs that finish ahead of an earlier one are kept in
+    // earlyResults until all preceding results are published.
+    std::size_t nextJobId;
+    std::size_t nextResultJobId;
+    std::map<std::size_t, JobResult> earlyResults;
+    int numPublishedResults;
 
     DpsoOcrProgress progress;
 
     std::queue<JobResult> results;
 
     bool terminateJobs;
-    bool terminateThread;
+    bool terminateThreads;
 
     bool jobsPending() const
     {
-        return !jobQueue.empty() || jobActive;
+        return !jobQueue.empty() || numActiveJobs > 0;
     }
 };
 
 
+struct PreparedJob {
+    Job job;
+    int imgBufferIdx;
+    ocr::Recognizer::Image image;
+    // Set if the result cache is enabled.
+    std::optional<ocr::ResultCache::Key> cacheKey;
+    metrics::Clock::time_point prepEndTime;
+};
+
+
+// Link between the preprocessing and recognition stages of a worker.
+struct Handoff {
+    std::condition_variable condVar;
+
+    // Indices of Worker::imgBuffers available to the preprocessing
+    // stage.
+    std::vector<int> freeImgBufferIndices;
+
+    std::queue<PreparedJob> preparedJobs;
+
+    bool terminate;
+};
+
+
+// Each worker owns the buffers it needs to process a job, so that
+// workers only contend for the Link and briefly for the language data
+// cache of the shared recognizer.
+//
+// A worker is a two-stage pipeline: the preprocessing thread prepares
+// the image of the next job while the recognition thread runs OCR on
+// the previous one. The stages exchange images via the
+// double-buffered imgBuffers, which also limits the number of
+// prepared jobs waiting for recognition.
+struct Worker {
+    std::thread prepThread;
+    std::thread recognitionThread;
+
+    std::vector<std::uint8_t> grayImgBuffer;
+    std::vector<std::uint8_t> imgBuffers[2];
+    img::Preprocess preprocess;
+
+    // Separate steps of Preprocess, used when we need to dump the
+    // intermediate images.
+    std::vector<std::uint8_t> upscaledImgBuffer;
+    img::Upscale upscale;
+    img::UnsharpMask unsharpMask;
+
+    Synchronized<Handoff> handoff;
+
+    // Number of jobs taken from the queue and not finished yet.
+    // Protected by DpsoOcr::link.
+    int numJobs{};
+};
+
+
 }
 
 
 struct DpsoOcr {
+    std::string engineId;
     ocr::DataLockObserver dataLockObserver;
 
+    // Shared by the image operations of all workers. When a single
+    // job is being prepared, which is the usual case for interactive
+    // use, its preprocessing can use all cores.
+    std::unique_ptr<ThreadPool> imgThreadPool;
+
+    // Shared by all workers, so that they also share the cache of
+    // loaded language data.
     std::unique_ptr<ocr::Recognizer> recognizer;
+    std::vector<std::unique_ptr<Worker>> workers;
 
     std::string defaultLangCode;
     std::vector<Lang> langs;
     int numActiveLangs;
 
     Synchronized<Link> link;
-    std::thread thread;
-
-    std::vector<std::uint8_t> imgBuffers[2];
-    img::Upscale upscale;
-    img::UnsharpMask unsharpMask;
     bool dumpDebugImages;
 
+    // Null unless tracing is enabled via DPSO_TRACE_FILE.
+    std::unique_ptr<trace::Recorder> traceRecorder;
+    std::string traceFilePath;
+
+    ocr::ResultCache resultCache;
+
+    // Signaled by the worker threads after changing link.progress or
+    // link.results.
+    ocr::Notifier notifier;
+
+    metrics::Registry metricsRegistry;
+    Metrics metrics{metricsRegistry};
+    std::string statsJson;
+
     std::size_t numPendingResults;
     std::queue<JobResult> results;
 };
@@ -119,14 +251,16 @@ static void reloadLangs(DpsoOcr& ocr)
 
     ocr.numActiveLangs = 0;
 
+    const auto& recognizer = *ocr.recognizer;
+
     ocr.langs.clear();
-    ocr.langs.reserve(ocr.recognizer->getNumLangs());
+    ocr.langs.reserve(recognizer.getNumLangs());
 
-    for (int i{}; i < ocr.recognizer->getNumLangs(); ++i)
+    for (int i{}; i < recognizer.getNumLangs(); ++i)
         ocr.langs.push_back(
             {
-                ocr.recognizer->getLangCode(i),
-                ocr.recognizer->getLangName(i),
+                recognizer.getLangCode(i),
+                recognizer.getLangName(i),
                 i,
                 false});
 
@@ -151,10 +285,21 @@ static void waitJobsToFinish(DpsoOcr& ocr)
 }
 
 
-static void threadLoop(DpsoOcr& ocr);
+static void prepThreadLoop(DpsoOcr& ocr, Worker& worker);
+static void recognitionThreadLoop(DpsoOcr& ocr, Worker& worker);
+
+
+const int maxDefaultNumWorkers = 4;
 
 
 DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir)
+{
+    return dpsoOcrCreateEx(engineIdx, dataDir, 0);
+}
+
+
+DpsoOcr* dpsoOcrCreateEx(
+    int engineIdx, const char* dataDir, int numWorkers)
 {
     if (engineIdx < 0
             || static_cast<std::size_t>(engineIdx)
@@ -165,9 +310,32 @@ DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir)
 
     const auto& ocrEngine = ocr::Engine::get(engineIdx);
 
+    const auto* dumpDebugImagesEnvVar = std::getenv(
+        "DPSO_DUMP_DEBUG_IMAGES");
+    const auto dumpDebugImages =
+        dumpDebugImagesEnvVar
+        && *dumpDebugImagesEnvVar
+        && std::strcmp(dumpDebugImagesEnvVar, "0") != 0;
+
+    // Workers that recognize at the same time need separate
+    // Tesseract instances, each with its own copy of the language
+    // data, so we don't use all hardware threads by default.
+    if (numWorkers <= 0)
+        numWorkers = std::clamp(
+            static_cast<int>(std::thread::hardware_concurrency()),
+            1,
+            maxDefaultNumWorkers);
+
+    // Debug images are saved under fixed names, so several workers
+    // would overwrite each other's files.
+    if (dumpDebugImages)
+        numWorkers = 1;
+
     // We don't use OcrUPtr here because dpsoOcrDelete() expects
-    // a joinable thread.
+    // joinable threads.
     auto ocr = std::make_unique<DpsoOcr>();
+    ocr->engineId = ocrEngine.getInfo().id;
+    ocr->dumpDebugImages = dumpDebugImages;
 
     ocr->dataLockObserver = ocr::DataLockObserver{
         ocrEngine.getInfo().id,
@@ -175,6 +343,10 @@ DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir)
         [&ocr = *ocr]
         {
             waitJobsToFinish(ocr);
+            ocr.recognizer->clearCache();
+
+            // Updated language data may give different results.
+            ocr.resultCache.clear();
         },
         [&ocr = *ocr]
         {
@@ -193,6 +365,12 @@ DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir)
         return nullptr;
     }
 
+    ocr->imgThreadPool = std::make_unique<ThreadPool>(
+        std::max(
+            0,
+            static_cast<int>(std::thread::hardware_concurrency())
+                - 1));
+
     try {
         ocr->recognizer = ocrEngine.createRecognizer(dataDir);
     } catch (ocr::RecognizerError& e) {
@@ -200,17 +378,50 @@ DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir)
         return nullptr;
     }
 
+    ocr->workers.reserve(numWorkers);
+    for (int i{}; i < numWorkers; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->handoff.getLock()->freeImgBufferIndices = {0, 1};
+
+        worker->preprocess.setThreadPool(ocr->imgThreadPool.get());
+        worker->upscale.setThreadPool(ocr->imgThreadPool.get());
+        worker->unsharpMask.setThreadPool(ocr->imgThreadPool.get());
+
+        ocr->workers.push_back(std::move(worker));
+    }
+
+    ocr->link.getLock()->numIdleWorkers = numWorkers;
+
     ocr->defaultLangCode = ocr->recognizer->getDefaultLangCode();
     reloadLangs(*ocr);
 
-    ocr->thread = std::thread(threadLoop, std::ref(*ocr));
+    // Chrome trace event file to be written on dpsoOcrDelete().
+    if (const auto* traceFileEnvVar = std::getenv("DPSO_TRACE_FILE");
+            traceFileEnvVar && *traceFileEnvVar) {
+        ocr->traceRecorder = std::make_unique<trace::Recorder>();
+        ocr->traceFilePath = traceFileEnvVar;
 
-    const auto* dumpDebugImagesEnvVar = std::getenv(
-        "DPSO_DUMP_DEBUG_IMAGES");
-    ocr->dumpDebugImages =
-        dumpDebugImagesEnvVar
-        && *dumpDebugImagesEnvVar
-        && std::strcmp(dumpDebugImagesEnvVar, "0") != 0;
+        ocr->traceRecorder->setThreadName(
+            std::this_thread::get_id(), "Main");
+    }
+
+    for (std::size_t i{}; i < ocr->workers.size(); ++i) {
+        auto& worker = *ocr->workers[i];
+
+        worker.prepThread = std::thread(
+            prepThreadLoop, std::ref(*ocr), std::ref(worker));
+        worker.recognitionThread = std::thread(
+            recognitionThreadLoop, std::ref(*ocr), std::ref(worker));
+
+        if (ocr->traceRecorder) {
+            ocr->traceRecorder->setThreadName(
+                worker.prepThread.get_id(),
+                str::format("Worker {} preprocessing", i + 1));
+            ocr->traceRecorder->setThreadName(
+                worker.recognitionThread.get_id(),
+                str::format("Worker {} recognition", i + 1));
+        }
+    }
 
     return ocr.release();
 }
@@ -225,10 +436,26 @@ void dpsoOcrDelete(DpsoOcr* ocr)
 
     {
         const auto link = ocr->link.getLock();
-        link->terminateThread = true;
-        link->threadActionCondVar.notify_one();
+        link->terminateThreads = true;
+        link->threadActionCondVar.notify_all();
+    }
+
+    for (auto& worker : ocr->workers) {
+        {
+            const auto handoff = worker->handoff.getLock();
+            handoff->terminate = true;
+            handoff->condVar.notify_all();
+        }
+
+        worker->prepThread.join();
+        worker->recognitionThread.join();
     }
-    ocr->thread.join();
+
+    if (ocr->traceRecorder)
+        try {
+            ocr->traceRecorder->saveJson(ocr->traceFilePath);
+        } catch (std::runtime_error&) {  // os::Error, StreamError
+        }
 
     delete ocr;
 }
@@ -344,22 +571,40 @@ static std::string createTimestamp()
 }
 
 
+// Return the factor for upscaling an image with the given height of
+// text lines.
+static int getUpscaleFactor(int textLineHeight)
+{
+    // Tesseract works best when the x-height is about 20 px or more.
+    // The line height (from ascenders to descenders) is roughly twice
+    // the x-height.
+    const auto targetLineHeight = 40;
+    const auto maxScale = 4;
+
+    if (textLineHeight <= 0)
+        return maxScale;
+
+    return std::clamp(
+        (targetLineHeight + textLineHeight - 1) / textLineHeight,
+        1,
+        maxScale);
+}
+
+
+// Convert the image to the form suitable for OCR in outBuffer.
 static ocr::Recognizer::Image prepareImage(
-    DpsoOcr& ocr, const DpsoImg* image)
+    Worker& worker,
+    ThreadPool& imgThreadPool,
+    bool dumpDebugImages,
+    trace::Recorder* traceRecorder,
+    const DpsoImg* image,
+    std::vector<std::uint8_t>& outBuffer)
 {
     assert(image);
 
     const auto imageW = dpsoImgGetWidth(image);
     const auto imageH = dpsoImgGetHeight(image);
 
-    const auto scale = 4;
-    const auto bufferW = imageW * scale;
-    const auto bufferH = imageH * scale;
-    const auto bufferPitch = bufferW;
-
-    for (auto& buffer : ocr.imgBuffers)
-        buffer.resize(bufferH * bufferPitch);
-
     const std::uint8_t* graySrc;
     int graySrcPitch;
     if (const auto pxFormat = dpsoImgGetPxFormat(image);
@@ -367,97 +612,283 @@ static ocr::Recognizer::Image prepareImage(
         graySrc = dpsoImgGetConstData(image);
         graySrcPitch = dpsoImgGetPitch(image);
     } else {
-        DPSO_START_TIMING(toGray);
+        worker.grayImgBuffer.resize(imageW * imageH);
+
+        const trace::Span span{traceRecorder, "to_gray"};
         img::toGray(
             dpsoImgGetConstData(image),
             dpsoImgGetPitch(image),
             pxFormat,
-            ocr.imgBuffers[0].data(),
-            bufferPitch,
+            worker.grayImgBuffer.data(),
             imageW,
-            imageH);
-        DPSO_END_TIMING(
-            toGray,
-            "{} to grayscale ({}x{} px)",
-            dpsoPxFormatToStr(pxFormat), imageW, imageH);
-
-        graySrc = ocr.imgBuffers[0].data();
-        graySrcPitch = bufferPitch;
+            imageW,
+            imageH,
+            &imgThreadPool);
+
+        graySrc = worker.grayImgBuffer.data();
+        graySrcPitch = imageW;
     }
 
-    if (ocr.dumpDebugImages) {
-        const auto pxFormat = dpsoImgGetPxFormat(image);
-        img::savePnm(
-            str::format(
-                "dpso_debug_1_original_{}{}",
-                dpsoPxFormatToStr(pxFormat),
-                img::getPnmExt(pxFormat)),
-            pxFormat,
-            dpsoImgGetConstData(image),
-            imageW, imageH, dpsoImgGetPitch(image));
+    int scale;
+    {
+        const trace::Span span{
+            traceRecorder, "text_line_height_estimation"};
+        const auto textLineHeight = img::estimateTextLineHeight(
+            graySrc, graySrcPitch, imageW, imageH);
+        scale = getUpscaleFactor(textLineHeight);
+    }
+
+    const auto bufferW = imageW * scale;
+    const auto bufferH = imageH * scale;
+    const auto bufferPitch = bufferW;
+
+    outBuffer.resize(bufferH * bufferPitch);
+
+    // The radius is 10 px for the maximum scale, and decreases
+    // proportionally for smaller ones so that the effect stays the
+    // same relative to the text size.
+    const auto unsharpMaskRadius = std::max(1, 10 * scale / 4);
 
-        img::savePnm(
-            "dpso_debug_2_grayscale.pgm",
-            DpsoPxFormatGrayscale,
-            graySrc, imageW, imageH, graySrcPitch);
+    if (!dumpDebugImages) {
+        const trace::Span span{traceRecorder, "preprocess"};
+        worker.preprocess(
+            graySrc, graySrcPitch, DpsoPxFormatGrayscale,
+            imageW, imageH,
+            outBuffer.data(), bufferPitch,
+            bufferW, bufferH,
+            unsharpMaskRadius);
+
+        return {outBuffer.data(), bufferW, bufferH, bufferPitch};
     }
 
-    DPSO_START_TIMING(imageResizing);
-    ocr.upscale(
+    const auto pxFormat = dpsoImgGetPxFormat(image);
+    img::savePnm(
+        str::format(
+            "dpso_debug_1_original_{}{}",
+            dpsoPxFormatToStr(pxFormat),
+            img::getPnmExt(pxFormat)),
+        pxFormat,
+        dpsoImgGetConstData(image),
+        imageW, imageH, dpsoImgGetPitch(image));
+
+    img::savePnm(
+        "dpso_debug_2_grayscale.pgm",
+        DpsoPxFormatGrayscale,
+        graySrc, imageW, imageH, graySrcPitch);
+
+    auto& upscaledBuffer = worker.upscaledImgBuffer;
+    upscaledBuffer.resize(bufferH * bufferPitch);
+
+    worker.upscale(
         graySrc, imageW, imageH, graySrcPitch,
-        ocr.imgBuffers[1].data(), bufferW, bufferH, bufferPitch);
-    DPSO_END_TIMING(
-        imageResizing,
-        "Image resizing ({}x{} px -> {}x{} px, x{})",
-        imageW, imageH, bufferW, bufferH, scale);
-
-    if (ocr.dumpDebugImages)
-        img::savePnm(
-            "dpso_debug_3_resize.pgm",
-            DpsoPxFormatGrayscale,
-            ocr.imgBuffers[1].data(), bufferW, bufferH, bufferPitch);
-
-    const auto unsharpMaskRadius = 10;
-
-    DPSO_START_TIMING(unsharpMasking);
-    ocr.unsharpMask(
-        ocr.imgBuffers[1].data(), bufferPitch,
-        ocr.imgBuffers[0].data(), bufferPitch,
+        upscaledBuffer.data(), bufferW, bufferH, bufferPitch);
+
+    img::savePnm(
+        "dpso_debug_3_resize.pgm",
+        DpsoPxFormatGrayscale,
+        upscaledBuffer.data(), bufferW, bufferH, bufferPitch);
+
+    worker.unsharpMask(
+        upscaledBuffer.data(), bufferPitch,
+        outBuffer.data(), bufferPitch,
         bufferW, bufferH,
         unsharpMaskRadius);
-    DPSO_END_TIMING(
-        unsharpMasking,
-        "Unsharp masking (radius={}, {}x{} px)",
-        unsharpMaskRadius, bufferW, bufferH);
 
-    if (ocr.dumpDebugImages)
-        img::savePnm(
-            "dpso_debug_4_unsharp_mask.pgm",
-            DpsoPxFormatGrayscale,
-            ocr.imgBuffers[0].data(), bufferW, bufferH, bufferPitch);
+    img::savePnm(
+        "dpso_debug_4_unsharp_mask.pgm",
+        DpsoPxFormatGrayscale,
+        outBuffer.data(), bufferW, bufferH, bufferPitch);
 
-    return {ocr.imgBuffers[0].data(), bufferW, bufferH, bufferPitch};
+    return {outBuffer.data(), bufferW, bufferH, bufferPitch};
 }
 
 
-static JobResult processJob(DpsoOcr& ocr, const Job& job)
+static JobResult processJob(
+    DpsoOcr& ocr, const PreparedJob& preparedJob)
 {
+    const auto& job = preparedJob.job;
+
+    // Don't start OCR of a job that was prepared after termination.
+    if (ocr.link.getLock()->terminateJobs)
+        return {
+            {ocr::Recognizer::Result::Status::terminated, ""},
+            job.timestamp};
+
+    const auto startTime = metrics::Clock::now();
+
     auto ocrResult = ocr.recognizer->recognize(
-        prepareImage(ocr, job.image.get()),
+        preparedJob.image,
         job.langIndices,
         job.ocrFeatures,
         [&]
         {
+            const trace::Span span{
+                ocr.traceRecorder.get(),
+                "cancel_check",
+                static_cast<std::int64_t>(job.id)};
             return !ocr.link.getLock()->terminateJobs;
         });
 
+    const auto endTime = metrics::Clock::now();
+
+    if (ocrResult.langLoadingTime.count() > 0)
+        ocr.metrics.langLoading.record(ocrResult.langLoadingTime);
+    ocr.metrics.recognition.record(
+        endTime - startTime - ocrResult.langLoadingTime);
+
+    if (ocr.traceRecorder) {
+        // The recognizer loads language data before recognition.
+        const auto langLoadingEndTime =
+            startTime + ocrResult.langLoadingTime;
+        if (ocrResult.langLoadingTime.count() > 0)
+            ocr.traceRecorder->addSpan(
+                "lang_loading",
+                startTime,
+                langLoadingEndTime,
+                job.id);
+        ocr.traceRecorder->addSpan(
+            "recognize", langLoadingEndTime, endTime, job.id);
+    }
+
     return {std::move(ocrResult), job.timestamp};
 }
 
 
-static void threadLoop(DpsoOcr& ocr)
+static void updateProgress(Link& link)
 {
+    // The current job is the oldest one that is not yet completed.
+    // Jobs are started in the queue order, so if any job is active,
+    // the oldest incomplete job is active as well.
+    link.progress.curJob =
+        link.numPublishedResults + (link.numActiveJobs > 0 ? 1 : 0);
+}
+
+
+static void publishResult(
+    Link& link, std::size_t jobId, JobResult&& jobResult)
+{
+    link.earlyResults.emplace(jobId, std::move(jobResult));
+
     while (true) {
+        const auto iter = link.earlyResults.find(
+            link.nextResultJobId);
+        if (iter == link.earlyResults.end())
+            break;
+
+        iter->second.jobId = iter->first;
+        iter->second.publishTime = metrics::Clock::now();
+        link.results.push(std::move(iter->second));
+        link.earlyResults.erase(iter);
+
+        ++link.nextResultJobId;
+        ++link.numPublishedResults;
+    }
+}
+
+
+static void updateJobMetrics(
+    Metrics& metrics,
+    const Job& job,
+    ocr::Recognizer::Result::Status status)
+{
+    metrics.total.record(metrics::Clock::now() - job.queueTime);
+
+    switch (status) {
+    case ocr::Recognizer::Result::Status::success:
+        metrics.numSucceededJobs.add();
+        break;
+    case ocr::Recognizer::Result::Status::terminated:
+        metrics.numTerminatedJobs.add();
+        break;
+    case ocr::Recognizer::Result::Status::error:
+        metrics.numFailedJobs.add();
+        break;
+    }
+}
+
+
+static void finishJob(
+    DpsoOcr& ocr,
+    Worker& worker,
+    const Job& job,
+    JobResult&& jobResult)
+{
+    const trace::Span span{
+        ocr.traceRecorder.get(),
+        "publish",
+        static_cast<std::int64_t>(job.id)};
+
+    updateJobMetrics(ocr.metrics, job, jobResult.ocrResult.status);
+
+    const auto jobId = job.id;
+
+    {
+        const auto link = ocr.link.getLock();
+
+        publishResult(*link, jobId, std::move(jobResult));
+
+        if (--worker.numJobs == 0) {
+            ++link->numIdleWorkers;
+            // The worker can take the next job.
+            link->threadActionCondVar.notify_all();
+        }
+
+        --link->numActiveJobs;
+        if (link->jobsPending())
+            updateProgress(*link);
+        else {
+            link->progress = {};
+            link->numPublishedResults = 0;
+            link->jobsDoneCondVar.notify_all();
+        }
+    }
+
+    ocr.notifier.notify();
+}
+
+
+static ocr::ResultCache::Key getCacheKey(
+    const DpsoOcr& ocr, const Job& job)
+{
+    // Language codes rather than indices, since the indices are not
+    // stable between sessions and language data updates.
+    std::string params{ocr.engineId};
+
+    for (const auto langIdx : job.langIndices) {
+        params += '\0';
+        params += ocr.recognizer->getLangCode(langIdx);
+    }
+
+    params += '\0';
+    params += str::toStr(job.ocrFeatures);
+
+    return ocr::ResultCache::makeKey(*job.image, params);
+}
+
+
+static void prepThreadLoop(DpsoOcr& ocr, Worker& worker)
+{
+    while (true) {
+        int imgBufferIdx;
+
+        {
+            auto handoff = worker.handoff.getLock();
+            handoff.wait(
+                handoff->condVar,
+                [&]
+                {
+                    return
+                        handoff->terminate
+                        || !handoff->freeImgBufferIndices.empty();
+                });
+
+            if (handoff->terminate)
+                break;
+
+            imgBufferIdx = handoff->freeImgBufferIndices.back();
+            handoff->freeImgBufferIndices.pop_back();
+        }
+
         Job job;
 
         {
@@ -467,31 +898,141 @@ static void threadLoop(DpsoOcr& ocr)
                 [&]
                 {
                     return
-                        link->terminateThread
-                        || !link->jobQueue.empty();
+                        link->terminateThreads
+                        || (!link->jobQueue.empty()
+                            && (worker.numJobs == 0
+                                || link->numIdleWorkers == 0));
                 });
 
-            if (link->terminateThread)
+            if (link->terminateThreads)
                 break;
 
             job = std::move(link->jobQueue.front());
             link->jobQueue.pop();
 
-            link->jobActive = true;
-            ++link->progress.curJob;
+            if (worker.numJobs++ == 0
+                    && --link->numIdleWorkers == 0
+                    && !link->jobQueue.empty())
+                // Let busy workers take the remaining jobs.
+                link->threadActionCondVar.notify_all();
+
+            ++link->numActiveJobs;
+            updateProgress(*link);
         }
 
-        auto jobResult = processJob(ocr, job);
+        ocr.notifier.notify();
 
-        const auto link = ocr.link.getLock();
+        ocr.metrics.queueWait.record(
+            metrics::Clock::now() - job.queueTime);
 
-        link->results.push(std::move(jobResult));
+        std::optional<ocr::ResultCache::Key> cacheKey;
+        if (ocr.resultCache.getIsEnabled()) {
+            const auto lookupStartTime = trace::Clock::now();
 
-        link->jobActive = false;
-        if (link->jobQueue.empty()) {
-            link->progress = {};
-            link->jobsDoneCondVar.notify_one();
+            cacheKey = getCacheKey(ocr, job);
+            auto text = ocr.resultCache.find(*cacheKey);
+
+            if (ocr.traceRecorder)
+                ocr.traceRecorder->addSpan(
+                    "cache_lookup",
+                    lookupStartTime,
+                    trace::Clock::now(),
+                    job.id);
+
+            if (text) {
+                {
+                    const auto handoff = worker.handoff.getLock();
+                    handoff->freeImgBufferIndices.push_back(
+                        imgBufferIdx);
+                }
+
+                finishJob(
+                    ocr,
+                    worker,
+                    job,
+                    {
+                        {
+                            ocr::Recognizer::Result::Status::success,
+                            std::move(*text)},
+                        job.timestamp});
+                continue;
+            }
+        }
+
+        const auto prepStartTime = metrics::Clock::now();
+        const auto image = prepareImage(
+            worker,
+            *ocr.imgThreadPool,
+            ocr.dumpDebugImages,
+            ocr.traceRecorder.get(),
+            job.image.get(),
+            worker.imgBuffers[imgBufferIdx]);
+        // Free the source image early, as the job may wait in the
+        // handoff queue for a while.
+        job.image.reset();
+
+        const auto prepEndTime = metrics::Clock::now();
+        ocr.metrics.preprocessing.record(prepEndTime - prepStartTime);
+        if (ocr.traceRecorder)
+            ocr.traceRecorder->addSpan(
+                "prepare", prepStartTime, prepEndTime, job.id);
+
+        const auto handoff = worker.handoff.getLock();
+        handoff->preparedJobs.push(
+            {
+                std::move(job),
+                imgBufferIdx,
+                image,
+                cacheKey,
+                prepEndTime});
+        handoff->condVar.notify_all();
+    }
+}
+
+
+static void recognitionThreadLoop(DpsoOcr& ocr, Worker& worker)
+{
+    while (true) {
+        PreparedJob preparedJob;
+
+        {
+            auto handoff = worker.handoff.getLock();
+            handoff.wait(
+                handoff->condVar,
+                [&]
+                {
+                    return
+                        handoff->terminate
+                        || !handoff->preparedJobs.empty();
+                });
+
+            if (handoff->terminate)
+                break;
+
+            preparedJob = std::move(handoff->preparedJobs.front());
+            handoff->preparedJobs.pop();
         }
+
+        ocr.metrics.recognitionWait.record(
+            metrics::Clock::now() - preparedJob.prepEndTime);
+
+        auto jobResult = processJob(ocr, preparedJob);
+
+        {
+            const auto handoff = worker.handoff.getLock();
+            handoff->freeImgBufferIndices.push_back(
+                preparedJob.imgBufferIdx);
+            handoff->condVar.notify_all();
+        }
+
+        if (preparedJob.cacheKey
+                && jobResult.ocrResult.status
+                    == ocr::Recognizer::Result::Status::success)
+            ocr.resultCache.insert(
+                *preparedJob.cacheKey, jobResult.ocrResult.text);
+
+        finishJob(
+            ocr, worker, preparedJob.job, std::move(jobResult));
     }
 }
 
@@ -531,18 +1072,26 @@ bool dpsoOcrQueueJob(
         ocrFeatures |= ocr::ocrFeatureTextSegmentation;
 
     Job job{
+        {},
         std::move(image),
         getActiveLangIndices(*ocr),
         ocrFeatures,
-        createTimestamp()};
+        createTimestamp(),
+        metrics::Clock::now()};
 
     ++ocr->numPendingResults;
+    ocr->metrics.numQueuedJobs.add();
 
     const auto link = ocr->link.getLock();
 
+    job.id = link->nextJobId++;
+    if (ocr->traceRecorder)
+        ocr->traceRecorder->addAsyncBegin("job", job.id);
     link->jobQueue.push(std::move(job));
     ++link->progress.totalJobs;
-    link->threadActionCondVar.notify_one();
+    // Not notify_one(): the woken thread may belong to a busy worker
+    // that won't take the job.
+    link->threadActionCondVar.notify_all();
 
     return true;
 }
@@ -592,6 +1141,11 @@ bool dpsoOcrGetResult(DpsoOcr* ocr, DpsoOcrJobResult* result)
     }
 
     const auto& r = ocr->results.front();
+    ocr->metrics.resultDrain.record(
+        metrics::Clock::now() - r.publishTime);
+    if (ocr->traceRecorder)
+        ocr->traceRecorder->addAsyncEnd("job", r.jobId);
+
     *result = {
         r.ocrResult.text.c_str(),
         r.ocrResult.text.size(),
@@ -603,6 +1157,91 @@ bool dpsoOcrGetResult(DpsoOcr* ocr, DpsoOcrJobResult* result)
 }
 
 
+bool dpsoOcrSetResultCache(
+    DpsoOcr* ocr, int maxEntries, const char* filePath)
+{
+    if (!ocr) {
+        setError("ocr is null");
+        return false;
+    }
+
+    return ocr->resultCache.configure(
+        maxEntries, filePath ? filePath : "");
+}
+
+
+void dpsoOcrGetResultCacheStats(
+    const DpsoOcr* ocr, DpsoOcrResultCacheStats* stats)
+{
+    if (!ocr || !stats)
+        return;
+
+    const auto s = ocr->resultCache.getStats();
+    *stats = {s.numHits, s.numMisses};
+}
+
+
+int dpsoOcrGetNotifyFd(const DpsoOcr* ocr)
+{
+    return ocr ? ocr->notifier.getFd() : -1;
+}
+
+
+void dpsoOcrClearNotifyFd(DpsoOcr* ocr)
+{
+    if (ocr)
+        ocr->notifier.clear();
+}
+
+
+static DpsoOcrStageStats getStageStats(
+    const metrics::Histogram& histogram)
+{
+    const auto s = histogram.getSnapshot();
+    const auto usToMs = 0.001;
+
+    return {
+        s.count,
+        s.getMeanUs() * usToMs,
+        s.getQuantileUs(0.5) * usToMs,
+        s.getQuantileUs(0.9) * usToMs,
+        s.getQuantileUs(0.99) * usToMs,
+        s.maxUs * usToMs};
+}
+
+
+void dpsoOcrGetStats(const DpsoOcr* ocr, DpsoOcrStats* stats)
+{
+    if (!ocr || !stats)
+        return;
+
+    const auto& m = ocr->metrics;
+
+    *stats = {
+        m.numQueuedJobs.get(),
+        m.numSucceededJobs.get(),
+        m.numFailedJobs.get(),
+        m.numTerminatedJobs.get(),
+        getStageStats(m.queueWait),
+        getStageStats(m.preprocessing),
+        getStageStats(m.recognitionWait),
+        getStageStats(m.langLoading),
+        getStageStats(m.recognition),
+        getStageStats(m.resultDrain),
+        getStageStats(m.total)};
+}
+
+
+const char* dpsoOcrGetStatsJson(DpsoOcr* ocr)
+{
+    if (!ocr)
+        return "";
+
+    ocr->statsJson = ocr->metricsRegistry.toJson();
+    return ocr->statsJson.c_str();
+}
+
+
 void dpsoOcrTerminateJobs(DpsoOcr* ocr)
 {
     if (!ocr || ocr->numPendingResults == 0)
@@ -613,6 +1252,7 @@ void dpsoOcrTerminateJobs(DpsoOcr* ocr)
 
     {
         const auto link = ocr->link.getLock();
+        ocr->metrics.numTerminatedJobs.add(link->jobQueue.size());
         link->jobQueue = {};
         link->terminateJobs = true;
     }
@@ -621,5 +1261,7 @@ void dpsoOcrTerminateJobs(DpsoOcr* ocr)
 
     const auto link = ocr->link.getLock();
     link->results = {};
+    link->earlyResults.clear();
+    link->nextResultJobId = link->nextJobId;
     link->terminateJobs = false;
 }
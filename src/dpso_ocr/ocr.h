@@ -24,10 +24,35 @@ typedef struct DpsoOcr DpsoOcr;
  * On failure, sets an error message (dpsoGetError()) and returns
  * null. In particular, the function will fail if a language manager
  * for the same engine and data dir is active.
+ *
+ * This is the same as dpsoOcrCreateEx() with numWorkers 0.
  */
 DpsoOcr* dpsoOcrCreate(int engineIdx, const char* dataDir);
 
 
+/**
+ * Create OCR with the given number of workers.
+ *
+ * Each worker is a background thread that processes one job at a
+ * time, so up to numWorkers queued jobs are processed in parallel.
+ * Results are still returned in the queue order.
+ *
+ * Workers that recognize at the same time need separate copies of
+ * the language data. The Tesseract engine keeps up to 3 initialized
+ * instances (one for each recently used set of languages), or as
+ * many as there are workers recognizing at the same time if that's
+ * more. Each instance holds the data of its languages, which can
+ * take hundreds of megabytes with several large languages.
+ *
+ * If numWorkers is 0 or negative, the number of hardware threads is
+ * used, but no more than 4.
+ *
+ * See dpsoOcrCreate() for other arguments.
+ */
+DpsoOcr* dpsoOcrCreateEx(
+    int engineIdx, const char* dataDir, int numWorkers);
+
+
 void dpsoOcrDelete(DpsoOcr* ocr);
 
 
@@ -139,6 +164,9 @@ typedef struct DpsoOcrProgress {
     /**
      * Number of the current job (1-based).
      *
+     * When several jobs are processed in parallel, this is the oldest
+     * job that is not yet completed.
+     *
      * Can be zero if a job (if any) is not yet started.
      */
     int curJob;
@@ -203,6 +231,184 @@ bool dpsoOcrHasPendingResults(const DpsoOcr* ocr);
 bool dpsoOcrGetResult(DpsoOcr* ocr, DpsoOcrJobResult* result);
 
 
+/**
+ * Get a file descriptor to wait for OCR updates.
+ *
+ * The descriptor becomes readable when the progress changes or a new
+ * result is available, so you can watch it with poll(), epoll, or
+ * the event loop of a GUI toolkit instead of polling
+ * dpsoOcrGetProgress() and dpsoOcrGetResult() periodically. When the
+ * descriptor becomes readable, call dpsoOcrClearNotifyFd() before
+ * checking the progress and results; otherwise, a notification can
+ * be lost.
+ *
+ * Don't read from or close the descriptor yourself. It remains valid
+ * till dpsoOcrDelete().
+ *
+ * Returns -1 if the notification descriptor is not available, which
+ * is always the case on Windows. You should fall back to periodic
+ * polling in this case.
+ */
+int dpsoOcrGetNotifyFd(const DpsoOcr* ocr);
+
+
+/**
+ * Make the descriptor from dpsoOcrGetNotifyFd() non-readable.
+ */
+void dpsoOcrClearNotifyFd(DpsoOcr* ocr);
+
+
+/**
+ * Set up the result cache.
+ *
+ * The result cache allows to skip OCR of images that were already
+ * recognized, which is common when the same dialog or table is
+ * captured repeatedly. A job whose image has exactly the same pixels,
+ * active languages, and flags as a cached one completes immediately
+ * with the cached text. Only successful results are cached.
+ *
+ * The cache keeps up to maxEntries least recently used results in
+ * memory. maxEntries 0 or negative disables the cache, which is the
+ * default.
+ *
+ * If filePath is not empty, the cached results are also stored in
+ * this file so that they persist between sessions. The file is loaded
+ * by this function and written by OCR threads.
+ *
+ * The cache is cleared when the language manager modifies the data.
+ *
+ * On failure to load or create the file, sets an error message
+ * (dpsoGetError()) and returns false. The in-memory cache is still
+ * enabled in this case.
+ */
+bool dpsoOcrSetResultCache(
+    DpsoOcr* ocr, int maxEntries, const char* filePath);
+
+
+typedef struct DpsoOcrResultCacheStats {
+    /**
+     * Number of jobs completed from the cache.
+     */
+    size_t numHits;
+
+    /**
+     * Number of jobs that were not found in the cache.
+     */
+    size_t numMisses;
+} DpsoOcrResultCacheStats;
+
+
+/**
+ * Get the result cache statistics.
+ *
+ * The counters accumulate over the lifetime of the DpsoOcr, and are
+ * only updated while the cache is enabled.
+ */
+void dpsoOcrGetResultCacheStats(
+    const DpsoOcr* ocr, DpsoOcrResultCacheStats* stats);
+
+
+/**
+ * Duration statistics of an OCR stage.
+ *
+ * All durations are in milliseconds. Quantiles are estimated from a
+ * histogram with an error of up to 25%. All fields are zero if
+ * count is zero.
+ */
+typedef struct DpsoOcrStageStats {
+    /**
+     * Number of recorded durations.
+     */
+    size_t count;
+
+    double meanMs;
+    double p50Ms;
+    double p90Ms;
+    double p99Ms;
+    double maxMs;
+} DpsoOcrStageStats;
+
+
+/**
+ * OCR statistics.
+ *
+ * The statistics accumulate over the lifetime of the DpsoOcr and are
+ * always collected, including release builds.
+ */
+typedef struct DpsoOcrStats {
+    size_t numQueuedJobs;
+
+    /**
+     * Number of jobs completed successfully, including the ones
+     * completed from the result cache.
+     */
+    size_t numSucceededJobs;
+
+    size_t numFailedJobs;
+
+    /**
+     * Number of jobs terminated with dpsoOcrTerminateJobs().
+     */
+    size_t numTerminatedJobs;
+
+    /**
+     * Time from dpsoOcrQueueJob() till a worker picks up the job.
+     */
+    DpsoOcrStageStats queueWait;
+
+    /**
+     * Image preprocessing: conversion to grayscale, upscaling, and
+     * sharpening.
+     */
+    DpsoOcrStageStats preprocessing;
+
+    /**
+     * Time a preprocessed image waits for the recognition.
+     */
+    DpsoOcrStageStats recognitionWait;
+
+    /**
+     * Loading language data by the OCR engine. Only recorded when
+     * the data is not already loaded, e.g., for the first job or
+     * after changing the active languages.
+     */
+    DpsoOcrStageStats langLoading;
+
+    /**
+     * Recognition, not including langLoading.
+     */
+    DpsoOcrStageStats recognition;
+
+    /**
+     * Time from the moment a result becomes available till it is
+     * received with dpsoOcrGetResult().
+     */
+    DpsoOcrStageStats resultDrain;
+
+    /**
+     * Time from dpsoOcrQueueJob() till the result becomes available.
+     */
+    DpsoOcrStageStats total;
+} DpsoOcrStats;
+
+
+void dpsoOcrGetStats(const DpsoOcr* ocr, DpsoOcrStats* stats);
+
+
+/**
+ * Get the statistics as a JSON object.
+ *
+ * The object contains the same data as DpsoOcrStats in a more
+ * detailed form: durations are in microseconds, and every stage
+ * includes the raw histogram buckets.
+ *
+ * The returned string remains valid till the next call to
+ * dpsoOcrGetStatsJson() or dpsoOcrDelete(). Returns an empty string
+ * if ocr is null.
+ */
+const char* dpsoOcrGetStatsJson(DpsoOcr* ocr);
+
+
 /**
  * Terminate jobs.
  *
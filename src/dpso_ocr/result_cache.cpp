@@ -0,0 +1,401 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/os.h"
+#include "dpso_utils/str.h"
+#include "dpso_utils/stream/utils.h"
+
+
+// Each entry in the cache file consists of a header line with the
+// key in hex and the text size, the text, and a line feed:
+//
+//   <32 hex digits> <text size>\n<text>\n
+//
+// Entries are appended in the order of insertion, so when loading
+// the file, the last entries are the most recently used ones.
+
+
+namespace dpso::ocr {
+namespace {
+
+
+// Non-cryptographic 128-bit hash. It processes 8 bytes at a time
+// with two independent multiply-rotate lanes, which is fast enough to
+// be negligible compared to OCR even for large screenshots.
+class Hasher {
+public:
+    void update(const void* data, std::size_t size)
+    {
+        const auto* bytes = static_cast<const std::uint8_t*>(data);
+
+        std::size_t i{};
+        for (; i + 8 <= size; i += 8) {
+            std::uint64_t word;
+            std::memcpy(&word, bytes + i, 8);
+            mix(word);
+        }
+
+        if (i < size) {
+            std::uint64_t word{};
+            std::memcpy(&word, bytes + i, size - i);
+            mix(word);
+        }
+
+        totalSize += size;
+    }
+
+    ResultCache::Key getKey() const
+    {
+        return {{fmix(h1 ^ totalSize), fmix(h2 + h1)}};
+    }
+private:
+    static constexpr std::uint64_t k1{0x87c37b91114253d5};
+    static constexpr std::uint64_t k2{0x4cf5ad432745937f};
+
+    std::uint64_t h1{0x9e3779b97f4a7c15};
+    std::uint64_t h2{0xc2b2ae3d27d4eb4f};
+    std::uint64_t totalSize{};
+
+    static std::uint64_t rotl(std::uint64_t v, int n)
+    {
+        return v << n | v >> (64 - n);
+    }
+
+    // Finalization mix from MurmurHash3.
+    static std::uint64_t fmix(std::uint64_t v)
+    {
+        v ^= v >> 33;
+        v *= 0xff51afd7ed558ccd;
+        v ^= v >> 33;
+        v *= 0xc4ceb9fe1a85ec53;
+        v ^= v >> 33;
+        return v;
+    }
+
+    void mix(std::uint64_t word)
+    {
+        h1 = rotl(h1 ^ word * k1, 31) * k2;
+        h2 = rotl(h2 + word * k2, 29) * k1 + h1;
+    }
+};
+
+
+}
+
+
+ResultCache::Key ResultCache::makeKey(
+    const DpsoImg& img, std::string_view params)
+{
+    Hasher hasher;
+
+    const int header[]{
+        dpsoImgGetPxFormat(&img),
+        dpsoImgGetWidth(&img),
+        dpsoImgGetHeight(&img)};
+    hasher.update(header, sizeof(header));
+
+    hasher.update(params.data(), params.size());
+
+    // Skip the padding at the end of rows.
+    const auto rowSize =
+        dpsoImgGetWidth(&img)
+        * dpsoPxFormatGetBytesPerPx(dpsoImgGetPxFormat(&img));
+    for (int y{}; y < dpsoImgGetHeight(&img); ++y)
+        hasher.update(
+            dpsoImgGetConstData(&img) + y * dpsoImgGetPitch(&img),
+            rowSize);
+
+    return hasher.getKey();
+}
+
+
+static std::string keyToStr(const ResultCache::Key& key)
+{
+    std::string result;
+    for (const auto hash : key.hash)
+        result += str::justifyRight(
+            str::toStr(static_cast<unsigned long long>(hash), 16),
+            16,
+            '0');
+
+    return result;
+}
+
+
+static bool parseEntry(
+    std::string_view data,
+    std::size_t& pos,
+    ResultCache::Key& key,
+    std::string_view& text)
+{
+    const auto headerEnd = data.find('\n', pos);
+    if (headerEnd == data.npos)
+        return false;
+
+    const auto header = data.substr(pos, headerEnd - pos);
+    if (header.size() < 34 || header[32] != ' ')
+        return false;
+
+    for (int i{}; i < 2; ++i) {
+        const auto* hexBegin = header.data() + i * 16;
+        const auto [ptr, ec] = std::from_chars(
+            hexBegin, hexBegin + 16, key.hash[i], 16);
+        if (ec != std::errc{} || ptr != hexBegin + 16)
+            return false;
+    }
+
+    std::size_t textSize;
+    const auto* sizeEnd = header.data() + header.size();
+    const auto [ptr, ec] = std::from_chars(
+        header.data() + 33, sizeEnd, textSize);
+    if (ec != std::errc{} || ptr != sizeEnd)
+        return false;
+
+    const auto textPos = headerEnd + 1;
+    if (data.size() - textPos <= textSize
+            || data[textPos + textSize] != '\n')
+        return false;
+
+    text = data.substr(textPos, textSize);
+    pos = textPos + textSize + 1;
+    return true;
+}
+
+
+static void appendEntry(
+    std::string& data,
+    const ResultCache::Key& key,
+    std::string_view text)
+{
+    data += keyToStr(key);
+    data += ' ';
+    data += str::toStr(text.size());
+    data += '\n';
+    data += text;
+    data += '\n';
+}
+
+
+ResultCache::ResultCache()
+    : maxEntries{}
+    , stats{}
+    , numFileEntries{}
+{
+}
+
+
+ResultCache::~ResultCache() = default;
+
+
+bool ResultCache::configure(int maxEntries, std::string_view filePath)
+{
+    const std::lock_guard fileGuard{fileMutex};
+
+    this->filePath = filePath;
+    file.reset();
+    numFileEntries = 0;
+
+    std::string data;
+    if (maxEntries > 0 && !filePath.empty())
+        try {
+            data = os::loadData(this->filePath);
+        } catch (os::FileNotFoundError&) {
+        } catch (os::Error& e) {
+            setError("os::loadData(): {}", e.what());
+            return false;
+        }
+
+    {
+        const std::lock_guard guard{mutex};
+
+        this->maxEntries = std::max(0, maxEntries);
+
+        if (this->maxEntries == 0) {
+            entries.clear();
+            index.clear();
+            return true;
+        }
+
+        // Like in history, we stop at the first invalid entry, since
+        // the file is most likely truncated due to a partial write.
+        // The rewrite below will drop the rest.
+        Key key;
+        std::string_view text;
+        for (std::size_t pos{}; parseEntry(data, pos, key, text);)
+            insertEntry(key, text);
+
+        trim();
+    }
+
+    if (filePath.empty())
+        return true;
+
+    return rewriteFile();
+}
+
+
+bool ResultCache::getIsEnabled() const
+{
+    const std::lock_guard guard{mutex};
+    return maxEntries > 0;
+}
+
+
+std::optional<std::string> ResultCache::find(const Key& key)
+{
+    const std::lock_guard guard{mutex};
+
+    if (maxEntries == 0)
+        return {};
+
+    const auto iter = index.find(key);
+    if (iter == index.end()) {
+        ++stats.numMisses;
+        return {};
+    }
+
+    ++stats.numHits;
+
+    entries.splice(entries.begin(), entries, iter->second);
+    return iter->second->second;
+}
+
+
+void ResultCache::insert(const Key& key, std::string_view text)
+{
+    std::string entryData;
+    int curMaxEntries;
+
+    {
+        const std::lock_guard guard{mutex};
+
+        if (maxEntries == 0)
+            return;
+
+        if (const auto iter = index.find(key); iter != index.end()) {
+            entries.splice(entries.begin(), entries, iter->second);
+            return;
+        }
+
+        insertEntry(key, text);
+        trim();
+
+        appendEntry(entryData, key, text);
+        curMaxEntries = maxEntries;
+    }
+
+    // The file is written without holding the main mutex, so that
+    // other workers are not blocked on find() and insert() by the IO.
+    const std::lock_guard fileGuard{fileMutex};
+    appendToFile(entryData, curMaxEntries);
+}
+
+
+void ResultCache::clear()
+{
+    {
+        const std::lock_guard guard{mutex};
+
+        entries.clear();
+        index.clear();
+    }
+
+    const std::lock_guard fileGuard{fileMutex};
+    if (file)
+        rewriteFile();
+}
+
+
+ResultCache::Stats ResultCache::getStats() const
+{
+    const std::lock_guard guard{mutex};
+    return stats;
+}
+
+
+void ResultCache::insertEntry(const Key& key, std::string_view text)
+{
+    if (const auto iter = index.find(key); iter != index.end()) {
+        iter->second->second = text;
+        entries.splice(entries.begin(), entries, iter->second);
+        return;
+    }
+
+    entries.emplace_front(key, text);
+    index[key] = entries.begin();
+}
+
+
+void ResultCache::trim()
+{
+    while (entries.size() > static_cast<std::size_t>(maxEntries)) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+
+void ResultCache::appendToFile(
+    std::string_view entryData, int curMaxEntries)
+{
+    if (!file)
+        return;
+
+    try {
+        write(*file, entryData);
+    } catch (StreamError&) {
+        file.reset();
+        return;
+    }
+
+    // Each evicted entry remains in the file until the rewrite.
+    if (++numFileEntries > curMaxEntries * 2)
+        rewriteFile();
+}
+
+
+bool ResultCache::rewriteFile()
+{
+    file.reset();
+
+    // Least recently used first; see the comment at the top. An
+    // entry inserted concurrently may end up in the file twice, which
+    // is harmless since the last copy wins on loading.
+    std::string data;
+    std::size_t numEntries;
+    {
+        const std::lock_guard guard{mutex};
+
+        for (auto iter = entries.rbegin(); iter != entries.rend();
+                ++iter)
+            appendEntry(data, iter->first, iter->second);
+
+        numEntries = entries.size();
+    }
+
+    const auto fileDir = os::getDirName(filePath);
+    if (!fileDir.empty())
+        try {
+            os::makeDirs(fileDir);
+        } catch (os::Error& e) {
+            setError("os::makeDirs(): {}", e.what());
+            return false;
+        }
+
+    try {
+        os::saveData(filePath, data);
+        file.emplace(filePath, FileStream::Mode::append);
+    } catch (os::Error& e) {
+        setError("Can't rewrite {}: {}", filePath, e.what());
+        return false;
+    }
+
+    numFileEntries = numEntries;
+    return true;
+}
+
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "dpso_img/img.h"
+#include "dpso_utils/stream/file_stream.h"
+
+
+namespace dpso::ocr {
+
+
+// Cache of OCR results, keyed by a hash of the image pixels and the
+// OCR parameters.
+//
+// The cache holds up to maxEntries least recently used results in
+// memory. If a file is set, the results are also appended to it to
+// persist between sessions; the file is rewritten when it accumulates
+// too many evicted entries.
+//
+// All methods are thread-safe.
+class ResultCache {
+public:
+    struct Key {
+        std::uint64_t hash[2];
+
+        bool operator==(const Key& other) const
+        {
+            return hash[0] == other.hash[0]
+                && hash[1] == other.hash[1];
+        }
+    };
+
+    struct Stats {
+        std::size_t numHits;
+        std::size_t numMisses;
+    };
+
+    // params should contain everything besides the image that
+    // affects the result, like the language codes.
+    static Key makeKey(const DpsoImg& img, std::string_view params);
+
+    ResultCache();
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    ResultCache(ResultCache&&) = delete;
+    ResultCache& operator=(ResultCache&&) = delete;
+
+    // maxEntries 0 disables the cache. filePath can be empty.
+    //
+    // On failure to load or create the file, sets an error message
+    // (dpsoGetError()) and returns false; the cache will still work
+    // without the file in this case.
+    bool configure(int maxEntries, std::string_view filePath);
+
+    bool getIsEnabled() const;
+
+    std::optional<std::string> find(const Key& key);
+    void insert(const Key& key, std::string_view text);
+
+    // Remove all entries, including the ones in the file.
+    void clear();
+
+    Stats getStats() const;
+private:
+    struct KeyHasher {
+        std::size_t operator()(const Key& key) const
+        {
+            return key.hash[0];
+        }
+    };
+
+    using EntryList = std::list<std::pair<Key, std::string>>;
+
+    // Protects the in-memory entries and the stats.
+    mutable std::mutex mutex;
+
+    int maxEntries;
+    // Most recently used first.
+    EntryList entries;
+    std::unordered_map<Key, EntryList::iterator, KeyHasher> index;
+
+    Stats stats;
+
+    // Protects the file-related members below. When both mutexes are
+    // needed, fileMutex should be locked first.
+    std::mutex fileMutex;
+
+    std::string filePath;
+    std::optional<FileStream> file;
+    // Number of entries in the file, including evicted ones.
+    int numFileEntries;
+
+    void insertEntry(const Key& key, std::string_view text);
+    void trim();
+
+    // The file methods should be called with fileMutex locked and
+    // mutex unlocked.
+    void appendToFile(std::string_view entryData, int curMaxEntries);
+    bool rewriteFile();
+};
+
+
+}
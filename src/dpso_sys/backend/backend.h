@@ -14,6 +14,7 @@ struct Rect;
 namespace backend {
 
 
+class DamageTracker;
 class KeyManager;
 class Selection;
 class Screenshot;
@@ -30,9 +31,21 @@ public:
     virtual KeyManager& getKeyManager() = 0;
     virtual Selection& getSelection() = 0;
 
-    // The method will clamp the rect to screen. Throws
-    // ScreenshotError.
-    virtual img::ImgUPtr takeScreenshot(const Rect& rect) = 0;
+    // The method will clamp the rect to screen. The result has the
+    // given pixel format. Throws ScreenshotError.
+    virtual img::ImgUPtr takeScreenshot(
+        const Rect& rect, DpsoPxFormat pxFormat) = 0;
+
+    // Returns null if the backend can't track changes of the screen
+    // contents, in which case the caller should treat the rect as
+    // always changed. The tracker should not outlive the backend.
+    virtual std::unique_ptr<DamageTracker> createDamageTracker(
+        const Rect& rect) = 0;
+
+    // Returns a file descriptor that becomes readable when update()
+    // has new events to process, or -1 if there is no such
+    // descriptor.
+    virtual int getEventFd() const = 0;
 
     virtual void update() = 0;
 };
@@ -0,0 +1,21 @@
+#pragma once
+
+
+namespace dpso::backend {
+
+
+// Tracks changes of the screen contents within a rect. Changes are
+// detected by Backend::update().
+class DamageTracker {
+public:
+    virtual ~DamageTracker() = default;
+
+    // Returns true if the contents of the rect may have changed
+    // since the tracker was created or clear() was called.
+    virtual bool getIsDamaged() const = 0;
+
+    virtual void clear() = 0;
+};
+
+
+}
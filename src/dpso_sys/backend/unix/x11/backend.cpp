@@ -4,6 +4,10 @@
 
 #include "backend/backend.h"
 #include "backend/backend_error.h"
+#include "backend/damage_tracker.h"
+#if DPSO_X11_DAMAGE
+#include "backend/unix/x11/damage_manager.h"
+#endif
 #include "backend/unix/x11/key_manager.h"
 #include "backend/unix/x11/screenshot.h"
 #include "backend/unix/x11/selection.h"
@@ -31,16 +35,27 @@ public:
 
     KeyManager& getKeyManager() override;
     Selection& getSelection() override;
-    img::ImgUPtr takeScreenshot(const Rect& rect) override;
+    img::ImgUPtr takeScreenshot(
+        const Rect& rect, DpsoPxFormat pxFormat) override;
 
+    std::unique_ptr<DamageTracker> createDamageTracker(
+        const Rect& rect) override;
+
+    int getEventFd() const override;
     void update() override;
 private:
     DisplayUPtr display;
 
     KeyManager keyManager;
     Selection selection;
+    Screenshoter screenshoter;
+#if DPSO_X11_DAMAGE
+    DamageManager damageManager;
 
+    BackendComponent* components[3];
+#else
     BackendComponent* components[2];
+#endif
 };
 
 
@@ -48,7 +63,13 @@ Backend::Backend()
     : display{openDisplay()}
     , keyManager{display.get()}
     , selection{display.get()}
+    , screenshoter{display.get()}
+#if DPSO_X11_DAMAGE
+    , damageManager{display.get()}
+    , components{&keyManager, &selection, &damageManager}
+#else
     , components{&keyManager, &selection}
+#endif
 {
 }
 
@@ -65,9 +86,30 @@ Selection& Backend::getSelection()
 }
 
 
-img::ImgUPtr Backend::takeScreenshot(const Rect& rect)
+img::ImgUPtr Backend::takeScreenshot(
+    const Rect& rect, DpsoPxFormat pxFormat)
+{
+    return screenshoter.takeScreenshot(rect, pxFormat);
+}
+
+
+// Without the X Damage extension, the screen watch falls back to
+// comparing screenshots, like on Windows.
+std::unique_ptr<DamageTracker> Backend::createDamageTracker(
+    const Rect& rect)
+{
+#if DPSO_X11_DAMAGE
+    return damageManager.createTracker(rect);
+#else
+    (void)rect;
+    return {};
+#endif
+}
+
+
+int Backend::getEventFd() const
 {
-    return x11::takeScreenshot(display.get(), rect);
+    return XConnectionNumber(display.get());
 }
 
 
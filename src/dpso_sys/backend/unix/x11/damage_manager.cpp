@@ -0,0 +1,149 @@
+#include "backend/unix/x11/damage_manager.h"
+
+#include <algorithm>
+
+#include <X11/extensions/Xdamage.h>
+
+#include "dpso_utils/geometry.h"
+
+
+namespace dpso::backend::x11 {
+
+
+class DamageManager::Tracker : public backend::DamageTracker {
+public:
+    Tracker(DamageManager& manager, const Rect& rect);
+    ~Tracker();
+
+    Tracker(const Tracker&) = delete;
+    Tracker& operator=(const Tracker&) = delete;
+
+    Tracker(Tracker&&) = delete;
+    Tracker& operator=(Tracker&&) = delete;
+
+    bool getIsDamaged() const override;
+    void clear() override;
+
+    Damage getDamage() const;
+    void handleDamage(const Rect& area);
+private:
+    DamageManager& manager;
+    Rect rect;
+    Damage damage;
+    bool isDamaged{};
+};
+
+
+DamageManager::Tracker::Tracker(
+        DamageManager& manager, const Rect& rect)
+    : manager{manager}
+    , rect{rect}
+    // The Damage object accumulates the damaged region of the whole
+    // root window (including its children) on the server side, and
+    // only sends events for the areas that are added to the region.
+    // Repeated damage of the same area, like a video playing outside
+    // our rect, therefore doesn't wake us up till clear() empties the
+    // region. An area that intersects our rect was reported at the
+    // time it was added, so we can't miss changes in the rect.
+    , damage{
+        XDamageCreate(
+            manager.display,
+            XDefaultRootWindow(manager.display),
+            XDamageReportDeltaRectangles)}
+{
+    // Hosts that wait for events on the connection descriptor
+    // (dpsoSysGetEventFd()) may not call update() for a long time.
+    XFlush(manager.display);
+
+    manager.trackers.push_back(this);
+}
+
+
+DamageManager::Tracker::~Tracker()
+{
+    XDamageDestroy(manager.display, damage);
+    XFlush(manager.display);
+
+    auto& trackers = manager.trackers;
+    trackers.erase(
+        std::find(trackers.begin(), trackers.end(), this));
+}
+
+
+bool DamageManager::Tracker::getIsDamaged() const
+{
+    return isDamaged;
+}
+
+
+void DamageManager::Tracker::clear()
+{
+    isDamaged = false;
+    XDamageSubtract(manager.display, damage, None, None);
+}
+
+
+Damage DamageManager::Tracker::getDamage() const
+{
+    return damage;
+}
+
+
+void DamageManager::Tracker::handleDamage(const Rect& area)
+{
+    if (!isEmpty(getIntersection(rect, area)))
+        isDamaged = true;
+}
+
+
+DamageManager::DamageManager(Display* display)
+    : display{display}
+{
+    int errorBase;
+    if (!XDamageQueryExtension(display, &eventBase, &errorBase))
+        return;
+
+    // The server needs to know the version supported by the client
+    // before any other requests.
+    int major;
+    int minor;
+    isAvailable = XDamageQueryVersion(display, &major, &minor);
+}
+
+
+DamageManager::~DamageManager() = default;
+
+
+std::unique_ptr<backend::DamageTracker> DamageManager::createTracker(
+    const Rect& rect)
+{
+    if (!isAvailable)
+        return {};
+
+    return std::make_unique<Tracker>(*this, rect);
+}
+
+
+bool DamageManager::handleEvent(const XEvent& event)
+{
+    if (!isAvailable || event.type != eventBase + XDamageNotify)
+        return false;
+
+    const auto& damageEvent =
+        reinterpret_cast<const XDamageNotifyEvent&>(event);
+
+    const Rect area{
+        damageEvent.area.x,
+        damageEvent.area.y,
+        damageEvent.area.width,
+        damageEvent.area.height};
+
+    for (auto* tracker : trackers)
+        if (tracker->getDamage() == damageEvent.damage)
+            tracker->handleDamage(area);
+
+    return true;
+}
+
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <X11/Xlib.h>
+
+#include "backend/damage_tracker.h"
+#include "backend/unix/x11/backend_component.h"
+
+
+namespace dpso {
+
+
+struct Rect;
+
+
+namespace backend::x11 {
+
+
+// Creates damage trackers based on the X Damage extension and
+// routes damage events to them.
+class DamageManager : public BackendComponent {
+public:
+    explicit DamageManager(Display* display);
+    ~DamageManager();
+
+    DamageManager(const DamageManager&) = delete;
+    DamageManager& operator=(const DamageManager&) = delete;
+
+    DamageManager(DamageManager&&) = delete;
+    DamageManager& operator=(DamageManager&&) = delete;
+
+    // Returns null if the X Damage extension is not available.
+    std::unique_ptr<backend::DamageTracker> createTracker(
+        const Rect& rect);
+
+    bool handleEvent(const XEvent& event) override;
+private:
+    class Tracker;
+
+    Display* display;
+    bool isAvailable{};
+    int eventBase{};
+    std::vector<Tracker*> trackers;
+};
+
+
+}
+}
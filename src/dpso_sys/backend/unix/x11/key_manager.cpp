@@ -170,6 +170,11 @@ void KeyManager::changeGrab(
                 x11Mods | ignoredX11Mods,
                 XDefaultRootWindow(display));
     }
+
+    // Hosts that wait for events on the connection descriptor
+    // (dpsoSysGetEventFd()) may not call update() for a long time,
+    // so don't leave the grabs in the output buffer.
+    XFlush(display);
 }
 
 
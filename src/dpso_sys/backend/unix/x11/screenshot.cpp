@@ -1,6 +1,7 @@
 #include "backend/unix/x11/screenshot.h"
 
-#include <X11/Xutil.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
 
 #include "dpso_img/ops.h"
 
@@ -21,12 +22,20 @@ namespace {
 using XPixel = unsigned long;
 
 
-template<ByteOrder byteOrder, typename CCTransformer>
-void getRgbData(
+// Mask/shift extraction of color components is fused with writing
+// the destination pixel, so that conversion to any format (most
+// importantly, grayscale for OCR) is a single pass over the image.
+template<
+    ByteOrder byteOrder,
+    typename CCTransformer,
+    typename PxWriter>
+void getImageData(
     const XImage& image,
     std::uint8_t* buf,
     int pitch,
-    CCTransformer ccTransformer)
+    int dstBytesPerPx,
+    CCTransformer ccTransformer,
+    PxWriter pxWriter)
 {
     const auto bytesPerPx = 4;
 
@@ -45,34 +54,75 @@ void getRgbData(
             load<byteOrder, bytesPerPx>(px, srcRow);
             srcRow += bytesPerPx;
 
-            *dstRow++ = ccTransformer(
-                (px & image.red_mask) >> rShift);
-            *dstRow++ = ccTransformer(
-                (px & image.green_mask) >> gShift);
-            *dstRow++ = ccTransformer(
-                (px & image.blue_mask) >> bShift);
+            pxWriter(
+                dstRow,
+                ccTransformer((px & image.red_mask) >> rShift),
+                ccTransformer((px & image.green_mask) >> gShift),
+                ccTransformer((px & image.blue_mask) >> bShift));
+            dstRow += dstBytesPerPx;
         }
     }
 }
 
 
-template<typename CCTransformer>
-void getRgbData(
+template<typename CCTransformer, typename PxWriter>
+void getImageData(
     const XImage& image,
     std::uint8_t* buf,
     int pitch,
-    CCTransformer ccTransformer)
+    int dstBytesPerPx,
+    CCTransformer ccTransformer,
+    PxWriter pxWriter)
 {
     if (image.byte_order == LSBFirst)
-        getRgbData<ByteOrder::little>(
-            image, buf, pitch, ccTransformer);
+        getImageData<ByteOrder::little>(
+            image, buf, pitch, dstBytesPerPx,
+            ccTransformer, pxWriter);
     else
-        getRgbData<ByteOrder::big>(
-            image, buf, pitch, ccTransformer);
+        getImageData<ByteOrder::big>(
+            image, buf, pitch, dstBytesPerPx,
+            ccTransformer, pxWriter);
+}
+
+
+template<typename CCTransformer>
+void getImageData(
+    const XImage& image,
+    std::uint8_t* buf,
+    int pitch,
+    DpsoPxFormat pxFormat,
+    CCTransformer ccTransformer)
+{
+    if (pxFormat == DpsoPxFormatGrayscale) {
+        getImageData(
+            image, buf, pitch, 1, ccTransformer,
+            [](std::uint8_t* px, XPixel r, XPixel g, XPixel b)
+            {
+                *px = img::rgbToGray(r, g, b);
+            });
+        return;
+    }
+
+    const auto offsets = img::getChannelOffsets(pxFormat);
+    getImageData(
+        image, buf, pitch, dpsoPxFormatGetBytesPerPx(pxFormat),
+        ccTransformer,
+        [=](std::uint8_t* px, XPixel r, XPixel g, XPixel b)
+        {
+            px[offsets.r] = r;
+            px[offsets.g] = g;
+            px[offsets.b] = b;
+            if (offsets.a != -1)
+                px[offsets.a] = 255;
+        });
 }
 
 
-void getRgbData(const XImage& image, std::uint8_t* buf, int pitch)
+void getImageData(
+    const XImage& image,
+    std::uint8_t* buf,
+    int pitch,
+    DpsoPxFormat pxFormat)
 {
     if (image.depth != 24  // XRGB 8-8-8-8
             && image.depth != 30  // XRGB 2-10-10-10
@@ -89,17 +139,68 @@ void getRgbData(const XImage& image, std::uint8_t* buf, int pitch)
 
     if (image.depth == 30)
         // XRGB 2-10-10-10
-        getRgbData(image, buf, pitch, [](XPixel c){ return c / 4; });
+        getImageData(
+            image, buf, pitch, pxFormat,
+            [](XPixel c){ return c / 4; });
     else
         // 24 (XRGB 8-8-8-8) and 32 (ARGB 8-8-8-8)
-        getRgbData(image, buf, pitch, [](XPixel c){ return c; });
+        getImageData(
+            image, buf, pitch, pxFormat,
+            [](XPixel c){ return c; });
 }
 
 
-}
+// Catches X errors while alive. MIT-SHM requests can fail even if
+// the extension is reported as available, e.g. when the X server
+// is on a different machine, and Xlib reports such errors
+// asynchronously via the error handler, which by default
+// terminates the process. The handler is global, so nesting traps
+// is not allowed.
+class XErrorTrap {
+public:
+    explicit XErrorTrap(Display* display)
+        : display{display}
+    {
+        XSync(display, False);
+        hasError = false;
+        oldHandler = XSetErrorHandler(handleError);
+    }
 
+    ~XErrorTrap()
+    {
+        XSync(display, False);
+        XSetErrorHandler(oldHandler);
+    }
 
-img::ImgUPtr takeScreenshot(Display* display, const Rect& rect)
+    XErrorTrap(const XErrorTrap&) = delete;
+    XErrorTrap& operator=(const XErrorTrap&) = delete;
+
+    // Waits for the server to process all requests sent so far.
+    bool getHasError() const
+    {
+        XSync(display, False);
+        return hasError;
+    }
+private:
+    using Handler = int (*)(Display*, XErrorEvent*);
+
+    static bool hasError;
+
+    Display* display;
+    Handler oldHandler;
+
+    static int handleError(Display*, XErrorEvent*)
+    {
+        hasError = true;
+        return 0;
+    }
+};
+
+
+bool XErrorTrap::hasError;
+
+
+Rect getCaptureRect(Display* display, const Rect& rect)
 {
     auto* screen = XDefaultScreenOfDisplay(display);
     const Rect screenRect{
@@ -108,33 +209,177 @@ img::ImgUPtr takeScreenshot(Display* display, const Rect& rect)
     if (isEmpty(captureRect))
         throw ScreenshotError{"Rect is outside screen bounds"};
 
-    ImageUPtr image{XGetImage(
-        display,
-        XDefaultRootWindow(display),
-        captureRect.x,
-        captureRect.y,
-        captureRect.w,
-        captureRect.h,
-        AllPlanes,
-        ZPixmap)};
+    return captureRect;
+}
 
-    if (!image)
-        throw ScreenshotError{"XGetImage() failed"};
+
+}
+
+
+Screenshoter::Screenshoter(Display* display)
+    : display{display}
+    , shmIsAvailable{XShmQueryExtension(display) == True}
+{
+    shmInfo.shmid = -1;
+}
+
+
+Screenshoter::~Screenshoter()
+{
+    releaseShm();
+}
+
+
+img::ImgUPtr Screenshoter::takeScreenshot(
+    const Rect& rect, DpsoPxFormat pxFormat)
+{
+    const auto captureRect = getCaptureRect(display, rect);
+
+    ImageUPtr image{getShmImage(captureRect)};
+    if (!image) {
+        image.reset(XGetImage(
+            display,
+            XDefaultRootWindow(display),
+            captureRect.x,
+            captureRect.y,
+            captureRect.w,
+            captureRect.h,
+            AllPlanes,
+            ZPixmap));
+
+        if (!image)
+            throw ScreenshotError{"XGetImage() failed"};
+    }
 
     img::ImgUPtr result{
         dpsoImgCreate(
-            DpsoPxFormatRgb, image->width, image->height, 0)};
+            pxFormat, image->width, image->height, 0)};
     if (!result)
         throw ScreenshotError{str::format(
             "dpsoImgCreate(): {}", dpsoGetError())};
 
-    getRgbData(
+    getImageData(
         *image,
         dpsoImgGetData(result.get()),
-        dpsoImgGetPitch(result.get()));
+        dpsoImgGetPitch(result.get()),
+        pxFormat);
 
     return result;
 }
 
 
+// Returns null if MIT-SHM cannot be used, in which case the caller
+// should fall back to XGetImage(). The image data points to the
+// shared segment, so it's only valid until the next call. Note that
+// XDestroyImage() doesn't free the data of MIT-SHM images.
+XImage* Screenshoter::getShmImage(const Rect& rect)
+{
+    if (!shmIsAvailable)
+        return nullptr;
+
+    auto* screen = XDefaultScreenOfDisplay(display);
+
+    ImageUPtr image{XShmCreateImage(
+        display,
+        XDefaultVisualOfScreen(screen),
+        XDefaultDepthOfScreen(screen),
+        ZPixmap,
+        nullptr,
+        &shmInfo,
+        rect.w,
+        rect.h)};
+    if (!image)
+        return nullptr;
+
+    const auto size =
+        static_cast<std::size_t>(image->bytes_per_line)
+        * image->height;
+    if (!reserveShm(size)) {
+        shmIsAvailable = false;
+        return nullptr;
+    }
+
+    image->data = shmInfo.shmaddr;
+
+    const XErrorTrap errorTrap{display};
+    if (!XShmGetImage(
+                display,
+                XDefaultRootWindow(display),
+                image.get(),
+                rect.x,
+                rect.y,
+                AllPlanes)
+            || errorTrap.getHasError()) {
+        // Don't try again: the reason is unlikely to go away, and
+        // every failure costs a few round trips.
+        releaseShm();
+        shmIsAvailable = false;
+        return nullptr;
+    }
+
+    return image.release();
+}
+
+
+bool Screenshoter::reserveShm(std::size_t size)
+{
+    if (size <= shmSize)
+        return true;
+
+    releaseShm();
+
+    shmInfo.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (shmInfo.shmid == -1)
+        return false;
+
+    auto* addr = shmat(shmInfo.shmid, nullptr, 0);
+    if (addr == reinterpret_cast<void*>(-1)) {
+        shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+        shmInfo.shmid = -1;
+        return false;
+    }
+
+    shmInfo.shmaddr = static_cast<char*>(addr);
+    // This is about the server's access: it writes to the segment.
+    shmInfo.readOnly = False;
+
+    bool attached{};
+    {
+        const XErrorTrap errorTrap{display};
+        attached = XShmAttach(display, &shmInfo)
+            && !errorTrap.getHasError();
+    }
+
+    // Now that both we and the server are attached (or the server
+    // failed to attach), mark the segment for deletion so that it
+    // doesn't outlive the process if it crashes.
+    shmctl(shmInfo.shmid, IPC_RMID, nullptr);
+
+    if (!attached) {
+        shmdt(shmInfo.shmaddr);
+        shmInfo.shmaddr = nullptr;
+        shmInfo.shmid = -1;
+        return false;
+    }
+
+    shmSize = size;
+    return true;
+}
+
+
+void Screenshoter::releaseShm()
+{
+    if (!shmInfo.shmaddr)
+        return;
+
+    XShmDetach(display, &shmInfo);
+    XSync(display, False);
+
+    shmdt(shmInfo.shmaddr);
+    shmInfo.shmaddr = nullptr;
+    shmInfo.shmid = -1;
+    shmSize = 0;
+}
+
+
 }
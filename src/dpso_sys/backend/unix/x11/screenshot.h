@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
+
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
 #include "dpso_img/img.h"
 
@@ -14,7 +18,34 @@ struct Rect;
 namespace backend::x11 {
 
 
-img::ImgUPtr takeScreenshot(Display* display, const Rect& rect);
+// Takes screenshots via the MIT-SHM extension if possible, falling
+// back to XGetImage(). The shared memory segment is reused across
+// screenshots and only grows, so that capturing the same region
+// again requires neither allocations nor extra IPC.
+class Screenshoter {
+public:
+    explicit Screenshoter(Display* display);
+    ~Screenshoter();
+
+    Screenshoter(const Screenshoter&) = delete;
+    Screenshoter& operator=(const Screenshoter&) = delete;
+
+    Screenshoter(Screenshoter&&) = delete;
+    Screenshoter& operator=(Screenshoter&&) = delete;
+
+    img::ImgUPtr takeScreenshot(
+        const Rect& rect, DpsoPxFormat pxFormat);
+private:
+    Display* display;
+    bool shmIsAvailable;
+    // shmInfo.shmaddr is null if no segment is attached.
+    XShmSegmentInfo shmInfo{};
+    std::size_t shmSize{};
+
+    XImage* getShmImage(const Rect& rect);
+    bool reserveShm(std::size_t size);
+    void releaseShm();
+};
 
 
 }
@@ -7,6 +7,7 @@
 
 #include "backend/backend_error.h"
 #include "backend/backend.h"
+#include "backend/damage_tracker.h"
 #include "backend/windows/execution_layer/backend_executor.h"
 #include "backend/windows/key_manager.h"
 #include "backend/windows/screenshot.h"
@@ -24,8 +25,13 @@ public:
 
     KeyManager& getKeyManager() override;
     Selection& getSelection() override;
-    img::ImgUPtr takeScreenshot(const Rect& rect) override;
+    img::ImgUPtr takeScreenshot(
+        const Rect& rect, DpsoPxFormat pxFormat) override;
 
+    std::unique_ptr<DamageTracker> createDamageTracker(
+        const Rect& rect) override;
+
+    int getEventFd() const override;
     void update() override;
 private:
     HINSTANCE instance;
@@ -71,9 +77,24 @@ Selection& Backend::getSelection()
 }
 
 
-img::ImgUPtr Backend::takeScreenshot(const Rect& rect)
+img::ImgUPtr Backend::takeScreenshot(
+    const Rect& rect, DpsoPxFormat pxFormat)
+{
+    return windows::takeScreenshot(rect, pxFormat);
+}
+
+
+// There is no efficient way to track screen changes with GDI.
+std::unique_ptr<DamageTracker> Backend::createDamageTracker(
+    const Rect& /*rect*/)
+{
+    return {};
+}
+
+
+int Backend::getEventFd() const
 {
-    return windows::takeScreenshot(rect);
+    return -1;
 }
 
 
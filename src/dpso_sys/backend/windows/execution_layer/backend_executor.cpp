@@ -1,5 +1,6 @@
 #include "backend/windows/execution_layer/backend_executor.h"
 
+#include "backend/damage_tracker.h"
 #include "backend/windows/execution_layer/action_executor.h"
 #include "backend/windows/execution_layer/key_manager_executor.h"
 #include "backend/windows/execution_layer/selection_executor.h"
@@ -16,8 +17,13 @@ public:
 
     KeyManager& getKeyManager() override;
     Selection& getSelection() override;
-    img::ImgUPtr takeScreenshot(const Rect& rect) override;
+    img::ImgUPtr takeScreenshot(
+        const Rect& rect, DpsoPxFormat pxFormat) override;
 
+    std::unique_ptr<DamageTracker> createDamageTracker(
+        const Rect& rect) override;
+
+    int getEventFd() const override;
     void update() override;
 private:
     ActionExecutor actionExecutor;
@@ -58,14 +64,30 @@ Selection& BackendExecutor::getSelection()
 }
 
 
-img::ImgUPtr BackendExecutor::takeScreenshot(const Rect& rect)
+img::ImgUPtr BackendExecutor::takeScreenshot(
+    const Rect& rect, DpsoPxFormat pxFormat)
 {
     return execute(actionExecutor, [&]{
-        return backend->takeScreenshot(rect);
+        return backend->takeScreenshot(rect, pxFormat);
     });
 }
 
 
+// The Windows backend doesn't support damage tracking, so there's
+// nothing to forward to the action executor thread.
+std::unique_ptr<DamageTracker> BackendExecutor::createDamageTracker(
+    const Rect& /*rect*/)
+{
+    return {};
+}
+
+
+int BackendExecutor::getEventFd() const
+{
+    return -1;
+}
+
+
 void BackendExecutor::update()
 {
     execute(actionExecutor, [&]{ backend->update(); });
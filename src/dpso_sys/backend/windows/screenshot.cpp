@@ -3,6 +3,8 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
+#include "dpso_img/ops.h"
+
 #include "dpso_utils/error_get.h"
 #include "dpso_utils/geometry.h"
 #include "dpso_utils/windows/error.h"
@@ -14,7 +16,7 @@
 namespace dpso::backend::windows {
 
 
-img::ImgUPtr takeScreenshot(const Rect& rect)
+img::ImgUPtr takeScreenshot(const Rect& rect, DpsoPxFormat pxFormat)
 {
     const Rect virtualScreenRect{
         GetSystemMetrics(SM_XVIRTUALSCREEN),
@@ -90,7 +92,28 @@ img::ImgUPtr takeScreenshot(const Rect& rect)
             "GetDIBits(): "
             + dpso::windows::getErrorMessage(GetLastError()));
 
-    return result;
+    // GDI can only give us BGRA, so other formats need an extra
+    // pass.
+    if (pxFormat == DpsoPxFormatBgra)
+        return result;
+
+    img::ImgUPtr converted{
+        dpsoImgCreate(pxFormat, captureRect.w, captureRect.h, 0)};
+    if (!converted)
+        throw ScreenshotError(
+            std::string{"dpsoImgCreate(): "} + dpsoGetError());
+
+    img::convertPxFormat(
+        dpsoImgGetConstData(result.get()),
+        dpsoImgGetPitch(result.get()),
+        DpsoPxFormatBgra,
+        dpsoImgGetData(converted.get()),
+        dpsoImgGetPitch(converted.get()),
+        pxFormat,
+        captureRect.w,
+        captureRect.h);
+
+    return converted;
 }
 
 
@@ -12,7 +12,7 @@ struct Rect;
 namespace backend::windows {
 
 
-img::ImgUPtr takeScreenshot(const Rect& rect);
+img::ImgUPtr takeScreenshot(const Rect& rect, DpsoPxFormat pxFormat);
 
 
 }
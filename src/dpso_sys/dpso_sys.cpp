@@ -32,6 +32,12 @@ void dpsoSysUpdate(DpsoSys* sys)
 }
 
 
+int dpsoSysGetEventFd(const DpsoSys* sys)
+{
+    return sys ? sys->backend->getEventFd() : -1;
+}
+
+
 DpsoKeyManager* dpsoSysGetKeyManager(DpsoSys* sys)
 {
     return sys ? &sys->keyManager : nullptr;
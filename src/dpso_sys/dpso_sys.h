@@ -2,6 +2,7 @@
 
 #include "dpso_sys_fwd.h"
 #include "key_manager.h"
+#include "screen_watch.h"
 #include "screenshot.h"
 #include "selection.h"
 
@@ -29,11 +30,40 @@ void dpsoSysDelete(DpsoSys* sys);
  * The function process system events, like mouse motion, key press,
  * etc., for hotkey handling (key_manager.h) and interactive selection
  * (selection.h). Call this function at a frequency close to the
- * monitor refresh rate, which is usually 60 times per second.
+ * monitor refresh rate, which is usually 60 times per second, or
+ * when the descriptor from dpsoSysGetEventFd() becomes readable.
  */
 void dpsoSysUpdate(DpsoSys* sys);
 
 
+/**
+ * Get a file descriptor to wait for system events.
+ *
+ * The descriptor becomes readable when dpsoSysUpdate() has new
+ * events to process, so you can watch it with poll(), epoll, or the
+ * event loop of a GUI toolkit and call dpsoSysUpdate() only when
+ * needed, rather than periodically. On X11, this is the descriptor
+ * of the connection to the X server.
+ *
+ * The periodic calls are still needed while the selection is
+ * enabled, since it follows the mouse cursor by polling.
+ *
+ * Functions that wait for a reply from the system, like
+ * dpsoTakeScreenshot(), can read new events into an internal queue,
+ * in which case the descriptor doesn't become readable for them.
+ * Call dpsoSysUpdate() after such functions, before waiting on the
+ * descriptor again.
+ *
+ * Don't read from or close the descriptor yourself. It remains valid
+ * till dpsoSysDelete().
+ *
+ * Returns -1 if the descriptor is not available, which is always
+ * the case on Windows. You should fall back to periodic calls of
+ * dpsoSysUpdate() in this case.
+ */
+int dpsoSysGetEventFd(const DpsoSys* sys);
+
+
 DpsoKeyManager* dpsoSysGetKeyManager(DpsoSys* sys);
 DpsoSelection* dpsoSysGetSelection(DpsoSys* sys);
 
@@ -0,0 +1,180 @@
+#include "screen_watch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/geometry.h"
+
+#include "backend/backend.h"
+#include "backend/damage_tracker.h"
+#include "backend/screenshot_error.h"
+#include "dpso_sys_p.h"
+
+
+using Clock = std::chrono::steady_clock;
+
+
+struct DpsoScreenWatch {
+    dpso::backend::Backend* backend;
+    dpso::Rect rect;
+    Clock::duration minInterval;
+    // Null if the backend can't track damage.
+    std::unique_ptr<dpso::backend::DamageTracker> damageTracker;
+
+    bool hasCapture;
+    // Also updated on failed captures, so that they are retried at
+    // the minimum interval rather than in a busy loop.
+    Clock::time_point lastCaptureTime;
+
+    // The last screenshot, with tightly packed rows.
+    DpsoPxFormat lastPxFormat;
+    int lastW;
+    int lastH;
+    std::vector<std::uint8_t> lastPixels;
+};
+
+
+DpsoScreenWatch* dpsoScreenWatchCreate(
+    DpsoSys* sys, const DpsoRect* rect, int minIntervalMs)
+{
+    if (!sys) {
+        dpso::setError("sys is null");
+        return {};
+    }
+
+    if (!rect) {
+        dpso::setError("rect is null");
+        return {};
+    }
+
+    if (minIntervalMs < 0) {
+        dpso::setError("minIntervalMs is negative");
+        return {};
+    }
+
+    auto* watch = new DpsoScreenWatch{};
+    watch->backend = sys->backend.get();
+    watch->rect = dpso::Rect{*rect};
+    watch->minInterval = std::chrono::milliseconds{minIntervalMs};
+    watch->damageTracker =
+        sys->backend->createDamageTracker(watch->rect);
+
+    return watch;
+}
+
+
+void dpsoScreenWatchDelete(DpsoScreenWatch* watch)
+{
+    delete watch;
+}
+
+
+static bool isChangePending(const DpsoScreenWatch& watch)
+{
+    return !watch.hasCapture
+        || !watch.damageTracker
+        || watch.damageTracker->getIsDamaged();
+}
+
+
+int dpsoScreenWatchGetTimeoutMs(const DpsoScreenWatch* watch)
+{
+    if (!watch || !isChangePending(*watch))
+        return -1;
+
+    const auto elapsed = Clock::now() - watch->lastCaptureTime;
+    if (elapsed >= watch->minInterval)
+        return 0;
+
+    // Round up so that the host doesn't wake up a bit too early and
+    // then spin with a zero timeout.
+    using namespace std::chrono;
+    return ceil<milliseconds>(watch->minInterval - elapsed).count();
+}
+
+
+// Returns true if the pixels differ from the last screenshot, which
+// is then replaced with the given one.
+static bool updateLastPixels(
+    DpsoScreenWatch& watch, const DpsoImg* img)
+{
+    const auto pxFormat = dpsoImgGetPxFormat(img);
+    const auto w = dpsoImgGetWidth(img);
+    const auto h = dpsoImgGetHeight(img);
+    const auto* data = dpsoImgGetConstData(img);
+    const auto pitch = dpsoImgGetPitch(img);
+
+    const auto rowSize = w * dpsoPxFormatGetBytesPerPx(pxFormat);
+
+    auto changed =
+        !watch.hasCapture
+        || pxFormat != watch.lastPxFormat
+        || w != watch.lastW
+        || h != watch.lastH;
+
+    if (changed)
+        watch.lastPixels.resize(
+            static_cast<std::size_t>(rowSize) * h);
+
+    for (int y{}; y < h; ++y) {
+        const auto* srcRow = data + y * pitch;
+        auto* lastRow = watch.lastPixels.data() + y * rowSize;
+
+        if (!changed && std::memcmp(srcRow, lastRow, rowSize) == 0)
+            continue;
+
+        changed = true;
+        std::copy_n(srcRow, rowSize, lastRow);
+    }
+
+    watch.hasCapture = true;
+    watch.lastPxFormat = pxFormat;
+    watch.lastW = w;
+    watch.lastH = h;
+
+    return changed;
+}
+
+
+bool dpsoScreenWatchGetChange(
+    DpsoScreenWatch* watch, DpsoPxFormat pxFormat, DpsoImg** img)
+{
+    if (!img) {
+        dpso::setError("img is null");
+        return false;
+    }
+
+    *img = nullptr;
+
+    if (!watch) {
+        dpso::setError("watch is null");
+        return false;
+    }
+
+    if (dpsoScreenWatchGetTimeoutMs(watch) != 0)
+        return true;
+
+    // Clear before taking the screenshot, so that changes made while
+    // we are capturing are not lost.
+    if (watch->damageTracker)
+        watch->damageTracker->clear();
+
+    watch->lastCaptureTime = Clock::now();
+
+    dpso::img::ImgUPtr screenshot;
+    try {
+        screenshot = watch->backend->takeScreenshot(
+            watch->rect, pxFormat);
+    } catch (dpso::backend::ScreenshotError& e) {
+        dpso::setError("Backend::takeScreenshot(): {}", e.what());
+        return false;
+    }
+
+    if (updateLastPixels(*watch, screenshot.get()))
+        *img = screenshot.release();
+
+    return true;
+}
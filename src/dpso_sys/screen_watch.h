@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "dpso_img/img.h"
+#include "dpso_utils/geometry_c.h"
+
+#include "dpso_sys_fwd.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Screen watch.
+ *
+ * The screen watch captures a screen region whenever its contents
+ * change, e.g. to recognize text in a log pane or a dashboard as it
+ * updates, without taking and comparing screenshots blindly at a
+ * fixed rate.
+ *
+ * Changes are detected by dpsoSysUpdate() using the facilities of
+ * the platform, like the X Damage extension. If the platform has
+ * none, every check is treated as a possible change, and the watch
+ * falls back to comparing screenshots at the minimum interval.
+ */
+typedef struct DpsoScreenWatch DpsoScreenWatch;
+
+
+/**
+ * Create a screen watch.
+ *
+ * The watch captures the intersection of the given rect with the
+ * screen geometry. minIntervalMs is the minimum interval between
+ * screenshots: changes that happen faster are coalesced into one.
+ *
+ * The watch should be deleted before the sys.
+ *
+ * On failure, sets an error message (dpsoGetError()) and returns
+ * null.
+ */
+DpsoScreenWatch* dpsoScreenWatchCreate(
+    DpsoSys* sys, const DpsoRect* rect, int minIntervalMs);
+
+
+void dpsoScreenWatchDelete(DpsoScreenWatch* watch);
+
+
+/**
+ * Get the time till a pending change can be captured.
+ *
+ * Returns 0 if dpsoScreenWatchGetChange() should be called right
+ * away, or -1 if there are no pending changes, in which case the
+ * next one can only be detected by dpsoSysUpdate(). Hosts that
+ * wait for events on the descriptor from dpsoSysGetEventFd() should
+ * use the value as the wait timeout.
+ */
+int dpsoScreenWatchGetTimeoutMs(const DpsoScreenWatch* watch);
+
+
+/**
+ * Capture the region if its contents changed.
+ *
+ * If the contents may have changed since the last capture and the
+ * minimum interval has passed, takes a screenshot in the given pixel
+ * format (see dpsoTakeScreenshot()) and compares it with the last
+ * one. The first call always captures the region.
+ *
+ * On success, returns true and sets *img to the new screenshot if
+ * the pixels actually changed, or to null otherwise. You own the
+ * returned image.
+ *
+ * On failure, sets an error message (dpsoGetError()), sets *img to
+ * null, and returns false.
+ */
+bool dpsoScreenWatchGetChange(
+    DpsoScreenWatch* watch, DpsoPxFormat pxFormat, DpsoImg** img);
+
+
+#ifdef __cplusplus
+}
+
+
+#include <memory>
+
+
+namespace dpso {
+
+
+struct ScreenWatchDeleter {
+    void operator()(DpsoScreenWatch* watch) const
+    {
+        dpsoScreenWatchDelete(watch);
+    }
+};
+
+
+using ScreenWatchUPtr =
+    std::unique_ptr<DpsoScreenWatch, ScreenWatchDeleter>;
+
+
+}
+
+
+#endif
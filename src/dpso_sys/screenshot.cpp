@@ -8,7 +8,8 @@
 #include "dpso_sys_p.h"
 
 
-DpsoImg* dpsoTakeScreenshot(DpsoSys* sys, const DpsoRect* rect)
+DpsoImg* dpsoTakeScreenshot(
+    DpsoSys* sys, const DpsoRect* rect, DpsoPxFormat pxFormat)
 {
     if (!sys) {
         dpso::setError("sys is null");
@@ -22,7 +23,7 @@ DpsoImg* dpsoTakeScreenshot(DpsoSys* sys, const DpsoRect* rect)
 
     try {
         return sys->backend->takeScreenshot(
-            dpso::Rect{*rect}).release();
+            dpso::Rect{*rect}, pxFormat).release();
     } catch (dpso::backend::ScreenshotError& e) {
         dpso::setError("Backend::takeScreenshot(): {}", e.what());
         return {};
@@ -15,12 +15,18 @@ extern "C" {
  * Take a screenshot.
  *
  * The screenshot is taken from the intersection of the given rect
- * with the screen geometry.
+ * with the screen geometry. The resulting image has the given pixel
+ * format; request DpsoPxFormatGrayscale if colors are not needed
+ * (e.g., for OCR). On X11, the conversion is done while reading the
+ * screen data, so grayscale avoids a separate pass over the image.
+ * On Windows, GDI always captures BGRA, and any other format is
+ * converted afterwards into a new image.
  *
  * On failure, sets an error message (dpsoGetError()) and returns
  * null.
  */
-DpsoImg* dpsoTakeScreenshot(DpsoSys* sys, const DpsoRect* rect);
+DpsoImg* dpsoTakeScreenshot(
+    DpsoSys* sys, const DpsoRect* rect, DpsoPxFormat pxFormat);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,248 @@
+#include "lz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// The compressed data is a sequence of blocks. Each block starts with
+// a token byte, with the number of literals in the high 4 bits and
+// the match length minus minMatchLen in the low 4 bits. If a 4-bit
+// field is 15, the value continues in the following bytes: each is
+// added to the value, and the sequence ends with a byte less than
+// 255. The token and the optional literal length bytes are followed
+// by the literals, the 16-bit little-endian match offset, and the
+// optional match length bytes.
+//
+// The last block consists only of the token and the literals; it can
+// have no literals.
+
+
+namespace dpso::lz {
+namespace {
+
+
+const std::size_t minMatchLen = 4;
+const std::size_t maxOffset = 0xffff;
+
+// The longest output per input byte is produced by the 255 bytes of
+// a match length.
+const std::size_t maxExpansion = 255;
+
+const int hashBits = 16;
+
+
+std::uint32_t read32(const char* data)
+{
+    // The byte order doesn't matter: the value is only hashed and
+    // compared.
+    std::uint32_t v;
+    std::memcpy(&v, data, sizeof(v));
+    return v;
+}
+
+
+std::size_t getHash(std::uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - hashBits);
+}
+
+
+void appendLength(std::string& data, std::size_t len)
+{
+    for (; len >= 255; len -= 255)
+        data += static_cast<char>(255);
+
+    data += static_cast<char>(len);
+}
+
+
+void appendBlock(
+    std::string& data,
+    std::string_view literals,
+    std::size_t matchLen,
+    std::size_t offset)
+{
+    const auto matchLenCode =
+        matchLen > 0 ? matchLen - minMatchLen : 0;
+
+    data += static_cast<char>(
+        (std::min<std::size_t>(literals.size(), 15) << 4)
+        | std::min<std::size_t>(matchLenCode, 15));
+
+    if (literals.size() >= 15)
+        appendLength(data, literals.size() - 15);
+
+    data += literals;
+
+    if (matchLen == 0)
+        return;
+
+    data += static_cast<char>(offset & 0xff);
+    data += static_cast<char>(offset >> 8);
+
+    if (matchLenCode >= 15)
+        appendLength(data, matchLenCode - 15);
+}
+
+
+class Reader {
+public:
+    explicit Reader(std::string_view data)
+        : data{data}
+    {
+    }
+
+    std::size_t getNumAvailable() const
+    {
+        return data.size() - pos;
+    }
+
+    std::uint8_t readByte()
+    {
+        return data[pos++];
+    }
+
+    const char* read(std::size_t size)
+    {
+        const auto* result = data.data() + pos;
+        pos += size;
+        return result;
+    }
+
+    // Read the continuation of a 4-bit length field.
+    bool readLength(std::size_t& len)
+    {
+        if (len < 15)
+            return true;
+
+        while (getNumAvailable() > 0) {
+            const auto b = readByte();
+            len += b;
+            if (b < 255)
+                return true;
+        }
+
+        return false;
+    }
+private:
+    std::string_view data;
+    std::size_t pos{};
+};
+
+
+}
+
+
+std::string compress(std::string_view data)
+{
+    std::string result;
+    result.reserve(data.size() / 2);
+
+    // Positions of the last occurrences of 4-byte sequences.
+    std::vector<std::size_t> table(std::size_t{1} << hashBits);
+
+    std::size_t literalsPos{};
+    std::size_t pos{};
+
+    while (data.size() - pos >= minMatchLen) {
+        const auto v = read32(data.data() + pos);
+        auto& tableEntry = table[getHash(v)];
+        const auto matchPos = tableEntry;
+        tableEntry = pos;
+
+        if (matchPos >= pos
+                || pos - matchPos > maxOffset
+                || read32(data.data() + matchPos) != v) {
+            ++pos;
+            continue;
+        }
+
+        auto matchLen = minMatchLen;
+        while (pos + matchLen < data.size()
+                && data[matchPos + matchLen] == data[pos + matchLen])
+            ++matchLen;
+
+        appendBlock(
+            result,
+            data.substr(literalsPos, pos - literalsPos),
+            matchLen,
+            pos - matchPos);
+
+        pos += matchLen;
+        literalsPos = pos;
+    }
+
+    appendBlock(result, data.substr(literalsPos), 0, 0);
+
+    return result;
+}
+
+
+bool decompress(
+    std::string_view data, std::size_t size, std::string& result)
+{
+    if (size > 0 && (size - 1) / maxExpansion >= data.size())
+        return false;
+
+    result.resize(size);
+
+    Reader reader{data};
+    std::size_t resultPos{};
+
+    while (reader.getNumAvailable() > 0) {
+        const auto token = reader.readByte();
+
+        std::size_t literalsLen = token >> 4;
+        if (!reader.readLength(literalsLen)
+                || reader.getNumAvailable() < literalsLen
+                || size - resultPos < literalsLen)
+            return false;
+
+        std::memcpy(
+            &result[resultPos],
+            reader.read(literalsLen),
+            literalsLen);
+        resultPos += literalsLen;
+
+        if (reader.getNumAvailable() == 0)
+            break;
+
+        if (reader.getNumAvailable() < 2)
+            return false;
+
+        std::size_t offset = reader.readByte();
+        offset |= static_cast<std::size_t>(reader.readByte()) << 8;
+
+        std::size_t matchLen = token & 0xf;
+        if (!reader.readLength(matchLen))
+            return false;
+
+        matchLen += minMatchLen;
+
+        if (offset == 0
+                || offset > resultPos
+                || size - resultPos < matchLen)
+            return false;
+
+        // The match can overlap the data being written, so we can't
+        // use memcpy() for short offsets.
+        if (offset >= matchLen)
+            std::memcpy(
+                &result[resultPos],
+                &result[resultPos - offset],
+                matchLen);
+        else
+            for (std::size_t i{}; i < matchLen; ++i)
+                result[resultPos + i] =
+                    result[resultPos + i - offset];
+
+        resultPos += matchLen;
+    }
+
+    return resultPos == size;
+}
+
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// Fast LZ77 compression, similar to the LZ4 block format. It trades
+// compression ratio for speed and is good enough for text.
+namespace dpso::lz {
+
+
+std::string compress(std::string_view data);
+
+
+// Decompress data produced by compress(). size is the size of the
+// original data. Returns false if the data is damaged.
+//
+// A byte of compressed data expands to at most 255 bytes, so a size
+// larger than that is rejected before allocating the result. This
+// makes it safe to pass a size read from an untrusted source.
+bool decompress(
+    std::string_view data, std::size_t size, std::string& result);
+
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+namespace dpso::os {
+
+
+// A file mapped to memory for reading.
+//
+// The file should not be truncated while it's mapped; depending on
+// the platform, accessing the missing pages may crash the program.
+// Appending is fine, but the data written after mapping is not
+// visible through the mapping.
+class MappedFile {
+public:
+    enum class Mode {
+        // The data can only be read.
+        readOnly,
+
+        // The data can be modified, but the changes are not written
+        // back to the file. Pages are copied on the first write, so
+        // unmodified data costs no memory beyond the page cache.
+        copyOnWrite
+    };
+
+    // Throws os::Error.
+    explicit MappedFile(
+        std::string_view filePath, Mode mode = Mode::readOnly);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&&) = delete;
+    MappedFile& operator=(MappedFile&&) = delete;
+
+    // Null if the file is empty.
+    const std::uint8_t* getData() const
+    {
+        return data;
+    }
+
+    // Null if the file is empty or the mode is not copyOnWrite.
+    std::uint8_t* getWritableData()
+    {
+        return mode == Mode::copyOnWrite ? data : nullptr;
+    }
+
+    std::size_t getSize() const
+    {
+        return size;
+    }
+private:
+    Mode mode;
+    std::uint8_t* data{};
+    std::size_t size{};
+};
+
+
+}
@@ -0,0 +1,65 @@
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <string>
+
+#include "os.h"
+#include "scope_exit.h"
+
+
+namespace dpso::os {
+
+
+MappedFile::MappedFile(std::string_view filePath, Mode mode)
+    : mode{mode}
+{
+    const auto fd = open(
+        std::string{filePath}.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        throwErrno("open()", errno);
+
+    const ScopeExit closeFd{[&]{ close(fd); }};
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        throwErrno("fstat()", errno);
+
+    if (!S_ISREG(st.st_mode))
+        throw Error{"Not a regular file"};
+
+    if (st.st_size == 0)
+        return;
+
+    if (static_cast<std::uintmax_t>(st.st_size) > SIZE_MAX)
+        throw Error{"File is too large to map"};
+
+    auto* addr = mmap(
+        nullptr,
+        st.st_size,
+        mode == Mode::copyOnWrite
+            ? PROT_READ | PROT_WRITE : PROT_READ,
+        MAP_PRIVATE,
+        fd,
+        0);
+    if (addr == MAP_FAILED)
+        throwErrno("mmap()", errno);
+
+    data = static_cast<std::uint8_t*>(addr);
+    size = st.st_size;
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (data)
+        munmap(data, size);
+}
+
+
+}
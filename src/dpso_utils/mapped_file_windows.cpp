@@ -0,0 +1,100 @@
+#include "mapped_file.h"
+
+#include <cstdint>
+
+#include "os.h"
+#include "str.h"
+#include "windows/error.h"
+#include "windows/handle.h"
+#include "windows/utf.h"
+
+
+namespace dpso::os {
+
+
+[[noreturn]]
+static void throwLastError(std::string_view description)
+{
+    const auto lastError = GetLastError();
+
+    const auto message = str::format(
+        "{}: {}", description, windows::getErrorMessage(lastError));
+
+    if (lastError == ERROR_FILE_NOT_FOUND)
+        throw FileNotFoundError{message};
+
+    throw Error{message};
+}
+
+
+MappedFile::MappedFile(std::string_view filePath, Mode mode)
+    : mode{mode}
+{
+    std::wstring filePathUtf16;
+    try {
+        filePathUtf16 = windows::utf8ToUtf16(filePath);
+    } catch (windows::CharConversionError& e) {
+        throw Error{str::format(
+            "Can't convert filePath to UTF-16: {}", e.what())};
+    }
+
+    // FILE_SHARE_WRITE allows appending to the file while it's
+    // mapped.
+    const windows::Handle<windows::InvalidHandleType::value> file{
+        CreateFileW(
+            filePathUtf16.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr)};
+    if (!file)
+        throwLastError("CreateFileW()");
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+        throwLastError("GetFileSizeEx()");
+
+    if (fileSize.QuadPart == 0)
+        return;
+
+    if (static_cast<std::uint64_t>(fileSize.QuadPart) > SIZE_MAX)
+        throw Error{"File is too large to map"};
+
+    // The mapping object and the file can be closed once the view is
+    // created; the view keeps them alive.
+    const windows::Handle<windows::InvalidHandleType::null> mapping{
+        CreateFileMappingW(
+            file,
+            nullptr,
+            mode == Mode::copyOnWrite
+                ? PAGE_WRITECOPY : PAGE_READONLY,
+            0,
+            0,
+            nullptr)};
+    if (!mapping)
+        throwLastError("CreateFileMappingW()");
+
+    auto* view = MapViewOfFile(
+        mapping,
+        mode == Mode::copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ,
+        0,
+        0,
+        0);
+    if (!view)
+        throwLastError("MapViewOfFile()");
+
+    data = static_cast<std::uint8_t*>(view);
+    size = fileSize.QuadPart;
+}
+
+
+MappedFile::~MappedFile()
+{
+    if (data)
+        UnmapViewOfFile(data);
+}
+
+
+}
@@ -0,0 +1,233 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "str.h"
+
+
+namespace dpso::metrics {
+
+
+double Histogram::Snapshot::getMeanUs() const
+{
+    return count > 0 ? static_cast<double>(sumUs) / count : 0;
+}
+
+
+double Histogram::Snapshot::getQuantileUs(double q) const
+{
+    if (count == 0)
+        return 0;
+
+    const auto rank = std::clamp<std::uint64_t>(
+        static_cast<std::uint64_t>(std::ceil(q * count)), 1, count);
+
+    std::uint64_t numBefore{};
+    for (int i{}; i < numBuckets; ++i) {
+        if (numBefore + buckets[i] < rank) {
+            numBefore += buckets[i];
+            continue;
+        }
+
+        // Assume the values are evenly spaced within the bucket,
+        // starting from the lower bound. The upper bound is limited
+        // by the maximum so that the last bucket is not stretched
+        // beyond the actual values.
+        const double lowerBound = getBucketLowerBound(i);
+        const double upperBound = std::min<double>(
+            i + 1 < numBuckets ? getBucketLowerBound(i + 1) : maxUs,
+            maxUs + 1.0);
+        const auto pos =
+            static_cast<double>(rank - numBefore - 1) / buckets[i];
+
+        return std::min<double>(
+            lowerBound + (upperBound - lowerBound) * pos, maxUs);
+    }
+
+    return maxUs;
+}
+
+
+int Histogram::getBucketIdx(std::uint64_t us)
+{
+    if (us < 4)
+        return us;
+
+    int exp{};
+    for (auto v = us; v > 1; v >>= 1)
+        ++exp;
+
+    if (exp > maxExp)
+        return numBuckets - 1;
+
+    const auto subIdx = (us >> (exp - 2)) & 3;
+    return 4 + (exp - 2) * 4 + subIdx;
+}
+
+
+std::uint64_t Histogram::getBucketLowerBound(int bucketIdx)
+{
+    assert(bucketIdx >= 0);
+    assert(bucketIdx < numBuckets);
+
+    if (bucketIdx < 4)
+        return bucketIdx;
+
+    const auto exp = (bucketIdx - 4) / 4 + 2;
+    const std::uint64_t subIdx = (bucketIdx - 4) % 4;
+    return (4 + subIdx) << (exp - 2);
+}
+
+
+void Histogram::record(std::uint64_t us)
+{
+    buckets[getBucketIdx(us)].fetch_add(1, std::memory_order_relaxed);
+    sumUs.fetch_add(us, std::memory_order_relaxed);
+
+    auto curMaxUs = maxUs.load(std::memory_order_relaxed);
+    while (curMaxUs < us
+            && !maxUs.compare_exchange_weak(
+                curMaxUs, us, std::memory_order_relaxed));
+}
+
+
+void Histogram::record(Clock::duration duration)
+{
+    const auto us = std::chrono::duration_cast<
+        std::chrono::microseconds>(duration).count();
+    record(static_cast<std::uint64_t>(std::max<decltype(us)>(us, 0)));
+}
+
+
+Histogram::Snapshot Histogram::getSnapshot() const
+{
+    Snapshot result{};
+
+    for (int i{}; i < numBuckets; ++i) {
+        result.buckets[i] = buckets[i].load(
+            std::memory_order_relaxed);
+        result.count += result.buckets[i];
+    }
+
+    result.sumUs = sumUs.load(std::memory_order_relaxed);
+    result.maxUs = maxUs.load(std::memory_order_relaxed);
+
+    return result;
+}
+
+
+template<typename T>
+static T& getOrCreate(
+    std::map<std::string, std::unique_ptr<T>, std::less<>>& map,
+    std::string_view name)
+{
+    if (const auto iter = map.find(name); iter != map.end())
+        return *iter->second;
+
+    return *map.emplace(
+        std::string{name}, std::make_unique<T>()).first->second;
+}
+
+
+Counter& Registry::getCounter(std::string_view name)
+{
+    const std::lock_guard lock{mutex};
+    return getOrCreate(counters, name);
+}
+
+
+Histogram& Registry::getHistogram(std::string_view name)
+{
+    const std::lock_guard lock{mutex};
+    return getOrCreate(histograms, name);
+}
+
+
+void Registry::forEachCounter(const CounterFn& fn) const
+{
+    const std::lock_guard lock{mutex};
+    for (const auto& [name, counter] : counters)
+        fn(name, *counter);
+}
+
+
+void Registry::forEachHistogram(const HistogramFn& fn) const
+{
+    const std::lock_guard lock{mutex};
+    for (const auto& [name, histogram] : histograms)
+        fn(name, *histogram);
+}
+
+
+static std::string histogramToJson(const Histogram& histogram)
+{
+    const auto s = histogram.getSnapshot();
+
+    auto result = str::format(
+        "{{\"count\": {}, \"sum\": {}, \"mean\": {}, "
+        "\"p50\": {}, \"p90\": {}, \"p99\": {}, \"max\": {}, "
+        "\"buckets\": [",
+        s.count,
+        s.sumUs,
+        s.getMeanUs(),
+        s.getQuantileUs(0.5),
+        s.getQuantileUs(0.9),
+        s.getQuantileUs(0.99),
+        s.maxUs);
+
+    auto isFirst = true;
+    for (int i{}; i < Histogram::numBuckets; ++i) {
+        if (s.buckets[i] == 0)
+            continue;
+
+        if (!isFirst)
+            result += ", ";
+        isFirst = false;
+
+        result += str::format(
+            "[{}, {}]",
+            Histogram::getBucketLowerBound(i), s.buckets[i]);
+    }
+
+    result += "]}";
+    return result;
+}
+
+
+std::string Registry::toJson() const
+{
+    // The names are restricted to characters that don't need
+    // escaping.
+    std::string result{"{\n  \"counters\": {"};
+
+    auto isFirst = true;
+    forEachCounter(
+        [&](const std::string& name, const Counter& counter)
+        {
+            result += str::format(
+                "{}\n    \"{}\": {}",
+                isFirst ? "" : ",", name, counter.get());
+            isFirst = false;
+        });
+
+    result += isFirst ? "},\n" : "\n  },\n";
+    result += "  \"histograms\": {";
+
+    isFirst = true;
+    forEachHistogram(
+        [&](const std::string& name, const Histogram& histogram)
+        {
+            result += str::format(
+                "{}\n    \"{}\": {}",
+                isFirst ? "" : ",", name, histogramToJson(histogram));
+            isFirst = false;
+        });
+
+    result += isFirst ? "}\n}\n" : "\n  }\n}\n";
+    return result;
+}
+
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+
+// Low-overhead metrics that stay enabled in release builds.
+//
+// Unlike timing.h, which prints the duration of every step in debug
+// builds, the metrics only accumulate values, so they are cheap
+// enough to be always on and can be queried at any time.
+
+
+namespace dpso::metrics {
+
+
+using Clock = std::chrono::steady_clock;
+
+
+// Monotonic event counter.
+class Counter {
+public:
+    void add(std::uint64_t n = 1)
+    {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const
+    {
+        return value.load(std::memory_order_relaxed);
+    }
+private:
+    std::atomic<std::uint64_t> value{};
+};
+
+
+// Histogram of durations with fixed log-linear buckets.
+//
+// Values are in microseconds. Each power of two is split into 4
+// buckets, so a bucket spans at most 25% of its lower bound, and
+// quantile estimates are accurate to within that. Values of
+// 2^(maxExp + 1) us (about 19 hours) and above go to the last bucket.
+class Histogram {
+public:
+    static const int maxExp{35};
+    static const int numBuckets{4 + (maxExp - 1) * 4};
+
+    struct Snapshot {
+        std::uint64_t count;
+        std::uint64_t sumUs;
+        std::uint64_t maxUs;
+        std::uint64_t buckets[numBuckets];
+
+        double getMeanUs() const;
+
+        // Estimate the q-th quantile in microseconds, q being in
+        // [0, 1]. Returns 0 if the histogram is empty.
+        double getQuantileUs(double q) const;
+    };
+
+    static int getBucketIdx(std::uint64_t us);
+
+    // Return the lower bound of the bucket, inclusive.
+    static std::uint64_t getBucketLowerBound(int bucketIdx);
+
+    void record(std::uint64_t us);
+    void record(Clock::duration duration);
+
+    // The snapshot is not atomic as a whole, but count is always the
+    // sum of the buckets.
+    Snapshot getSnapshot() const;
+private:
+    std::atomic<std::uint64_t> sumUs{};
+    std::atomic<std::uint64_t> maxUs{};
+    std::atomic<std::uint64_t> buckets[numBuckets]{};
+};
+
+
+// Named counters and histograms.
+//
+// get*() take a lock, so look the metrics up once and keep the
+// references; recording through them is lock-free. The references
+// stay valid for the lifetime of the registry.
+//
+// Names should consist of lowercase ASCII letters, digits, and
+// underscores; by convention, histogram names end with "_us".
+class Registry {
+public:
+    Counter& getCounter(std::string_view name);
+    Histogram& getHistogram(std::string_view name);
+
+    using CounterFn = std::function<
+        void(const std::string& name, const Counter& counter)>;
+    using HistogramFn = std::function<
+        void(const std::string& name, const Histogram& histogram)>;
+
+    // Call fn for each metric in the alphabetical order of names.
+    void forEachCounter(const CounterFn& fn) const;
+    void forEachHistogram(const HistogramFn& fn) const;
+
+    // Return a JSON object with "counters" and "histograms" members.
+    // A histogram is represented by an object with count, sum, mean,
+    // p50, p90, p99, and max (all in microseconds), and a "buckets"
+    // array of [lowerBound, count] pairs for non-empty buckets.
+    std::string toJson() const;
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Counter>, std::less<>>
+        counters;
+    std::map<std::string, std::unique_ptr<Histogram>, std::less<>>
+        histograms;
+};
+
+
+}
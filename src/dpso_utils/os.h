@@ -108,6 +108,16 @@ void syncDir(std::string_view dirPath);
 std::string loadData(std::string_view filePath);
 
 
+// Replace the contents of a file with data.
+//
+// The data is written and synced to a temporary file, which then
+// replaces filePath, so that a failure doesn't leave filePath
+// damaged. The temporary file is removed on failure.
+//
+// Throws os::Error.
+void saveData(std::string_view filePath, std::string_view data);
+
+
 // Run an executable.
 //
 // If supported by the platform, exePath may be just the name of the
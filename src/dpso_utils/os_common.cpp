@@ -170,4 +170,34 @@ std::string loadData(std::string_view filePath)
 }
 
 
+
+
+void saveData(std::string_view filePath, std::string_view data)
+{
+    const auto tmpFilePath = std::string{filePath} + ".tmp";
+
+    try {
+        try {
+            FileStream file{tmpFilePath, FileStream::Mode::write};
+            write(file, data);
+            file.sync();
+        } catch (StreamError& e) {
+            throw Error{
+                str::format("write(file, ...): {}", e.what())};
+        }
+
+        replace(tmpFilePath, filePath);
+    } catch (Error&) {
+        try {
+            removeFile(tmpFilePath);
+        } catch (Error&) {
+        }
+
+        throw;
+    }
+
+    const auto dirPath = getDirName(filePath);
+    syncDir(dirPath.empty() ? "." : std::string_view{dirPath});
+}
+
 }
@@ -241,6 +241,45 @@ std::string toHex(const void* data, std::size_t size)
 }
 
 
+std::string escapeJsonStr(std::string_view s)
+{
+    std::string result;
+    result.reserve(s.size());
+
+    static const auto* hexChars = "0123456789abcdef";
+
+    for (const auto c : s)
+        switch (c) {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\r':
+            result += "\\r";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            if (const auto b = static_cast<unsigned char>(c);
+                    b < 0x20) {
+                result += "\\u00";
+                result += hexChars[b >> 4];
+                result += hexChars[b & 0x0f];
+            } else
+                result += c;
+            break;
+        }
+
+    return result;
+}
+
+
 static auto makeArgLookupFn(
     std::initializer_list<std::string_view> args)
 {
@@ -56,6 +56,13 @@ std::string toStr(double v);
 std::string toHex(const void* data, std::size_t size);
 
 
+// Escape a string for inclusion in a JSON string literal (without
+// the enclosing quotes). Quotes, backslashes, and control characters
+// are escaped; other characters, including non-ASCII UTF-8 sequences,
+// are kept as is.
+std::string escapeJsonStr(std::string_view s);
+
+
 namespace formatArg {
 
 
@@ -61,6 +61,13 @@ std::size_t FileStream::readSome(void* dst, std::size_t dstSize)
 }
 
 
+void FileStream::flush()
+{
+    if (std::fflush(impl->fp.get()) == EOF)
+        throw StreamError{"fflush() failed"};
+}
+
+
 void FileStream::sync()
 {
     if (std::fflush(impl->fp.get()) == EOF)
@@ -39,6 +39,9 @@ public:
 
     void write(const void* src, std::size_t srcSize) override;
 
+    // Pass buffered data to the OS. Throws StreamError.
+    void flush();
+
     // Synchronize the file state with the storage device.
     //
     // Throws os::Error.
@@ -0,0 +1,137 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace dpso {
+namespace {
+
+
+// A parallelFor() call. Batches live on the stack of the calling
+// thread and are only accessed with ThreadPool::Impl::mutex locked.
+struct Batch {
+    const std::function<void(int)>* fn;
+    int numTasks;
+    int nextTaskIdx;
+    int numDoneTasks;
+};
+
+
+}
+
+
+struct ThreadPool::Impl {
+    std::mutex mutex;
+    std::condition_variable taskCondVar;
+    std::condition_variable doneCondVar;
+    // Batches that still have tasks to start.
+    std::deque<Batch*> batches;
+    bool terminate;
+
+    std::vector<std::thread> threads;
+
+    void threadLoop();
+
+    // Start the next task of the batch. The lock is released while the
+    // task runs.
+    void runTask(Batch& batch, std::unique_lock<std::mutex>& lock);
+};
+
+
+void ThreadPool::Impl::threadLoop()
+{
+    std::unique_lock lock{mutex};
+
+    while (true) {
+        taskCondVar.wait(
+            lock, [&]{ return terminate || !batches.empty(); });
+        if (terminate)
+            break;
+
+        runTask(*batches.front(), lock);
+    }
+}
+
+
+void ThreadPool::Impl::runTask(
+    Batch& batch, std::unique_lock<std::mutex>& lock)
+{
+    const auto taskIdx = batch.nextTaskIdx++;
+    if (batch.nextTaskIdx == batch.numTasks)
+        batches.erase(
+            std::find(batches.begin(), batches.end(), &batch));
+
+    lock.unlock();
+    (*batch.fn)(taskIdx);
+    lock.lock();
+
+    if (++batch.numDoneTasks == batch.numTasks)
+        doneCondVar.notify_all();
+}
+
+
+ThreadPool::ThreadPool(int numThreads)
+    : impl{std::make_unique<Impl>()}
+{
+    impl->terminate = false;
+
+    for (int i{}; i < numThreads; ++i)
+        impl->threads.emplace_back(&Impl::threadLoop, impl.get());
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        const std::lock_guard guard{impl->mutex};
+        impl->terminate = true;
+    }
+
+    impl->taskCondVar.notify_all();
+
+    for (auto& thread : impl->threads)
+        thread.join();
+}
+
+
+int ThreadPool::getConcurrency() const
+{
+    return impl->threads.size() + 1;
+}
+
+
+void ThreadPool::parallelFor(
+    int numTasks, const std::function<void(int)>& fn)
+{
+    if (numTasks < 1)
+        return;
+
+    if (numTasks == 1 || impl->threads.empty()) {
+        for (int i{}; i < numTasks; ++i)
+            fn(i);
+        return;
+    }
+
+    Batch batch{&fn, numTasks, 0, 0};
+
+    std::unique_lock lock{impl->mutex};
+
+    impl->batches.push_back(&batch);
+    impl->taskCondVar.notify_all();
+
+    while (batch.nextTaskIdx < batch.numTasks)
+        impl->runTask(batch, lock);
+
+    // The batch is no longer in the queue, so once the tasks started
+    // by other threads are done, nobody refers to it.
+    impl->doneCondVar.wait(
+        lock, [&]{ return batch.numDoneTasks == batch.numTasks; });
+}
+
+
+}
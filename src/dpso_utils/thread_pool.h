@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+
+
+namespace dpso {
+
+
+// Pool of threads for data-parallel loops.
+//
+// The pool can be shared: parallelFor() can be called from several
+// threads at once, in which case their tasks are interleaved.
+class ThreadPool {
+public:
+    // The pool starts numThreads background threads. Since the thread
+    // calling parallelFor() takes part in the work, use one thread
+    // less than the desired concurrency. numThreads can be 0, in which
+    // case parallelFor() runs everything on the calling thread.
+    explicit ThreadPool(int numThreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    // Return the maximum number of parallelFor() tasks that can run
+    // simultaneously, i.e. the number of background threads plus 1.
+    int getConcurrency() const;
+
+    // Call fn(i) for each i in [0, numTasks), blocking until all
+    // calls return. fn should not throw.
+    void parallelFor(int numTasks, const std::function<void(int)>& fn);
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+
+}
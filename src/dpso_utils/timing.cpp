@@ -30,11 +30,11 @@ void report(
 {
     const auto duration = getTime() - startTime;
 
-    str::print("Timing: ");
-    str::print(fmt, args);
-    str::print(": {} ms\n", duration);
-
-    std::fflush(stdout);
+    // stderr keeps the reports out of machine-readable output that
+    // tools like the OCR benchmark print to stdout.
+    str::print(stderr, "Timing: ");
+    str::print(stderr, fmt, args);
+    str::print(stderr, ": {} ms\n", duration);
 }
 
 
@@ -0,0 +1,250 @@
+#include "trace.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "str.h"
+#include "stream/file_stream.h"
+#include "stream/utils.h"
+
+
+namespace dpso::trace {
+namespace {
+
+
+struct Event {
+    const char* name;
+    // 'X' for a complete span, 'b' and 'e' for the beginning and
+    // the end of an asynchronous span.
+    char phase;
+    std::int64_t jobId;
+    // Relative to the creation of the recorder.
+    std::int64_t timeNs;
+    std::int64_t durationNs;
+};
+
+
+struct ThreadBuffer {
+    std::thread::id threadId;
+    // Small sequential id, since std::thread::id is not a number.
+    int tid;
+    std::string name;
+    std::vector<Event> events;
+    std::size_t numDroppedEvents;
+};
+
+
+// Limits the memory use to about 40 MB per thread if the recording
+// is enabled for a long time.
+const std::size_t maxEventsPerThread{1 << 20};
+
+
+// The buffer of the calling thread for the last used recorder, which
+// saves a lock on every event.
+struct ThreadCache {
+    std::uint64_t recorderId;
+    ThreadBuffer* buffer;
+};
+
+thread_local ThreadCache threadCache;
+
+
+}
+
+
+struct Recorder::Impl {
+    // Unlike the address, the id is never reused, so it's safe to
+    // keep in ThreadCache after the recorder is deleted.
+    std::uint64_t id;
+    Clock::time_point startTime;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    ThreadBuffer& getBuffer(std::thread::id threadId)
+    {
+        for (auto& buffer : buffers)
+            if (buffer->threadId == threadId)
+                return *buffer;
+
+        buffers.push_back(
+            std::make_unique<ThreadBuffer>(
+                ThreadBuffer{
+                    threadId,
+                    static_cast<int>(buffers.size() + 1),
+                    {},
+                    {},
+                    0}));
+        return *buffers.back();
+    }
+
+    ThreadBuffer& getCurrentThreadBuffer()
+    {
+        if (threadCache.recorderId != id) {
+            const std::lock_guard lock{mutex};
+            threadCache = {
+                id, &getBuffer(std::this_thread::get_id())};
+        }
+
+        return *threadCache.buffer;
+    }
+
+    void add(
+        const char* name,
+        char phase,
+        std::int64_t jobId,
+        Clock::time_point time,
+        Clock::duration duration)
+    {
+        auto& buffer = getCurrentThreadBuffer();
+        if (buffer.events.size() == maxEventsPerThread) {
+            ++buffer.numDroppedEvents;
+            return;
+        }
+
+        using std::chrono::nanoseconds;
+        using std::chrono::duration_cast;
+
+        buffer.events.push_back(
+            {
+                name,
+                phase,
+                jobId,
+                duration_cast<nanoseconds>(time - startTime).count(),
+                duration_cast<nanoseconds>(duration).count()});
+    }
+};
+
+
+static std::uint64_t getNextRecorderId()
+{
+    static std::atomic<std::uint64_t> nextId{1};
+    return nextId++;
+}
+
+
+Recorder::Recorder()
+    : impl{std::make_unique<Impl>()}
+{
+    impl->id = getNextRecorderId();
+    impl->startTime = Clock::now();
+}
+
+
+Recorder::~Recorder() = default;
+
+
+void Recorder::setThreadName(
+    std::thread::id threadId, std::string name)
+{
+    const std::lock_guard lock{impl->mutex};
+    impl->getBuffer(threadId).name = std::move(name);
+}
+
+
+void Recorder::addSpan(
+    const char* name,
+    Clock::time_point begin,
+    Clock::time_point end,
+    std::int64_t jobId)
+{
+    impl->add(name, 'X', jobId, begin, end - begin);
+}
+
+
+void Recorder::addAsyncBegin(const char* name, std::int64_t jobId)
+{
+    impl->add(name, 'b', jobId, Clock::now(), {});
+}
+
+
+void Recorder::addAsyncEnd(const char* name, std::int64_t jobId)
+{
+    impl->add(name, 'e', jobId, Clock::now(), {});
+}
+
+
+// Format nanoseconds as fractional microseconds, which is the unit
+// of the trace format.
+static std::string nsToUsStr(std::int64_t ns)
+{
+    return str::format(
+        "{}.{}",
+        ns / 1000,
+        str::justifyRight(str::toStr(ns % 1000), 3, '0'));
+}
+
+
+static void writeEvent(
+    Stream& stream, int tid, const Event& event, bool isFirst)
+{
+    write(stream, isFirst ? "\n" : ",\n");
+
+    write(
+        stream,
+        str::format(
+            "{{\"name\": \"{}\", \"cat\": \"dpso\", \"ph\": \"{}\", "
+            "\"pid\": 1, \"tid\": {}, \"ts\": {}",
+            event.name,
+            event.phase,
+            tid,
+            nsToUsStr(event.timeNs)));
+
+    if (event.phase == 'X')
+        write(
+            stream,
+            str::format(
+                ", \"dur\": {}", nsToUsStr(event.durationNs)));
+
+    if (event.phase == 'b' || event.phase == 'e')
+        write(stream, str::format(", \"id\": {}", event.jobId));
+    else if (event.jobId != Recorder::noJobId)
+        write(
+            stream,
+            str::format(", \"args\": {{\"job\": {}}", event.jobId));
+
+    write(stream, '}');
+}
+
+
+void Recorder::saveJson(std::string_view filePath) const
+{
+    FileStream file{filePath, FileStream::Mode::write};
+
+    write(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+    auto isFirst = true;
+    std::size_t numDroppedEvents{};
+
+    for (const auto& buffer : impl->buffers) {
+        if (!buffer->name.empty()) {
+            write(file, isFirst ? "\n" : ",\n");
+            write(
+                file,
+                str::format(
+                    "{{\"name\": \"thread_name\", \"ph\": \"M\", "
+                    "\"pid\": 1, \"tid\": {}, "
+                    "\"args\": {{\"name\": \"{}\"}}}",
+                    buffer->tid,
+                    str::escapeJsonStr(buffer->name)));
+            isFirst = false;
+        }
+
+        for (const auto& event : buffer->events) {
+            writeEvent(file, buffer->tid, event, isFirst);
+            isFirst = false;
+        }
+
+        numDroppedEvents += buffer->numDroppedEvents;
+    }
+
+    write(
+        file,
+        str::format(
+            "\n], \"otherData\": {{\"numDroppedEvents\": \"{}\"}}}\n",
+            numDroppedEvents));
+}
+
+
+}
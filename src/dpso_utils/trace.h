@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+
+namespace dpso::trace {
+
+
+using Clock = std::chrono::steady_clock;
+
+
+// Recorder of events in the Chrome trace event format, which can be
+// viewed in Perfetto (ui.perfetto.dev) or chrome://tracing.
+//
+// Every thread records events to its own buffer without locking. A
+// lock is only taken when a thread records to a recorder for the
+// first time, and by setThreadName().
+//
+// Event names are not copied, so they should be string literals.
+//
+// saveJson() should only be called when no other thread records
+// events, e.g. after all recording threads are joined.
+class Recorder {
+public:
+    // Id for events that don't belong to a job.
+    static const std::int64_t noJobId{-1};
+
+    Recorder();
+    ~Recorder();
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    Recorder(Recorder&&) = delete;
+    Recorder& operator=(Recorder&&) = delete;
+
+    // The name is shown instead of the numeric thread id. The thread
+    // doesn't have to be the calling one.
+    void setThreadName(std::thread::id threadId, std::string name);
+
+    // Record a span of time on the calling thread.
+    void addSpan(
+        const char* name,
+        Clock::time_point begin,
+        Clock::time_point end,
+        std::int64_t jobId = noJobId);
+
+    // Record the beginning or the end of an asynchronous span, which
+    // can begin and end on different threads. Spans with the same
+    // name are matched by the job id.
+    void addAsyncBegin(const char* name, std::int64_t jobId);
+    void addAsyncEnd(const char* name, std::int64_t jobId);
+
+    // Throws os::Error or StreamError.
+    void saveJson(std::string_view filePath) const;
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+
+// Records a span from the constructor to the destructor. Does nothing
+// if the recorder is null.
+class Span {
+public:
+    Span(
+        Recorder* recorder,
+        const char* name,
+        std::int64_t jobId = Recorder::noJobId)
+        : recorder{recorder}
+        , name{name}
+        , jobId{jobId}
+        , begin{recorder ? Clock::now() : Clock::time_point{}}
+    {
+    }
+
+    ~Span()
+    {
+        if (recorder)
+            recorder->addSpan(name, begin, Clock::now(), jobId);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    Span(Span&&) = delete;
+    Span& operator=(Span&&) = delete;
+private:
+    Recorder* recorder;
+    const char* name;
+    std::int64_t jobId;
+    Clock::time_point begin;
+};
+
+
+}
@@ -1,10 +1,13 @@
 #include "history.h"
 
+#include <algorithm>
+
 #include <QDir>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QScrollBar>
 #include <QStringList>
 #include <QTextEdit>
 #include <QVBoxLayout>
@@ -22,6 +25,12 @@
 namespace ui::qt {
 
 
+// The number of the newest entries to show when the history is
+// opened. Reading all entries at startup would be slow for a large
+// history, especially if old segments are compressed.
+const auto numInitialEntries = 100;
+
+
 History::History(const std::string& dirPath)
 {
     historyFilePath = dirPath + dpsoDirSeparator + uiHistoryFileName;
@@ -31,6 +40,16 @@ History::History(const std::string& dirPath)
     textEdit->setUndoRedoEnabled(false);
     textEdit->setWordWrapMode(QTextOption::WordWrap);
 
+    // rangeChanged is needed for the case when the shown entries
+    // don't fill the viewport, so the scroll bar can't be moved.
+    auto* scrollBar = textEdit->verticalScrollBar();
+    connect(
+        scrollBar, &QScrollBar::valueChanged,
+        this, &History::loadOlderEntriesIfAtTop);
+    connect(
+        scrollBar, &QScrollBar::rangeChanged,
+        this, &History::loadOlderEntriesIfAtTop);
+
     blockFormat.setLineHeight(
         140, QTextBlockFormat::ProportionalHeight);
     blockMargin = QFontMetrics(charFormat.font()).height();
@@ -160,6 +179,7 @@ void History::clear()
         return;
     }
 
+    firstShownIdx = 0;
     textEdit->clear();
     setButtonsEnabled(false);
 }
@@ -179,16 +199,66 @@ void History::append(const char* timestamp, const char* text)
         return;
     }
 
-    appendToTextEdit(timestamp, text);
+    scrollToTextPos(appendToTextEdit(timestamp, text));
 
     setButtonsEnabled(true);
 }
 
 
-void History::appendToTextEdit(
+void History::loadOlderEntriesIfAtTop()
+{
+    if (!history
+            || firstShownIdx == 0
+            || isLoadingOlderEntries)
+        return;
+
+    const auto* scrollBar = textEdit->verticalScrollBar();
+    if (scrollBar->value() > scrollBar->minimum())
+        return;
+
+    // Double the number of shown entries so that the total cost of
+    // rebuilding the text on each load stays linear.
+    const auto numShown =
+        dpsoHistoryCount(history.get()) - firstShownIdx;
+    showEntries(
+        std::max(
+            firstShownIdx - std::max(numShown, numInitialEntries),
+            0),
+        firstShownIdx);
+}
+
+
+void History::showEntries(int firstIdx, int scrollToIdx)
+{
+    isLoadingOlderEntries = true;
+
+    textEdit->clear();
+    firstShownIdx = firstIdx;
+
+    const auto count = dpsoHistoryCount(history.get());
+    int scrollPos{};
+    for (auto i = firstIdx; i < count; ++i) {
+        DpsoHistoryEntry entry;
+        dpsoHistoryGet(history.get(), i, &entry);
+
+        const auto pos = appendToTextEdit(
+            entry.timestamp, entry.text);
+        if (i == scrollToIdx)
+            scrollPos = pos;
+    }
+
+    scrollToTextPos(scrollPos);
+
+    isLoadingOlderEntries = false;
+}
+
+
+// Returns the position of the entry's timestamp.
+int History::appendToTextEdit(
     const char* timestamp, const char* text)
 {
-    auto cursor = textEdit->textCursor();
+    Q_ASSERT(textEdit->document());
+    QTextCursor cursor(textEdit->document());
     cursor.movePosition(QTextCursor::End);
 
     charFormat.setFontWeight(QFont::Bold);
@@ -203,7 +273,6 @@ void History::appendToTextEdit(
         (isRightToLeft() ? Qt::AlignRight : Qt::AlignLeft)
         | Qt::AlignAbsolute);
 
-    Q_ASSERT(textEdit->document());
     if (textEdit->document()->isEmpty()) {
         // An empty document still has a block. Reuse it so that it
         // doesn't result in an empty line.
@@ -218,7 +287,6 @@ void History::appendToTextEdit(
 
     cursor.insertText(timestamp);
 
-    // Remember the position so we can scroll up later.
     cursor.movePosition(QTextCursor::StartOfBlock);
     const auto textBegin = cursor.position();
     cursor.movePosition(QTextCursor::End);
@@ -234,11 +302,19 @@ void History::appendToTextEdit(
     // older versions look pretty.
     cursor.insertText(QString(text).trimmed());
 
-    // We must scroll to the bottom before scrolling to textBegin,
-    // so that textBegin becomes the first line in the viewport
-    // rather than the last.
+    return textBegin;
+}
+
+
+void History::scrollToTextPos(int pos)
+{
+    // We must scroll to the bottom before scrolling to pos, so that
+    // pos becomes the first line in the viewport rather than the
+    // last.
+    auto cursor = textEdit->textCursor();
+    cursor.movePosition(QTextCursor::End);
     textEdit->setTextCursor(cursor);
-    cursor.setPosition(textBegin);
+    cursor.setPosition(pos);
     textEdit->setTextCursor(cursor);
 }
 
@@ -253,12 +329,41 @@ void History::loadState(const DpsoCfg* cfg)
             + "\": "
             + dpsoGetError());
 
-    textEdit->clear();
-    for (int i{}; i < dpsoHistoryCount(history.get()); ++i) {
-        DpsoHistoryEntry entry;
-        dpsoHistoryGet(history.get(), i, &entry);
-        appendToTextEdit(entry.timestamp, entry.text);
-    }
+    // Appending is done on the UI thread, so we sync in the
+    // background to avoid stalls when many texts arrive at once.
+    syncPeriodMs = dpsoCfgGetInt(
+        cfg,
+        cfgKeyHistorySyncPeriodMs,
+        cfgDefaultValueHistorySyncPeriodMs);
+    dpsoHistorySetSyncMode(
+        history.get(),
+        syncPeriodMs == 0
+            ? dpsoHistorySyncModeEachEntry
+            : syncPeriodMs > 0
+                ? dpsoHistorySyncModePeriodic
+                : dpsoHistorySyncModeOnClose,
+        syncPeriodMs);
+
+    segmentMaxSize = dpsoCfgGetInt(
+        cfg,
+        cfgKeyHistorySegmentMaxSize,
+        cfgDefaultValueHistorySegmentMaxSize);
+    segmentMaxEntries = dpsoCfgGetInt(
+        cfg,
+        cfgKeyHistorySegmentMaxEntries,
+        cfgDefaultValueHistorySegmentMaxEntries);
+    compressSegments = dpsoCfgGetBool(
+        cfg,
+        cfgKeyHistoryCompressSegments,
+        cfgDefaultValueHistoryCompressSegments);
+    dpsoHistorySetRotation(
+        history.get(),
+        std::max(segmentMaxSize, 0),
+        std::max(segmentMaxEntries, 0),
+        compressSegments);
+
+    const auto count = dpsoHistoryCount(history.get());
+    showEntries(std::max(count - numInitialEntries, 0), count - 1);
 
     wrapWords = dpsoCfgGetBool(
         cfg, cfgKeyHistoryWrapWords, cfgDefaultValueHistoryWrapWords);
@@ -273,6 +378,12 @@ void History::loadState(const DpsoCfg* cfg)
 
 void History::saveState(DpsoCfg* cfg) const
 {
+    dpsoCfgSetBool(
+        cfg, cfgKeyHistoryCompressSegments, compressSegments);
+    dpsoCfgSetInt(
+        cfg, cfgKeyHistorySegmentMaxEntries, segmentMaxEntries);
+    dpsoCfgSetInt(cfg, cfgKeyHistorySegmentMaxSize, segmentMaxSize);
+    dpsoCfgSetInt(cfg, cfgKeyHistorySyncPeriodMs, syncPeriodMs);
     dpsoCfgSetBool(cfg, cfgKeyHistoryWrapWords, wrapWords);
     dpsoCfgSetStr(
         cfg, cfgKeyHistoryExportDir, lastDirPath.toUtf8().data());
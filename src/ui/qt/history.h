@@ -33,6 +33,15 @@ private:
     dpso::HistoryUPtr history;
 
     bool wrapWords{};
+    int syncPeriodMs{};
+    int segmentMaxSize{};
+    int segmentMaxEntries{};
+    bool compressSegments{};
+
+    // Only the newest entries are shown initially; older ones are
+    // loaded when the text edit is scrolled to the top.
+    int firstShownIdx{};
+    bool isLoadingOlderEntries{};
 
     QTextEdit* textEdit;
     QTextCharFormat charFormat;
@@ -47,7 +56,10 @@ private:
     QString selectedNameFilter;
 
     void setButtonsEnabled(bool enabled);
-    void appendToTextEdit(const char* timestamp, const char* text);
+    void loadOlderEntriesIfAtTop();
+    void showEntries(int firstIdx, int scrollToIdx);
+    int appendToTextEdit(const char* timestamp, const char* text);
+    void scrollToTextPos(int pos);
 };
 
 
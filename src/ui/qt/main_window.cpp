@@ -17,10 +17,12 @@
 #include <QPushButton>
 #include <QSessionManager>
 #include <QSignalBlocker>
+#include <QSocketNotifier>
 #include <QStringList>
 #include <QStyle>
 #include <QSystemTrayIcon>
 #include <QTabWidget>
+#include <QTimer>
 #include <QTimerEvent>
 #include <QToolButton>
 #include <QVBoxLayout>
@@ -143,7 +145,26 @@ MainWindow::MainWindow(const UiStartupArgs& startupArgs)
     else
         showMinimized();
 
-    updateTimerId = startTimer(1000 / 60);
+    // The notifiers let us react to hotkeys, OCR progress, and
+    // results as soon as they are available rather than on the next
+    // tick of the timer, and to not wake up at all when idle.
+    if (const auto fd = dpsoSysGetEventFd(sys.get()); fd != -1) {
+        sysNotifier = std::make_unique<QSocketNotifier>(
+            fd, QSocketNotifier::Read);
+        connect(
+            sysNotifier.get(), &QSocketNotifier::activated,
+            this, &MainWindow::processSysEvents);
+    }
+
+    if (const auto fd = dpsoOcrGetNotifyFd(ocr.get()); fd != -1) {
+        ocrNotifier = std::make_unique<QSocketNotifier>(
+            fd, QSocketNotifier::Read);
+        connect(
+            ocrNotifier.get(), &QSocketNotifier::activated,
+            this, &MainWindow::processOcrUpdates);
+    }
+
+    updateTimerState();
 
     // See comments in commitData().
     #if QT_VERSION < QT_VERSION_CHECK(6, 0, 0)
@@ -166,16 +187,35 @@ MainWindow::MainWindow(const UiStartupArgs& startupArgs)
 
 void MainWindow::timerEvent(QTimerEvent* /*event*/)
 {
-    dpsoSysUpdate(sys.get());
+    updateSys();
+}
 
-    // The selection doesn't block keyboard and mouse interaction, so
-    // disable it once it no longer makes sense.
-    if (dpsoSelectionGetIsEnabled(selection) && !canStartSelection())
-        setSelectionIsEnabled(false);
+
+void MainWindow::processOcrUpdates()
+{
+    dpsoOcrClearNotifyFd(ocr.get());
 
     updateStatus();
     checkResults();
-    checkHotkeyActions();
+
+    // updateStatus() keeps the progress status till the results are
+    // processed. Without the timer, there will be no other chance to
+    // replace it.
+    if (!updateTimerId)
+        updateStatus();
+}
+
+
+void MainWindow::processSysEvents()
+{
+    updateSys();
+
+    // Handling a hotkey can wait for replies from the system (e.g.,
+    // when taking a screenshot), and new events read meanwhile
+    // don't make the descriptor readable. See dpsoSysGetEventFd().
+    if (dpsoKeyManagerGetLastHotkeyAction(keyManager)
+            != dpsoNoHotkeyAction)
+        QTimer::singleShot(0, this, &MainWindow::processSysEvents);
 }
 
 
@@ -207,7 +247,12 @@ void MainWindow::closeEvent(QCloseEvent* event)
         return;
     }
 
-    killTimer(updateTimerId);
+    if (updateTimerId)
+        killTimer(updateTimerId);
+    if (sysNotifier)
+        sysNotifier->setEnabled(false);
+    if (ocrNotifier)
+        ocrNotifier->setEnabled(false);
 
     saveState(cfg.get());
 
@@ -266,6 +311,10 @@ void MainWindow::openLangManager()
 void MainWindow::invalidateStatus()
 {
     statusValid = false;
+
+    // Without the timer, nothing else would update the status.
+    if (!updateTimerId)
+        QTimer::singleShot(0, this, &MainWindow::updateStatus);
 }
 
 
@@ -985,6 +1034,7 @@ void MainWindow::setSelectionIsEnabled(bool isEnabled)
 {
     dpsoSelectionSetIsEnabled(selection, isEnabled);
     invalidateStatus();
+    updateTimerState();
 
     if (!isEnabled) {
         dpsoKeyManagerUnbindAction(
@@ -1006,6 +1056,40 @@ void MainWindow::setSelectionIsEnabled(bool isEnabled)
 }
 
 
+// The timer is only needed if we can't wait for system events and
+// OCR updates on their descriptors, or while the selection is
+// enabled, since it follows the mouse cursor by polling.
+void MainWindow::updateTimerState()
+{
+    const auto needTimer =
+        !sysNotifier
+        || !ocrNotifier
+        || dpsoSelectionGetIsEnabled(selection);
+
+    if (needTimer && !updateTimerId)
+        updateTimerId = startTimer(1000 / 60);
+    else if (!needTimer && updateTimerId) {
+        killTimer(updateTimerId);
+        updateTimerId = 0;
+    }
+}
+
+
+void MainWindow::updateSys()
+{
+    dpsoSysUpdate(sys.get());
+
+    // The selection doesn't block keyboard and mouse interaction, so
+    // disable it once it no longer makes sense.
+    if (dpsoSelectionGetIsEnabled(selection) && !canStartSelection())
+        setSelectionIsEnabled(false);
+
+    updateStatus();
+    checkResults();
+    checkHotkeyActions();
+}
+
+
 void MainWindow::setStatus(Status newStatus, const QString& text)
 {
     const auto title = newStatus == Status::ok
@@ -1189,7 +1273,7 @@ void MainWindow::checkHotkeyActions()
             break;
 
         auto* screenshot = dpsoTakeScreenshot(
-            sys.get(), &selectionRect);
+            sys.get(), &selectionRect, DpsoPxFormatGrayscale);
         if (!screenshot) {
             QMessageBox::warning(
                 this,
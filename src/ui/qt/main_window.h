@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 
@@ -21,6 +22,7 @@ class QLabel;
 class QLineEdit;
 class QPushButton;
 class QSessionManager;
+class QSocketNotifier;
 class QSystemTrayIcon;
 class QTabWidget;
 
@@ -49,14 +51,23 @@ private slots:
     void invalidateStatus();
     void setVisibility(bool vilible);
     void commitData(QSessionManager& sessionManager);
+    void processOcrUpdates();
+    void processSysEvents();
 private:
     dpso::SysUPtr sys;
     DpsoKeyManager* keyManager;
     DpsoSelection* selection;
+    // Null if dpsoSysGetEventFd() is not available, in which case
+    // system events are only processed by the timer.
+    std::unique_ptr<QSocketNotifier> sysNotifier;
 
     std::string progressStatusFmt;
 
     dpso::OcrUPtr ocr;
+    // Null if dpsoOcrGetNotifyFd() is not available, in which case
+    // OCR updates are only checked by the timer. Declared after ocr
+    // so that it's destroyed while the descriptor is still valid.
+    std::unique_ptr<QSocketNotifier> ocrNotifier;
 
     std::string cfgDirPath;
     std::string cfgFilePath;
@@ -138,6 +149,9 @@ private:
     bool canStartSelection() const;
     void setSelectionIsEnabled(bool isEnabled);
 
+    void updateTimerState();
+    void updateSys();
+
     void setStatus(Status newStatus, const QString& text);
     void updateStatus();
     void checkResults();
@@ -15,6 +15,14 @@ bool const cfgDefaultValueActionsDonePlaySound =
     false;
 bool const cfgDefaultValueActionsDonePlaySoundCustom =
     false;
+bool const cfgDefaultValueHistoryCompressSegments =
+    true;
+int const cfgDefaultValueHistorySegmentMaxEntries =
+    0;
+int const cfgDefaultValueHistorySegmentMaxSize =
+    4194304;
+int const cfgDefaultValueHistorySyncPeriodMs =
+    1000;
 bool const cfgDefaultValueHistoryWrapWords =
     true;
 DpsoHotkey const cfgDefaultValueHotkeyCancelSelection =
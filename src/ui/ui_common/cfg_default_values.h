@@ -18,6 +18,10 @@ extern const char* const cfgDefaultValueActionCopyToClipboardTextSeparator;
 extern bool const cfgDefaultValueActionRunExecutable;
 extern bool const cfgDefaultValueActionsDonePlaySound;
 extern bool const cfgDefaultValueActionsDonePlaySoundCustom;
+extern bool const cfgDefaultValueHistoryCompressSegments;
+extern int const cfgDefaultValueHistorySegmentMaxEntries;
+extern int const cfgDefaultValueHistorySegmentMaxSize;
+extern int const cfgDefaultValueHistorySyncPeriodMs;
 extern bool const cfgDefaultValueHistoryWrapWords;
 extern DpsoHotkey const cfgDefaultValueHotkeyCancelSelection;
 extern DpsoHotkey const cfgDefaultValueHotkeyToggleSelection;
@@ -19,8 +19,16 @@ const char* const cfgKeyActionsDonePlaySoundCustom =
     "actions_done_play_sound_custom";
 const char* const cfgKeyActionsDonePlaySoundCustomPath =
     "actions_done_play_sound_custom_path";
+const char* const cfgKeyHistoryCompressSegments =
+    "history_compress_segments";
 const char* const cfgKeyHistoryExportDir =
     "history_export_dir";
+const char* const cfgKeyHistorySegmentMaxEntries =
+    "history_segment_max_entries";
+const char* const cfgKeyHistorySegmentMaxSize =
+    "history_segment_max_size";
+const char* const cfgKeyHistorySyncPeriodMs =
+    "history_sync_period_ms";
 const char* const cfgKeyHistoryWrapWords =
     "history_wrap_words";
 const char* const cfgKeyHotkeyCancelSelection =
@@ -16,7 +16,11 @@ extern const char* const cfgKeyActionRunExecutablePath;
 extern const char* const cfgKeyActionsDonePlaySound;
 extern const char* const cfgKeyActionsDonePlaySoundCustom;
 extern const char* const cfgKeyActionsDonePlaySoundCustomPath;
+extern const char* const cfgKeyHistoryCompressSegments;
 extern const char* const cfgKeyHistoryExportDir;
+extern const char* const cfgKeyHistorySegmentMaxEntries;
+extern const char* const cfgKeyHistorySegmentMaxSize;
+extern const char* const cfgKeyHistorySyncPeriodMs;
 extern const char* const cfgKeyHistoryWrapWords;
 extern const char* const cfgKeyHotkeyCancelSelection;
 extern const char* const cfgKeyHotkeyToggleSelection;
@@ -1,13 +1,17 @@
 #include "cmdline.h"
 
 #include <cstdlib>
+#include <initializer_list>
 #include <string_view>
+#include <utility>
 
 #include "dpso_utils/error_get.h"
 #include "dpso_utils/str_stdio.h"
 
 #include "app_info.h"
 #include "cmdline_cmd_autostart.h"
+#include "cmdline_cmd_ocr_files.h"
+#include "cmdline_cmd_watch_region.h"
 #include "cmdline_opts.h"
 #include "toplevel_argv0.h"
 
@@ -23,7 +27,10 @@ static void printHelp(std::string_view argv0)
     str::print("{} {}\n\n", uiAppName, uiAppVersion);
     str::print("Usage\n");
     str::print("    {} [options...]\n", argv0);
-    str::print("    {} command action\n\n", argv0);
+    str::print("    {} command action\n", argv0);
+    str::print("    {} ocr-files [options...] path...\n", argv0);
+    str::print(
+        "    {} watch-region -rect X,Y,W,H [options...]\n\n", argv0);
 
     str::print(
         "Options\n"
@@ -54,7 +61,53 @@ static void printHelp(std::string_view argv0)
         "            Disable autostart.\n"
         "        query\n"
         "            Print \"on\" or \"off\" depending on whether\n"
-        "            autostart is enabled.\n",
+        "            autostart is enabled.\n"
+        "\n"
+        "  ocr-files\n"
+        "      Recognize binary PGM and PPM images without showing\n"
+        "      the window. Each path is either a file, a directory\n"
+        "      to be searched recursively for .pgm, .ppm, and .pnm\n"
+        "      files, or a file name pattern with * and ?\n"
+        "      wildcards. Results are printed to stdout in the\n"
+        "      JSON Lines format, one {{\"file\", \"timestamp\",\n"
+        "      \"text\"}} object per image, and the throughput is\n"
+        "      printed to stderr. The languages and the text\n"
+        "      segmentation setting are taken from the program\n"
+        "      configuration.\n"
+        "\n"
+        "      Options\n"
+        "        -lang CODE\n"
+        "            Use the language instead of the configured\n"
+        "            ones. Can be given several times.\n"
+        "        -history\n"
+        "            Append the results to the history instead of\n"
+        "            printing them. The program should not be\n"
+        "            running at the same time.\n"
+        "\n"
+        "  watch-region\n"
+        "      Recognize the screen region whenever its contents\n"
+        "      change, till interrupted with Ctrl+C. The region is\n"
+        "      given in screen pixels. A new screenshot is only\n"
+        "      recognized if its pixels differ from the previous\n"
+        "      one. Results are printed to stdout in the JSON Lines\n"
+        "      format, one {{\"timestamp\", \"text\"}} object per\n"
+        "      change. The languages and the text segmentation\n"
+        "      setting are taken from the program configuration.\n"
+        "\n"
+        "      Options\n"
+        "        -rect X,Y,W,H\n"
+        "            The region to watch.\n"
+        "        -interval MS\n"
+        "            The minimum interval between screenshots in\n"
+        "            milliseconds; faster changes are coalesced.\n"
+        "            The default is 1000.\n"
+        "        -lang CODE\n"
+        "            Use the language instead of the configured\n"
+        "            ones. Can be given several times.\n"
+        "        -history\n"
+        "            Append the results to the history instead of\n"
+        "            printing them. The program should not be\n"
+        "            running at the same time.\n",
         cmdLineOptHide);
 }
 
@@ -74,6 +127,21 @@ void processCmdLine(
 
         const std::string_view cmdName{argv[1]};
 
+        // Unlike others, these commands take a variable number of
+        // arguments.
+        for (const auto& [name, fn] : {
+                    std::pair{"ocr-files", cmdLineCmdOcrFiles},
+                    std::pair{"watch-region", cmdLineCmdWatchRegion}}) {
+            if (name != cmdName)
+                continue;
+
+            if (fn(argc, argv))
+                std::exit(EXIT_SUCCESS);
+
+            str::print(stderr, "{}.\n", dpsoGetError());
+            std::exit(EXIT_FAILURE);
+        }
+
         for (const auto& cmd : commands) {
             if (cmd.name != cmdName)
                 continue;
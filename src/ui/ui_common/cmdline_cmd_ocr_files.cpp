@@ -0,0 +1,338 @@
+#include "cmdline_cmd_ocr_files.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#include "dpso_ext/dpso_ext.h"
+#include "dpso_img/pnm.h"
+#include "dpso_utils/error_get.h"
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/str.h"
+#include "dpso_utils/str_stdio.h"
+
+#include "cmdline_ocr_common.h"
+
+
+namespace fs = std::filesystem;
+using namespace dpso;
+
+
+namespace ui {
+namespace {
+
+
+struct Options {
+    std::vector<std::string> langCodes;
+    bool toHistory;
+    std::vector<std::string> paths;
+};
+
+
+bool parseArgs(int argc, char* argv[], Options& options)
+{
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+
+        if (arg.empty() || arg[0] != '-')
+            options.paths.emplace_back(arg);
+        else if (arg == "-history")
+            options.toHistory = true;
+        else if (arg == "-lang") {
+            if (i + 1 == argc) {
+                setError("Option \"{}\" requires a value", arg);
+                return false;
+            }
+
+            options.langCodes.emplace_back(argv[++i]);
+        } else {
+            setError("Unknown option \"{}\"", arg);
+            return false;
+        }
+    }
+
+    if (options.paths.empty()) {
+        setError("No files given");
+        return false;
+    }
+
+    return true;
+}
+
+
+bool isImageFile(const fs::path& path)
+{
+    const auto ext = path.extension().u8string();
+    for (const auto* imageExt : {".pgm", ".ppm", ".pnm"})
+        if (str::equalIgnoreCase(ext, imageExt))
+            return true;
+
+    return false;
+}
+
+
+// Match a file name against a pattern with * and ? wildcards.
+bool matchWildcard(std::string_view pattern, std::string_view name)
+{
+    std::size_t p{};
+    std::size_t n{};
+    // Position after the last *, and the name position it matched.
+    auto starP = std::string_view::npos;
+    std::size_t starN{};
+
+    while (n < name.size())
+        if (p < pattern.size()
+                && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            starP = ++p;
+            starN = n;
+        } else if (starP != std::string_view::npos) {
+            p = starP;
+            n = ++starN;
+        } else
+            return false;
+
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+
+    return p == pattern.size();
+}
+
+
+// Expand the path to a sorted list of files. Directories are searched
+// recursively for PNM images, and * and ? wildcards in the last path
+// component match any files in the parent directory; the latter is
+// useful on Windows, where the shell doesn't expand wildcards. Other
+// paths are taken as is.
+bool collectFiles(
+    std::string_view pathStr, std::vector<std::string>& files)
+{
+    const auto path = fs::u8path(pathStr);
+    const auto fileName = path.filename().u8string();
+
+    std::vector<std::string> result;
+    std::error_code ec;
+
+    if (fileName.find_first_of("*?") != fileName.npos) {
+        auto dirPath = path.parent_path();
+        if (dirPath.empty())
+            dirPath = ".";
+
+        for (fs::directory_iterator iter{dirPath, ec}, end;
+                !ec && iter != end;
+                iter.increment(ec))
+            if (iter->is_regular_file(ec)
+                    && matchWildcard(
+                        fileName,
+                        iter->path().filename().u8string()))
+                result.push_back(iter->path().u8string());
+    } else if (fs::is_directory(path, ec)) {
+        for (fs::recursive_directory_iterator iter{path, ec}, end;
+                !ec && iter != end;
+                iter.increment(ec))
+            if (iter->is_regular_file(ec)
+                    && isImageFile(iter->path()))
+                result.push_back(iter->path().u8string());
+    } else
+        result.emplace_back(pathStr);
+
+    if (ec) {
+        setError("Can't list \"{}\": {}", pathStr, ec.message());
+        return false;
+    }
+
+    std::sort(result.begin(), result.end());
+    files.insert(files.end(), result.begin(), result.end());
+    return true;
+}
+
+
+struct Ctx {
+    DpsoOcr* ocr;
+    DpsoOcrJobFlags jobFlags;
+    // Null to print results to stdout.
+    DpsoHistory* history;
+};
+
+
+struct Stats {
+    int numFiles;
+    int numFailedFiles;
+    std::int64_t numPixels;
+};
+
+
+bool publishResult(
+    const Ctx& ctx,
+    const std::string& filePath,
+    const DpsoOcrJobResult& result)
+{
+    if (ctx.history)
+        return appendToHistory(ctx.history, result);
+
+    str::print(
+        "{{\"file\": \"{}\", \"timestamp\": \"{}\", "
+        "\"text\": \"{}\"}\n",
+        str::escapeJsonStr(filePath),
+        str::escapeJsonStr(result.timestamp),
+        str::escapeJsonStr(result.text));
+    return true;
+}
+
+
+// Wait till the OCR has updates, or for a short time if waiting is
+// not supported.
+void waitForOcr(DpsoOcr* ocr)
+{
+    #ifndef _WIN32
+    pollfd pfd{dpsoOcrGetNotifyFd(ocr), POLLIN, 0};
+    if (pfd.fd != -1) {
+        poll(&pfd, 1, -1);
+        dpsoOcrClearNotifyFd(ocr);
+        return;
+    }
+    #endif
+
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+}
+
+
+// Images are loaded as jobs are queued, with a limited number of jobs
+// in flight, so that the memory use doesn't depend on the number of
+// files. The limit is a multiple of the number of workers to keep
+// them busy while the main thread loads images and prints results.
+bool processFiles(
+    const Ctx& ctx,
+    const std::vector<std::string>& filePaths,
+    Stats& stats)
+{
+    const auto maxJobsInFlight = std::max(
+        2u, std::thread::hardware_concurrency() * 2);
+
+    // Results come in the queue order.
+    std::deque<const std::string*> jobFilePaths;
+
+    auto iter = filePaths.begin();
+    while (true) {
+        while (iter != filePaths.end()
+                && jobFilePaths.size() < maxJobsInFlight) {
+            const auto& filePath = *iter++;
+
+            auto img = img::loadPnm(filePath);
+            if (!img) {
+                str::print(
+                    stderr,
+                    "Can't load \"{}\": {}.\n",
+                    filePath, dpsoGetError());
+                ++stats.numFailedFiles;
+                continue;
+            }
+
+            stats.numPixels +=
+                static_cast<std::int64_t>(dpsoImgGetWidth(img.get()))
+                * dpsoImgGetHeight(img.get());
+
+            auto* imgPtr = img.release();
+            if (!dpsoOcrQueueJob(ctx.ocr, &imgPtr, ctx.jobFlags)) {
+                setError("Can't queue OCR job: {}", dpsoGetError());
+                return false;
+            }
+
+            jobFilePaths.push_back(&filePath);
+        }
+
+        if (jobFilePaths.empty())
+            break;
+
+        waitForOcr(ctx.ocr);
+
+        DpsoOcrJobResult result;
+        while (dpsoOcrGetResult(ctx.ocr, &result)) {
+            if (!publishResult(ctx, *jobFilePaths.front(), result))
+                return false;
+
+            jobFilePaths.pop_front();
+            ++stats.numFiles;
+        }
+    }
+
+    return true;
+}
+
+
+}
+
+
+bool cmdLineCmdOcrFiles(int argc, char* argv[])
+{
+    Options options{};
+    if (!parseArgs(argc, argv, options))
+        return false;
+
+    CmdLineOcrCtx ocrCtx;
+    if (!initCmdLineOcr(
+            argc, argv, options.langCodes, options.toHistory, ocrCtx))
+        return false;
+
+    // Results can come faster than the history file can be synced,
+    // so sync only once at the end.
+    if (ocrCtx.history)
+        dpsoHistorySetSyncMode(
+            ocrCtx.history.get(), dpsoHistorySyncModeOnClose, 0);
+
+    std::vector<std::string> filePaths;
+    for (const auto& path : options.paths)
+        if (!collectFiles(path, filePaths))
+            return false;
+
+    const Ctx ctx{
+        ocrCtx.ocr.get(), ocrCtx.jobFlags, ocrCtx.history.get()};
+
+    Stats stats{};
+
+    const auto startTime = std::chrono::steady_clock::now();
+    const auto ok = processFiles(ctx, filePaths, stats);
+    const std::chrono::duration<double> duration{
+        std::chrono::steady_clock::now() - startTime};
+
+    str::print(
+        stderr,
+        "Recognized {} files ({} Mpx) in {} s: {} files/s.\n",
+        stats.numFiles,
+        stats.numPixels / 1e6,
+        duration.count(),
+        duration.count() > 0 ? stats.numFiles / duration.count() : 0);
+
+    if (!ok)
+        return false;
+
+    if (ocrCtx.history && !dpsoHistoryFlush(ocrCtx.history.get())) {
+        setError("Can't write history: {}", dpsoGetError());
+        return false;
+    }
+
+    if (stats.numFailedFiles > 0) {
+        setError(
+            "{} of {} files could not be loaded",
+            stats.numFailedFiles,
+            filePaths.size());
+        return false;
+    }
+
+    return true;
+}
+
+
+}
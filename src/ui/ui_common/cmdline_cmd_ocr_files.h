@@ -0,0 +1,15 @@
+#pragma once
+
+
+namespace ui {
+
+
+// Recognize image files without the GUI. argv is the full command
+// line, with the command name at argv[1]; arguments start at argv[2].
+//
+// On failure, sets an error message (dpsoGetError()) and returns
+// false.
+bool cmdLineCmdOcrFiles(int argc, char* argv[]);
+
+
+}
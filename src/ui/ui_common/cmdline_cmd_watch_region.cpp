@@ -0,0 +1,254 @@
+#include "cmdline_cmd_watch_region.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <poll.h>
+#endif
+
+#include "dpso_sys/dpso_sys.h"
+#include "dpso_utils/error_get.h"
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/str.h"
+#include "dpso_utils/str_stdio.h"
+
+#include "cmdline_ocr_common.h"
+
+
+using namespace dpso;
+
+
+namespace ui {
+namespace {
+
+
+struct Options {
+    DpsoRect rect;
+    int minIntervalMs;
+    std::vector<std::string> langCodes;
+    bool toHistory;
+};
+
+
+// Parse "X,Y,W,H".
+bool parseRect(std::string_view s, DpsoRect& rect)
+{
+    int* const values[]{&rect.x, &rect.y, &rect.w, &rect.h};
+
+    const auto* iter = s.data();
+    const auto* end = s.data() + s.size();
+
+    for (std::size_t i{}; i < std::size(values); ++i) {
+        if (i > 0) {
+            if (iter == end || *iter != ',')
+                return false;
+
+            ++iter;
+        }
+
+        const auto [ptr, ec] = std::from_chars(iter, end, *values[i]);
+        if (ec != std::errc{})
+            return false;
+
+        iter = ptr;
+    }
+
+    return iter == end && rect.w > 0 && rect.h > 0;
+}
+
+
+bool parseArgs(int argc, char* argv[], Options& options)
+{
+    auto hasRect = false;
+
+    for (int i = 2; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+
+        if (arg == "-history") {
+            options.toHistory = true;
+            continue;
+        }
+
+        if (arg != "-rect" && arg != "-interval" && arg != "-lang") {
+            setError("Unknown option \"{}\"", arg);
+            return false;
+        }
+
+        if (i + 1 == argc) {
+            setError("Option \"{}\" requires a value", arg);
+            return false;
+        }
+
+        const std::string_view value{argv[++i]};
+
+        if (arg == "-rect") {
+            if (!parseRect(value, options.rect)) {
+                setError("Invalid rect \"{}\"", value);
+                return false;
+            }
+
+            hasRect = true;
+        } else if (arg == "-interval") {
+            const auto [ptr, ec] = std::from_chars(
+                value.data(),
+                value.data() + value.size(),
+                options.minIntervalMs);
+            if (ec != std::errc{}
+                    || ptr != value.data() + value.size()
+                    || options.minIntervalMs < 0) {
+                setError("Invalid interval \"{}\"", value);
+                return false;
+            }
+        } else
+            options.langCodes.emplace_back(value);
+    }
+
+    if (!hasRect) {
+        setError("No rect given");
+        return false;
+    }
+
+    return true;
+}
+
+
+volatile std::sig_atomic_t interrupted;
+
+
+void handleSignal(int /*signum*/)
+{
+    interrupted = 1;
+}
+
+
+// Wait till the system or the OCR has updates, or the timeout
+// expires. Without the descriptors, dpsoSysUpdate() has to be
+// called periodically, so the wait is limited to a short time.
+void waitForUpdates(DpsoSys* sys, DpsoOcr* ocr, int timeoutMs)
+{
+    #ifndef _WIN32
+    pollfd pfds[2]{
+        {dpsoSysGetEventFd(sys), POLLIN, 0},
+        {dpsoOcrGetNotifyFd(ocr), POLLIN, 0},
+    };
+
+    if (pfds[0].fd != -1 && pfds[1].fd != -1) {
+        poll(pfds, 2, timeoutMs);
+        dpsoOcrClearNotifyFd(ocr);
+        return;
+    }
+    #else
+    (void)sys;
+    (void)ocr;
+    #endif
+
+    const auto maxTimeoutMs = 1000 / 60;
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds{
+            timeoutMs == -1
+                ? maxTimeoutMs : std::min(timeoutMs, maxTimeoutMs)});
+}
+
+
+bool publishResult(
+    DpsoHistory* history, const DpsoOcrJobResult& result)
+{
+    if (history)
+        return appendToHistory(history, result);
+
+    str::print(
+        "{{\"timestamp\": \"{}\", \"text\": \"{}\"}\n",
+        str::escapeJsonStr(result.timestamp),
+        str::escapeJsonStr(result.text));
+    std::fflush(stdout);
+    return true;
+}
+
+
+}
+
+
+bool cmdLineCmdWatchRegion(int argc, char* argv[])
+{
+    Options options{};
+    options.minIntervalMs = 1000;
+    if (!parseArgs(argc, argv, options))
+        return false;
+
+    CmdLineOcrCtx ocrCtx;
+    if (!initCmdLineOcr(
+            argc, argv, options.langCodes, options.toHistory, ocrCtx))
+        return false;
+
+    SysUPtr sys{dpsoSysCreate()};
+    if (!sys) {
+        setError("Can't create system backend: {}", dpsoGetError());
+        return false;
+    }
+
+    ScreenWatchUPtr watch{
+        dpsoScreenWatchCreate(
+            sys.get(), &options.rect, options.minIntervalMs)};
+    if (!watch) {
+        setError("Can't create screen watch: {}", dpsoGetError());
+        return false;
+    }
+
+    auto* ocr = ocrCtx.ocr.get();
+
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+
+    while (!interrupted) {
+        dpsoSysUpdate(sys.get());
+
+        DpsoOcrJobResult result;
+        while (dpsoOcrGetResult(ocr, &result))
+            if (!publishResult(ocrCtx.history.get(), result))
+                return false;
+
+        // Don't capture while the previous screenshot is still being
+        // recognized: changes made meanwhile are coalesced into the
+        // next capture, so the OCR never lags behind the screen.
+        const auto ocrIsBusy = dpsoOcrHasPendingResults(ocr);
+
+        if (!ocrIsBusy) {
+            DpsoImg* img;
+            if (!dpsoScreenWatchGetChange(
+                    watch.get(), DpsoPxFormatGrayscale, &img))
+                // Most likely the region is temporarily outside the
+                // screen, e.g. after changing the resolution.
+                str::print(
+                    stderr,
+                    "Can't capture the region: {}.\n",
+                    dpsoGetError());
+            else if (img
+                    && !dpsoOcrQueueJob(ocr, &img, ocrCtx.jobFlags)) {
+                setError("Can't queue OCR job: {}", dpsoGetError());
+                return false;
+            }
+
+            // Taking a screenshot waits for replies from the system,
+            // so new events may have been read without making the
+            // descriptor readable. See dpsoSysGetEventFd().
+            dpsoSysUpdate(sys.get());
+        }
+
+        const auto timeoutMs =
+            ocrIsBusy ? -1 : dpsoScreenWatchGetTimeoutMs(watch.get());
+        waitForUpdates(sys.get(), ocr, timeoutMs);
+    }
+
+    return true;
+}
+
+
+}
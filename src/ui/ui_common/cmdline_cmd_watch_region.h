@@ -0,0 +1,16 @@
+#pragma once
+
+
+namespace ui {
+
+
+// Recognize a screen region whenever its contents change, till
+// interrupted. argv is the full command line, with the command name
+// at argv[1]; arguments start at argv[2].
+//
+// On failure, sets an error message (dpsoGetError()) and returns
+// false.
+bool cmdLineCmdWatchRegion(int argc, char* argv[]);
+
+
+}
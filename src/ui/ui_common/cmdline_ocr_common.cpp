@@ -0,0 +1,199 @@
+#include "cmdline_ocr_common.h"
+
+#include <algorithm>
+
+#include "dpso_utils/error_get.h"
+#include "dpso_utils/error_set.h"
+#include "dpso_utils/os.h"
+#include "dpso_utils/os_error.h"
+#include "dpso_utils/str.h"
+
+#include "cfg_default_values.h"
+#include "cfg_keys.h"
+#include "exe_path.h"
+#include "file_names.h"
+#include "init_extra.h"
+#include "ocr_default.h"
+
+
+using namespace dpso;
+
+
+namespace ui {
+namespace {
+
+
+std::string getCfgDirPath()
+{
+    const auto* cfgPath = dpsoGetUserDir(DpsoUserDirConfig);
+    if (!cfgPath) {
+        setError("Can't get configuration dir: {}", dpsoGetError());
+        return {};
+    }
+
+    return os::joinPath({cfgPath, uiAppFileName});
+}
+
+
+bool activateLangs(
+    DpsoOcr* ocr,
+    const DpsoCfg* cfg,
+    const std::vector<std::string>& langCodes)
+{
+    if (langCodes.empty())
+        dpsoCfgLoadActiveLangs(
+            cfg,
+            cfgKeyOcrLanguages,
+            ocr,
+            dpsoOcrGetNumLangs(ocr) == 1
+                ? dpsoOcrGetLangCode(ocr, 0)
+                : dpsoOcrGetDefaultLangCode(ocr));
+
+    for (const auto& langCode : langCodes) {
+        const auto langIdx = dpsoOcrGetLangIdx(ocr, langCode.c_str());
+        if (langIdx == -1) {
+            setError("Language \"{}\" is not available", langCode);
+            return false;
+        }
+
+        dpsoOcrSetLangIsActive(ocr, langIdx, true);
+    }
+
+    if (dpsoOcrGetNumActiveLangs(ocr) == 0) {
+        setError("No active languages");
+        return false;
+    }
+
+    return true;
+}
+
+
+bool openHistory(
+    const std::string& cfgDirPath,
+    const DpsoCfg* cfg,
+    HistoryUPtr& history)
+{
+    const auto historyFilePath = os::joinPath(
+        {cfgDirPath, uiHistoryFileName});
+
+    try {
+        os::makeDirs(cfgDirPath);
+    } catch (os::Error& e) {
+        setError("Can't create \"{}\": {}", cfgDirPath, e.what());
+        return false;
+    }
+
+    history.reset(dpsoHistoryOpen(historyFilePath.c_str()));
+    if (!history) {
+        setError(
+            "Can't open \"{}\": {}",
+            historyFilePath, dpsoGetError());
+        return false;
+    }
+
+    dpsoHistorySetRotation(
+        history.get(),
+        std::max(
+            dpsoCfgGetInt(
+                cfg,
+                cfgKeyHistorySegmentMaxSize,
+                cfgDefaultValueHistorySegmentMaxSize),
+            0),
+        std::max(
+            dpsoCfgGetInt(
+                cfg,
+                cfgKeyHistorySegmentMaxEntries,
+                cfgDefaultValueHistorySegmentMaxEntries),
+            0),
+        dpsoCfgGetBool(
+            cfg,
+            cfgKeyHistoryCompressSegments,
+            cfgDefaultValueHistoryCompressSegments));
+
+    return true;
+}
+
+
+}
+
+
+bool initCmdLineOcr(
+    int argc,
+    char* argv[],
+    const std::vector<std::string>& langCodes,
+    bool needHistory,
+    CmdLineOcrCtx& ctx)
+{
+    // Tesseract may need the environment set up by initStart(), and
+    // dpsoOcrCreateDefault() uses the exe path.
+    if (!initStart(argc, argv)) {
+        setError("ui::initStart(): {}", dpsoGetError());
+        return false;
+    }
+
+    if (!initExePath(argv[0])) {
+        setError("ui::initExePath(): {}", dpsoGetError());
+        return false;
+    }
+
+    const auto cfgDirPath = getCfgDirPath();
+    if (cfgDirPath.empty())
+        return false;
+
+    ctx.cfg.reset(dpsoCfgCreate());
+    if (!ctx.cfg) {
+        setError("Can't create Cfg: {}", dpsoGetError());
+        return false;
+    }
+
+    const auto cfgFilePath = os::joinPath(
+        {cfgDirPath, uiCfgFileName});
+    if (!dpsoCfgLoad(ctx.cfg.get(), cfgFilePath.c_str())) {
+        setError(
+            "Can't load \"{}\": {}", cfgFilePath, dpsoGetError());
+        return false;
+    }
+
+    if (dpsoOcrGetNumEngines() == 0) {
+        setError("No OCR engines are available");
+        return false;
+    }
+
+    ctx.ocr.reset(dpsoOcrCreateDefault(0));
+    if (!ctx.ocr) {
+        setError("Can't create OCR: {}", dpsoGetError());
+        return false;
+    }
+
+    if (!activateLangs(ctx.ocr.get(), ctx.cfg.get(), langCodes))
+        return false;
+
+    if (needHistory
+            && !openHistory(cfgDirPath, ctx.cfg.get(), ctx.history))
+        return false;
+
+    ctx.jobFlags = {};
+    if (dpsoCfgGetBool(
+            ctx.cfg.get(),
+            cfgKeyOcrSplitTextBlocks,
+            cfgDefaultValueOcrSplitTextBlocks))
+        ctx.jobFlags |= dpsoOcrJobTextSegmentation;
+
+    return true;
+}
+
+
+bool appendToHistory(
+    DpsoHistory* history, const DpsoOcrJobResult& result)
+{
+    const DpsoHistoryEntry entry{result.timestamp, result.text};
+    if (!dpsoHistoryAppend(history, &entry)) {
+        setError("Can't append to history: {}", dpsoGetError());
+        return false;
+    }
+
+    return true;
+}
+
+
+}
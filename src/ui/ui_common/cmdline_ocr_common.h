@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "dpso_ext/dpso_ext.h"
+#include "dpso_ocr/dpso_ocr.h"
+
+
+// Helpers for commands that run OCR without the GUI.
+
+
+namespace ui {
+
+
+struct CmdLineOcrCtx {
+    dpso::CfgUPtr cfg;
+    dpso::OcrUPtr ocr;
+    DpsoOcrJobFlags jobFlags;
+    // Null unless requested.
+    dpso::HistoryUPtr history;
+};
+
+
+// Call initStart() and initExePath(), load the program
+// configuration, create the OCR with either the given languages or
+// the configured ones if langCodes is empty, and open the history if
+// needHistory is true.
+//
+// On failure, sets an error message (dpsoGetError()) and returns
+// false.
+bool initCmdLineOcr(
+    int argc,
+    char* argv[],
+    const std::vector<std::string>& langCodes,
+    bool needHistory,
+    CmdLineOcrCtx& ctx);
+
+
+// On failure, sets an error message (dpsoGetError()) and returns
+// false.
+bool appendToHistory(
+    DpsoHistory* history, const DpsoOcrJobResult& result);
+
+
+}
@@ -1,10 +1,14 @@
+#include <atomic>
 #include <cstring>
 #include <iterator>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include "dpso_ext/history.h"
 #include "dpso_utils/error_get.h"
+#include "dpso_utils/os.h"
 
 #include "flow.h"
 #include "utils.h"
@@ -63,6 +67,51 @@ bool testCount(const DpsoHistory* history, int expected, int lineNum)
 
 
 const auto* const historyFileName = "test_history.txt";
+const auto* const historyIndexFileName = "test_history.txt.idx";
+const auto* const historySearchIndexFileName =
+    "test_history.txt.search";
+const auto* const historySegmentsFileName =
+    "test_history.txt.segments";
+
+// Segment files are named "<history file>.<number>[.lz]".
+const int maxTestSegmentNumber = 10;
+
+
+std::string getSegmentFileName(int number, bool compressed)
+{
+    return dpso::str::format(
+        "{}.{}{}", historyFileName, number, compressed ? ".lz" : "");
+}
+
+
+void removeHistoryFiles()
+{
+    test::utils::removeFile(historyFileName);
+    test::utils::removeFile(historyIndexFileName);
+    test::utils::removeFile(historySearchIndexFileName);
+    test::utils::removeFile(historySegmentsFileName);
+
+    for (int i = 1; i <= maxTestSegmentNumber; ++i) {
+        test::utils::removeFile(getSegmentFileName(i, false));
+        test::utils::removeFile(getSegmentFileName(i, true));
+    }
+}
+
+
+bool fileExists(std::string_view filePath)
+{
+    try {
+        dpso::os::getFileSize(filePath);
+    } catch (dpso::os::FileNotFoundError&) {
+        return false;
+    } catch (dpso::os::Error& e) {
+        removeHistoryFiles();
+        test::fatalError(
+            "os::getFileSize(\"{}\"): {}", filePath, e.what());
+    }
+
+    return true;
+}
 
 
 enum class IoTestMode {
@@ -115,7 +164,7 @@ void testIo(IoTestMode mode)
 
     dpso::HistoryUPtr history{dpsoHistoryOpen(historyFileName)};
     if (!history) {
-        test::utils::removeFile(historyFileName);
+        removeHistoryFiles();
         test::fatalError(
             "testlIO({}): dpsoHistoryOpen(\"{}\"): {}",
             mode, historyFileName, dpsoGetError());
@@ -130,7 +179,7 @@ void testIo(IoTestMode mode)
         if (mode == IoTestMode::write) {
             if (!dpsoHistoryAppend(history.get(), &test.inEntry)) {
                 history.reset();
-                test::utils::removeFile(historyFileName);
+                removeHistoryFiles();
 
                 test::fatalError(
                     "testIo(true): dpsoHistoryAppend(): {}",
@@ -144,6 +193,13 @@ void testIo(IoTestMode mode)
         dpsoHistoryGet(history.get(), i, &outEntry);
         CMP_ENTRIES(outEntry, test.outEntry);
     }
+
+    // Entries should remain intact after subsequent appends.
+    for (int i{}; i < static_cast<int>(numTests); ++i) {
+        DpsoHistoryEntry outEntry;
+        dpsoHistoryGet(history.get(), i, &outEntry);
+        CMP_ENTRIES(outEntry, tests[i].outEntry);
+    }
 }
 
 
@@ -231,7 +287,7 @@ void testTruncatedData()
         test::utils::printFirstDifference(test.finalData, finalData);
     }
 
-    test::utils::removeFile(historyFileName);
+    removeHistoryFiles();
 }
 
 
@@ -259,7 +315,558 @@ void testInvalidData()
             test.description);
     }
 
+    removeHistoryFiles();
+}
+
+
+void testEntries(
+    const DpsoHistory* history,
+    const std::vector<DpsoHistoryEntry>& expectedEntries,
+    int lineNum)
+{
+    if (!testCount(history, expectedEntries.size(), lineNum))
+        return;
+
+    for (int i{}; i < dpsoHistoryCount(history); ++i) {
+        DpsoHistoryEntry entry;
+        dpsoHistoryGet(history, i, &entry);
+        cmpEntries(entry, expectedEntries[i], lineNum);
+    }
+}
+
+
+#define TEST_ENTRIES(history, expectedEntries) \
+    testEntries(history, expectedEntries, __LINE__)
+
+
+dpso::HistoryUPtr openHistory(std::string_view contextInfo)
+{
+    dpso::HistoryUPtr history{dpsoHistoryOpen(historyFileName)};
+    if (!history) {
+        removeHistoryFiles();
+        test::fatalError(
+            "{}: dpsoHistoryOpen(\"{}\"): {}",
+            contextInfo, historyFileName, dpsoGetError());
+    }
+
+    return history;
+}
+
+
+void testIndex()
+{
+    removeHistoryFiles();
+
+    const std::vector<DpsoHistoryEntry> entries{
+        {"ts1", "text1"}, {"ts2", ""}, {"ts3", "text3"}};
+
+    {
+        auto history = openHistory("testIndex()");
+        for (const auto& entry : entries)
+            if (!dpsoHistoryAppend(history.get(), &entry)) {
+                history.reset();
+                removeHistoryFiles();
+                test::fatalError(
+                    "testIndex(): dpsoHistoryAppend(): {}",
+                    dpsoGetError());
+            }
+    }
+
+    const auto indexData = test::utils::loadText(
+        "testIndex()", historyIndexFileName);
+
+    // Valid index.
+    TEST_ENTRIES(openHistory("testIndex()").get(), entries);
+
+    // Damaged tail of the index should be truncated.
+    test::utils::saveText(
+        "testIndex()",
+        historyIndexFileName,
+        indexData + "garbage that doesn't fit a record");
+    TEST_ENTRIES(openHistory("testIndex()").get(), entries);
+
+    if (test::utils::loadText("testIndex()", historyIndexFileName)
+            != indexData)
+        test::failure("testIndex(): Damaged index was not repaired");
+
+    // Entries appended without updating the index.
+    test::utils::saveText(
+        "testIndex()",
+        historyFileName,
+        test::utils::loadText("testIndex()", historyFileName)
+            + "\f\nts4\n\ntext4");
+    auto extendedEntries = entries;
+    extendedEntries.push_back({"ts4", "text4"});
+    TEST_ENTRIES(openHistory("testIndex()").get(), extendedEntries);
+
+    // Stale index of a replaced history.
+    test::utils::saveText(
+        "testIndex()", historyFileName, "ts5\n\ntext5\f\nts");
+    const std::vector<DpsoHistoryEntry> replacedEntries{
+        {"ts5", "text5"}};
+    TEST_ENTRIES(openHistory("testIndex()").get(), replacedEntries);
+
+    // Missing index.
+    test::utils::removeFile(historyIndexFileName);
+    TEST_ENTRIES(openHistory("testIndex()").get(), replacedEntries);
+
+    // Clearing should also clear the index.
+    dpsoHistoryClear(openHistory("testIndex()").get());
+    TEST_ENTRIES(openHistory("testIndex()").get(), {});
+
+    removeHistoryFiles();
+}
+
+
+void testSyncModes()
+{
+    const struct {
+        DpsoHistorySyncMode mode;
+        int periodMs;
+    } tests[]{
+        {dpsoHistorySyncModePeriodic, 0},
+        {dpsoHistorySyncModePeriodic, 50},
+        {dpsoHistorySyncModeOnClose, 0},
+    };
+
+    const std::vector<DpsoHistoryEntry> entries{
+        {"ts1", "text1"}, {"ts2", "text2"}, {"ts3", "text3"}};
+
+    for (const auto& test : tests) {
+        removeHistoryFiles();
+
+        {
+            auto history = openHistory("testSyncModes()");
+            if (!dpsoHistorySetSyncMode(
+                    history.get(), test.mode, test.periodMs))
+                test::fatalError(
+                    "testSyncModes(): "
+                    "dpsoHistorySetSyncMode({}, {}): {}",
+                    test.mode, test.periodMs, dpsoGetError());
+
+            // Entries should be available right after appending.
+            for (std::size_t i{}; i < entries.size(); ++i) {
+                if (!dpsoHistoryAppend(history.get(), &entries[i]))
+                    test::fatalError(
+                        "testSyncModes(): dpsoHistoryAppend(): {}",
+                        dpsoGetError());
+
+                TEST_ENTRIES(
+                    history.get(),
+                    std::vector(
+                        entries.begin(), entries.begin() + i + 1));
+            }
+
+            if (!dpsoHistoryFlush(history.get()))
+                test::failure(
+                    "testSyncModes(): dpsoHistoryFlush(): {}",
+                    dpsoGetError());
+
+            TEST_ENTRIES(history.get(), entries);
+
+            if (!dpsoHistoryClear(history.get()))
+                test::fatalError(
+                    "testSyncModes(): dpsoHistoryClear(): {}",
+                    dpsoGetError());
+
+            for (const auto& entry : entries)
+                dpsoHistoryAppend(history.get(), &entry);
+        }
+
+        // Closing should write everything.
+        TEST_ENTRIES(openHistory("testSyncModes()").get(), entries);
+    }
+
+    removeHistoryFiles();
+}
+
+
+void testSearch(
+    const DpsoHistory* history,
+    const char* query,
+    const std::vector<int>& expectedIndices,
+    int lineNum)
+{
+    const auto numFound = dpsoHistorySearch(
+        history, query, nullptr, 0);
+
+    std::vector<int> indices(numFound);
+    dpsoHistorySearch(history, query, indices.data(), indices.size());
+
+    if (indices == expectedIndices)
+        return;
+
+    const auto toStr = [](const std::vector<int>& v)
+    {
+        return test::utils::toStr(
+            v, [](int i){ return std::to_string(i); });
+    };
+
+    test::failure(
+        "line {}: dpsoHistorySearch(\"{}\"): Expected {}, got {}",
+        lineNum,
+        query,
+        toStr(expectedIndices),
+        toStr(indices));
+}
+
+
+#define TEST_SEARCH(history, query, ...) \
+    testSearch(history, query, __VA_ARGS__, __LINE__)
+
+
+void testSearch()
+{
+    removeHistoryFiles();
+
+    const DpsoHistoryEntry entries[]{
+        {"ts0", "The quick brown fox"},
+        {"ts1", "jumps over"},
+        {"ts2", "the LAZY dog"},
+        {"ts3", "Quick, quick!"},
+        {"ts4", ""},
+    };
+
+    {
+        auto history = openHistory("testSearch()");
+        for (const auto& entry : entries)
+            dpsoHistoryAppend(history.get(), &entry);
+
+        const auto* h = history.get();
+
+        TEST_SEARCH(h, "", {0, 1, 2, 3, 4});
+        TEST_SEARCH(h, "o", {0, 1, 2});
+        TEST_SEARCH(h, "the", {0, 2});
+        TEST_SEARCH(h, "QUICK", {0, 3});
+        TEST_SEARCH(h, "lazy dog", {2});
+        TEST_SEARCH(h, "quick brown cat", {});
+        // All trigrams match, but not as a substring.
+        TEST_SEARCH(h, "quick quick", {});
+
+        // The index should be updated by appending.
+        const DpsoHistoryEntry entry{"ts5", "a lazy cat"};
+        dpsoHistoryAppend(history.get(), &entry);
+        TEST_SEARCH(h, "lazy", {2, 5});
+
+        int indices[1]{};
+        const auto numFound = dpsoHistorySearch(
+            h, "quick", indices, 1);
+        if (numFound != 2 || indices[0] != 0)
+            test::failure(
+                "testSearch(): dpsoHistorySearch() with a short "
+                "array: Unexpected result {} {}",
+                numFound, indices[0]);
+    }
+
+    // The saved index should be reused and extended with the entries
+    // that were appended without it.
+    {
+        auto history = openHistory("testSearch()");
+        const DpsoHistoryEntry entry{"ts6", "lazy"};
+        dpsoHistoryAppend(history.get(), &entry);
+    }
+
+    TEST_SEARCH(openHistory("testSearch()").get(), "lazy", {2, 5, 6});
+
+    // Stale index of a replaced history.
+    test::utils::saveText(
+        "testSearch()", historyFileName, "ts\n\nlazy fox");
+    TEST_SEARCH(openHistory("testSearch()").get(), "lazy", {0});
+
+    // Damaged index.
+    test::utils::saveText(
+        "testSearch()", historySearchIndexFileName, "garbage");
+    TEST_SEARCH(openHistory("testSearch()").get(), "fox", {0});
+
+    {
+        auto history = openHistory("testSearch()");
+        TEST_SEARCH(history.get(), "fox", {0});
+        dpsoHistoryClear(history.get());
+        TEST_SEARCH(history.get(), "fox", {});
+    }
+
+    removeHistoryFiles();
+}
+
+
+void testRotation(bool compress)
+{
+    removeHistoryFiles();
+
+    const auto contextInfo = dpso::str::format(
+        "testRotation({})", test::utils::toStr(compress));
+
+    const std::vector<DpsoHistoryEntry> entries{
+        {"ts0", "text0"},
+        {"ts1", ""},
+        {"ts2 \f", "text2\n\n"},
+        {"ts3", "text3"},
+        {"", "text4"},
+    };
+
+    const auto appendEntries = [&](DpsoHistory* history)
+    {
+        for (const auto& entry : entries)
+            if (!dpsoHistoryAppend(history, &entry))
+                test::fatalError(
+                    "{}: dpsoHistoryAppend(): {}",
+                    contextInfo, dpsoGetError());
+    };
+
+    {
+        auto history = openHistory(contextInfo);
+        dpsoHistorySetRotation(history.get(), 0, 2, compress);
+        // Sealing should flush entries written in the background.
+        dpsoHistorySetSyncMode(
+            history.get(), dpsoHistorySyncModeOnClose, 0);
+
+        appendEntries(history.get());
+        TEST_ENTRIES(history.get(), entries);
+        TEST_SEARCH(history.get(), "text", {0, 2, 3, 4});
+    }
+
+    for (int i = 1; i <= 2; ++i)
+        if (!fileExists(getSegmentFileName(i, compress))
+                || fileExists(getSegmentFileName(i, !compress)))
+            test::failure(
+                "{}: Unexpected files of segment {}", contextInfo, i);
+
+    if (fileExists(getSegmentFileName(3, compress)))
+        test::failure("{}: Unexpected segment 3", contextInfo);
+
+    TEST_ENTRIES(openHistory(contextInfo).get(), entries);
+    TEST_SEARCH(openHistory(contextInfo).get(), "text", {0, 2, 3, 4});
+
+    // Sealing that was interrupted before updating the list of
+    // segments.
+    test::utils::saveText(
+        contextInfo,
+        getSegmentFileName(3, false),
+        test::utils::loadText(contextInfo, historyFileName));
     test::utils::removeFile(historyFileName);
+    TEST_ENTRIES(openHistory(contextInfo).get(), entries);
+
+    // Size limit.
+    {
+        auto history = openHistory(contextInfo);
+        dpsoHistorySetRotation(history.get(), 1, 0, compress);
+
+        auto allEntries = entries;
+        allEntries.insert(
+            allEntries.end(), entries.begin(), entries.end());
+
+        appendEntries(history.get());
+        TEST_ENTRIES(history.get(), allEntries);
+    }
+
+    // Every entry except the last one should be in its own segment.
+    // The segment is compressed in the background, so we check after
+    // closing the history, which waits for the compression.
+    if (!fileExists(getSegmentFileName(7, compress)))
+        test::failure(
+            "{}: Size limit didn't seal segments", contextInfo);
+
+    {
+        auto history = openHistory(contextInfo);
+        if (!dpsoHistoryClear(history.get()))
+            test::failure(
+                "{}: dpsoHistoryClear(): {}",
+                contextInfo, dpsoGetError());
+
+        TEST_ENTRIES(history.get(), {});
+    }
+
+    TEST_ENTRIES(openHistory(contextInfo).get(), {});
+
+    for (int i = 1; i <= maxTestSegmentNumber; ++i)
+        if (fileExists(getSegmentFileName(i, false))
+                || fileExists(getSegmentFileName(i, true)))
+            test::failure(
+                "{}: dpsoHistoryClear() didn't remove segment {}",
+                contextInfo, i);
+
+    removeHistoryFiles();
+}
+
+
+void testRotation()
+{
+    testRotation(false);
+    testRotation(true);
+}
+
+
+void testManyEntries()
+{
+    removeHistoryFiles();
+
+    const auto* contextInfo = "testManyEntries";
+
+    // Enough data for the appended entries to be moved from memory
+    // to the file mapping several times.
+    std::vector<std::string> texts;
+    for (int i{}; i < 300; ++i)
+        texts.push_back(
+            dpso::str::format("text{}", i) + std::string(1000, 'a'));
+
+    std::vector<DpsoHistoryEntry> entries;
+    for (const auto& text : texts)
+        entries.push_back({"ts", text.c_str()});
+
+    {
+        auto history = openHistory(contextInfo);
+        for (const auto& entry : entries)
+            if (!dpsoHistoryAppend(history.get(), &entry))
+                test::fatalError(
+                    "{}: dpsoHistoryAppend(): {}",
+                    contextInfo, dpsoGetError());
+
+        TEST_ENTRIES(history.get(), entries);
+    }
+
+    TEST_ENTRIES(openHistory(contextInfo).get(), entries);
+
+    removeHistoryFiles();
+}
+
+
+void testEntryLifetime()
+{
+    removeHistoryFiles();
+
+    const auto* contextInfo = "testEntryLifetime";
+
+    std::vector<std::string> timestamps;
+    std::vector<std::string> texts;
+    for (int i{}; i < 10; ++i) {
+        timestamps.push_back(dpso::str::format("ts{}", i));
+        texts.push_back(dpso::str::format("text{}", i));
+    }
+
+    const auto append = [&](DpsoHistory* history, std::size_t idx)
+    {
+        const DpsoHistoryEntry entry{
+            timestamps[idx].c_str(), texts[idx].c_str()};
+        if (!dpsoHistoryAppend(history, &entry))
+            test::fatalError(
+                "{}: dpsoHistoryAppend(): {}",
+                contextInfo, dpsoGetError());
+    };
+
+    {
+        auto history = openHistory(contextInfo);
+        dpsoHistorySetRotation(history.get(), 0, 3, false);
+
+        for (std::size_t i{}; i < 8; ++i)
+            append(history.get(), i);
+    }
+
+    // Entries from segments, the mapped file, and memory.
+    const auto history = openHistory(contextInfo);
+    for (std::size_t i = 8; i < texts.size(); ++i)
+        append(history.get(), i);
+
+    // All strings should stay valid till the history is modified,
+    // even though segments are loaded and unloaded in between.
+    std::vector<DpsoHistoryEntry> entries(texts.size());
+    for (std::size_t i{}; i < entries.size(); ++i)
+        dpsoHistoryGet(history.get(), i, &entries[i]);
+
+    dpsoHistorySearch(history.get(), "text", nullptr, 0);
+
+    for (std::size_t i{}; i < entries.size(); ++i)
+        if (entries[i].timestamp != timestamps[i]
+                || entries[i].text != texts[i])
+            test::failure(
+                "{}: Entry {} has changed to {{\"{}\", \"{}\"}}",
+                contextInfo, i, entries[i].timestamp,
+                entries[i].text);
+
+    removeHistoryFiles();
+}
+
+
+void testConcurrentGet()
+{
+    removeHistoryFiles();
+
+    const auto* contextInfo = "testConcurrentGet";
+
+    std::vector<std::string> timestamps;
+    std::vector<std::string> texts;
+    for (int i{}; i < 20; ++i) {
+        timestamps.push_back(dpso::str::format("ts{}", i));
+        texts.push_back(dpso::str::format("text{}", i));
+    }
+
+    {
+        auto history = openHistory(contextInfo);
+        dpsoHistorySetRotation(history.get(), 0, 6, true);
+
+        for (std::size_t i{}; i < texts.size(); ++i) {
+            const DpsoHistoryEntry entry{
+                timestamps[i].c_str(), texts[i].c_str()};
+            if (!dpsoHistoryAppend(history.get(), &entry))
+                test::fatalError(
+                    "{}: dpsoHistoryAppend(): {}",
+                    contextInfo, dpsoGetError());
+        }
+    }
+
+    // Reopen so that the entries of the active segment are read from
+    // the file rather than from memory.
+    const auto history = openHistory(contextInfo);
+
+    std::atomic<int> numMismatches{};
+
+    std::vector<std::thread> threads;
+    for (int i{}; i < 4; ++i)
+        threads.emplace_back(
+            [&, i]
+            {
+                // Threads start from different entries so that they
+                // load different segments.
+                for (std::size_t j{}; j < texts.size() * 3; ++j) {
+                    const auto idx = (j + i * 5) % texts.size();
+
+                    DpsoHistoryEntry entry;
+                    dpsoHistoryGet(history.get(), idx, &entry);
+
+                    if (entry.timestamp != timestamps[idx]
+                            || entry.text != texts[idx])
+                        ++numMismatches;
+                }
+            });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (numMismatches > 0)
+        test::failure(
+            "{}: {} entries don't match",
+            contextInfo, numMismatches.load());
+
+    // The first of the concurrent searches builds the index.
+    threads.clear();
+    std::atomic<int> numSearchFailures{};
+    for (int i{}; i < 4; ++i)
+        threads.emplace_back(
+            [&]
+            {
+                if (dpsoHistorySearch(
+                        history.get(), "text1", nullptr, 0) != 11)
+                    ++numSearchFailures;
+            });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (numSearchFailures > 0)
+        test::failure(
+            "{}: {} concurrent searches failed",
+            contextInfo, numSearchFailures.load());
+
+    removeHistoryFiles();
 }
 
 
@@ -269,6 +876,13 @@ void testHistory()
     testIo(IoTestMode::read);
     testTruncatedData();
     testInvalidData();
+    testIndex();
+    testSyncModes();
+    testSearch();
+    testRotation();
+    testManyEntries();
+    testEntryLifetime();
+    testConcurrentGet();
 }
 
 
@@ -401,6 +401,10 @@ void testExport()
     }
 
     test::utils::removeFile(historyFileName);
+    test::utils::removeFile(
+        std::string{historyFileName} + ".idx");
+    test::utils::removeFile(
+        std::string{historyFileName} + ".search");
 }
 
 
@@ -0,0 +1,146 @@
+#include <cstdint>
+
+#include "dpso_img/img.h"
+
+#include "dpso_utils/error_get.h"
+
+#include "flow.h"
+
+
+namespace {
+
+
+struct ReleaseInfo {
+    int numCalls;
+};
+
+
+void release(void* userData)
+{
+    ++static_cast<ReleaseInfo*>(userData)->numCalls;
+}
+
+
+void testCreateFromData()
+{
+    std::uint8_t data[3 * 8];
+    ReleaseInfo releaseInfo{};
+
+    auto* img = dpsoImgCreateFromData(
+        DpsoPxFormatRgb, 2, 3, 8, data, release, &releaseInfo);
+    if (!img) {
+        test::failure("dpsoImgCreateFromData(): {}", dpsoGetError());
+        return;
+    }
+
+    if (dpsoImgGetPxFormat(img) != DpsoPxFormatRgb
+            || dpsoImgGetWidth(img) != 2
+            || dpsoImgGetHeight(img) != 3
+            || dpsoImgGetPitch(img) != 8)
+        test::failure(
+            "dpsoImgCreateFromData(): unexpected {} {}x{} image with "
+            "pitch {}",
+            dpsoPxFormatToStr(dpsoImgGetPxFormat(img)),
+            dpsoImgGetWidth(img),
+            dpsoImgGetHeight(img),
+            dpsoImgGetPitch(img));
+
+    if (dpsoImgGetData(img) != data)
+        test::failure(
+            "dpsoImgCreateFromData(): image doesn't use the data");
+
+    if (releaseInfo.numCalls != 0)
+        test::failure(
+            "dpsoImgCreateFromData(): data released before the image "
+            "is deleted");
+
+    dpsoImgDelete(img);
+
+    if (releaseInfo.numCalls != 1)
+        test::failure(
+            "dpsoImgDelete(): release function called {} times "
+            "instead of 1",
+            releaseInfo.numCalls);
+}
+
+
+void testCreateFromDataMinPitch()
+{
+    std::uint8_t data[4 * 2];
+
+    auto* img = dpsoImgCreateFromData(
+        DpsoPxFormatBgra, 2, 1, 0, data, nullptr, nullptr);
+    if (!img) {
+        test::failure(
+            "dpsoImgCreateFromData() with null releaseFn: {}",
+            dpsoGetError());
+        return;
+    }
+
+    if (dpsoImgGetPitch(img) != 8)
+        test::failure(
+            "dpsoImgCreateFromData() with pitch 0: expected pitch 8, "
+            "got {}",
+            dpsoImgGetPitch(img));
+
+    dpsoImgDelete(img);
+}
+
+
+void testCreateFromDataFailure()
+{
+    std::uint8_t data[16];
+    ReleaseInfo releaseInfo{};
+
+    const struct {
+        int w;
+        int h;
+        int pitch;
+        std::uint8_t* data;
+    } tests[]{
+        {0, 1, 0, data},
+        {1, 0, 0, data},
+        {4, 1, 3, data},
+        {1, 1, 0, nullptr},
+    };
+
+    for (const auto& test : tests) {
+        auto* img = dpsoImgCreateFromData(
+            DpsoPxFormatGrayscale,
+            test.w,
+            test.h,
+            test.pitch,
+            test.data,
+            release,
+            &releaseInfo);
+        if (img) {
+            test::failure(
+                "dpsoImgCreateFromData(Grayscale, {}, {}, {}, {}): "
+                "expected failure",
+                test.w,
+                test.h,
+                test.pitch,
+                test.data ? "data" : "nullptr");
+            dpsoImgDelete(img);
+        }
+    }
+
+    if (releaseInfo.numCalls != 0)
+        test::failure(
+            "dpsoImgCreateFromData(): release function called on "
+            "failure");
+}
+
+
+void testImg()
+{
+    testCreateFromData();
+    testCreateFromDataMinPitch();
+    testCreateFromDataFailure();
+}
+
+
+}
+
+
+REGISTER_TEST(testImg);
@@ -0,0 +1,450 @@
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <utility>
+#include <vector>
+
+#include "dpso_img/ops.h"
+#include "dpso_img/upscale_fixed_point.h"
+
+#include "dpso_utils/thread_pool.h"
+
+#include "flow.h"
+
+
+using namespace dpso;
+
+
+namespace {
+
+
+void testEstimateTextLineHeight()
+{
+    const struct Test {
+        // Each line is {y, h} filled with "ink" on a light background.
+        std::initializer_list<std::pair<int, int>> lines;
+        int expectedHeight;
+    } tests[]{
+        {{}, 0},
+        {{{5, 7}}, 7},
+        {{{0, 10}, {20, 10}, {40, 10}}, 10},
+        {{{2, 8}, {20, 12}, {40, 12}}, 12},
+        // Touches the bottom edge
+        {{{50, 10}}, 10},
+    };
+
+    const auto w = 100;
+    const auto h = 60;
+    const auto pitch = w + 3;
+
+    for (const auto& test : tests) {
+        std::vector<std::uint8_t> img(pitch * h, 230);
+
+        for (const auto& [lineY, lineH] : test.lines)
+            for (auto y = lineY; y < lineY + lineH; ++y)
+                // Glyph-like pattern: every other group of pixels.
+                for (int x{}; x < w; ++x)
+                    if (x % 6 < 3)
+                        img[y * pitch + x] = 20;
+
+        const auto got = img::estimateTextLineHeight(
+            img.data(), pitch, w, h);
+        if (got != test.expectedHeight)
+            test::failure(
+                "img::estimateTextLineHeight(): "
+                "expected {}, got {} for {} lines",
+                test.expectedHeight,
+                got,
+                test.lines.size());
+    }
+}
+
+
+// Fill the buffer with text-like noise: mostly a light background
+// with dark pixels.
+void fillRandom(std::vector<std::uint8_t>& data, unsigned seed)
+{
+    for (auto& v : data) {
+        seed = seed * 1103515245 + 12345;
+        const auto r = seed >> 16;
+        v = r % 5 == 0 ? r % 64 : 192 + r % 64;
+    }
+}
+
+
+void testUpscale()
+{
+    const struct Test {
+        int srcW;
+        int srcH;
+        int dstW;
+        int dstH;
+    } tests[]{
+        {1, 1, 1, 1},
+        {1, 1, 4, 4},
+        {37, 23, 37, 23},
+        {37, 23, 74, 46},
+        {40, 3, 160, 12},
+        {3, 40, 9, 120},
+        // Non-integer scales
+        {50, 30, 203, 121},
+        {37, 23, 50, 30},
+        // Wide enough for all SIMD versions
+        {300, 200, 1200, 800},
+    };
+
+    for (const auto& test : tests) {
+        const auto srcPitch = test.srcW + 3;
+        std::vector<std::uint8_t> src(srcPitch * test.srcH);
+        fillRandom(src, test.srcW * test.srcH);
+
+        const auto dstPitch = test.dstW + 1;
+        std::vector<std::uint8_t> expected(dstPitch * test.dstH);
+        img::upscaleReference(
+            src.data(), test.srcW, test.srcH, srcPitch,
+            expected.data(), test.dstW, test.dstH, dstPitch);
+
+        std::vector<std::uint8_t> got(dstPitch * test.dstH);
+        img::Upscale{}(
+            src.data(), test.srcW, test.srcH, srcPitch,
+            got.data(), test.dstW, test.dstH, dstPitch);
+
+        for (int y{}; y < test.dstH; ++y)
+            for (int x{}; x < test.dstW; ++x) {
+                const auto i = y * dstPitch + x;
+                if (std::abs(got[i] - expected[i]) <= 1)
+                    continue;
+
+                test::failure(
+                    "img::Upscale: {}x{} -> {}x{}: "
+                    "expected {} (+-1) at {}x{}, got {}",
+                    test.srcW, test.srcH, test.dstW, test.dstH,
+                    expected[i], x, y, got[i]);
+                y = test.dstH;
+                break;
+            }
+    }
+}
+
+
+void testUpscaleVRow()
+{
+    // Worst-case overshoot of the filter on black and white pixels.
+    const std::int16_t extremes[]{
+        -20 * (1 << img::upscaleTmpFracBits),
+        275 * (1 << img::upscaleTmpFracBits)};
+
+    const auto w = 100;
+    std::vector<std::int16_t> rows[img::upscaleNumTaps];
+    unsigned seed{};
+    for (auto& row : rows) {
+        row.resize(w);
+        for (int x{}; x < w; ++x) {
+            seed = seed * 1103515245 + 12345;
+            row[x] = x < 8
+                ? extremes[(seed >> 16) % 2]
+                : (seed >> 16) % (256 << img::upscaleTmpFracBits);
+        }
+    }
+
+    const std::int16_t* rowPtrs[img::upscaleNumTaps];
+    for (int k{}; k < img::upscaleNumTaps; ++k)
+        rowPtrs[k] = rows[k].data();
+
+    const float weightsList[][img::upscaleNumTaps]{
+        {0.0f, 1.0f, 0.0f, 0.0f},
+        {-0.0703125f, 0.8671875f, 0.2265625f, -0.0234375f},
+        {-0.0625f, 0.5625f, 0.5625f, -0.0625f},
+    };
+
+    for (const auto& floatWeights : weightsList) {
+        std::int16_t weights[img::upscaleNumTaps];
+        for (int k{}; k < img::upscaleNumTaps; ++k)
+            weights[k] = img::toUpscaleWeight(floatWeights[k]);
+        img::normalizeUpscaleWeights(weights, 1);
+
+        // Different widths to cover the scalar tails.
+        for (const auto rowW : {1, 7, 8, 15, 16, 33, w}) {
+            std::vector<std::uint8_t> expected(rowW);
+            img::upscaleVRowScalar(
+                rowPtrs, weights, expected.data(), rowW);
+
+            std::vector<std::uint8_t> got(rowW);
+            img::upscaleVRow(rowPtrs, weights, got.data(), rowW);
+
+            if (got != expected)
+                test::failure(
+                    "img::upscaleVRow() doesn't match "
+                    "img::upscaleVRowScalar() with width {}",
+                    rowW);
+        }
+    }
+}
+
+
+void testPreprocess()
+{
+    const struct Test {
+        DpsoPxFormat pxFormat;
+        int srcW;
+        int srcH;
+        int dstW;
+        int dstH;
+        int radius;
+    } tests[]{
+        {DpsoPxFormatGrayscale, 1, 1, 1, 1, 1},
+        {DpsoPxFormatGrayscale, 1, 1, 4, 4, 10},
+        {DpsoPxFormatGrayscale, 37, 23, 37, 23, 2},
+        {DpsoPxFormatRgb, 37, 23, 74, 46, 5},
+        {DpsoPxFormatBgra, 40, 3, 160, 12, 10},
+        {DpsoPxFormatArgb, 3, 40, 9, 120, 7},
+        {DpsoPxFormatAbgr, 50, 30, 203, 121, 10},
+        // Tall enough for several stripes
+        {DpsoPxFormatRgba, 300, 200, 1200, 800, 10},
+    };
+
+    for (const auto& test : tests) {
+        const auto bpp = dpsoPxFormatGetBytesPerPx(test.pxFormat);
+        const auto srcPitch = test.srcW * bpp + 3;
+        std::vector<std::uint8_t> src(srcPitch * test.srcH);
+        fillRandom(src, test.srcW * test.srcH);
+
+        std::vector<std::uint8_t> gray(test.srcW * test.srcH);
+        img::toGray(
+            src.data(), srcPitch, test.pxFormat,
+            gray.data(), test.srcW,
+            test.srcW, test.srcH);
+
+        const auto dstPitch = test.dstW + 1;
+        std::vector<std::uint8_t> upscaled(dstPitch * test.dstH);
+        img::Upscale{}(
+            gray.data(), test.srcW, test.srcH, test.srcW,
+            upscaled.data(), test.dstW, test.dstH, dstPitch);
+
+        std::vector<std::uint8_t> expected(dstPitch * test.dstH);
+        img::UnsharpMask{}(
+            upscaled.data(), dstPitch,
+            expected.data(), dstPitch,
+            test.dstW, test.dstH,
+            test.radius);
+
+        std::vector<std::uint8_t> got(dstPitch * test.dstH);
+        img::Preprocess{}(
+            src.data(), srcPitch, test.pxFormat,
+            test.srcW, test.srcH,
+            got.data(), dstPitch,
+            test.dstW, test.dstH,
+            test.radius);
+
+        for (int y{}; y < test.dstH; ++y)
+            for (int x{}; x < test.dstW; ++x) {
+                const auto i = y * dstPitch + x;
+                if (got[i] == expected[i])
+                    continue;
+
+                test::failure(
+                    "img::Preprocess: {} {}x{} -> {}x{}, radius {}: "
+                    "expected {} at {}x{}, got {}",
+                    dpsoPxFormatToStr(test.pxFormat),
+                    test.srcW, test.srcH, test.dstW, test.dstH,
+                    test.radius,
+                    expected[i], x, y, got[i]);
+                // Report only the first mismatch.
+                y = test.dstH;
+                break;
+            }
+    }
+}
+
+
+void testConvertPxFormat()
+{
+    // The same pixel (R 10, G 20, B 30, A 40) in every format.
+    const struct Px {
+        DpsoPxFormat pxFormat;
+        std::vector<std::uint8_t> data;
+    } pixels[]{
+        {DpsoPxFormatGrayscale, {img::rgbToGray(10, 20, 30)}},
+        {DpsoPxFormatRgb, {10, 20, 30}},
+        {DpsoPxFormatBgr, {30, 20, 10}},
+        {DpsoPxFormatRgba, {10, 20, 30, 40}},
+        {DpsoPxFormatBgra, {30, 20, 10, 40}},
+        {DpsoPxFormatArgb, {40, 10, 20, 30}},
+        {DpsoPxFormatAbgr, {40, 30, 20, 10}},
+    };
+
+    for (const auto& src : pixels) {
+        // Converting from grayscale loses colors.
+        if (src.pxFormat == DpsoPxFormatGrayscale)
+            continue;
+
+        const auto srcHasAlpha =
+            img::getChannelOffsets(src.pxFormat).a != -1;
+
+        for (const auto& dst : pixels) {
+            auto expected = dst.data;
+
+            const auto dstAlpha =
+                img::getChannelOffsets(dst.pxFormat).a;
+            if (dstAlpha != -1 && !srcHasAlpha)
+                expected[dstAlpha] = 255;
+
+            std::vector<std::uint8_t> got(expected.size());
+            img::convertPxFormat(
+                src.data.data(), 0, src.pxFormat,
+                got.data(), 0, dst.pxFormat,
+                1, 1);
+
+            if (got != expected)
+                test::failure(
+                    "img::convertPxFormat(): {} -> {}: "
+                    "unexpected result",
+                    dpsoPxFormatToStr(src.pxFormat),
+                    dpsoPxFormatToStr(dst.pxFormat));
+        }
+    }
+
+    const std::uint8_t gray{77};
+    std::uint8_t got[4]{};
+    img::convertPxFormat(
+        &gray, 0, DpsoPxFormatGrayscale,
+        got, 0, DpsoPxFormatBgra,
+        1, 1);
+    if (got[0] != gray || got[1] != gray || got[2] != gray
+            || got[3] != 255)
+        test::failure(
+            "img::convertPxFormat(): Grayscale -> Bgra: "
+            "unexpected result");
+}
+
+
+// The parallel versions should give exactly the same results as the
+// serial ones.
+void testParallel()
+{
+    ThreadPool threadPool{3};
+
+    const auto srcW = 400;
+    const auto srcH = 300;
+    const auto pxFormat = DpsoPxFormatBgra;
+    const auto srcPitch = srcW * dpsoPxFormatGetBytesPerPx(pxFormat);
+    std::vector<std::uint8_t> src(srcPitch * srcH);
+    fillRandom(src, 1);
+
+    const auto check = [](
+        const char* name,
+        const std::vector<std::uint8_t>& got,
+        const std::vector<std::uint8_t>& expected)
+    {
+        if (got != expected)
+            test::failure(
+                "Parallel {} doesn't match the serial one", name);
+    };
+
+    std::vector<std::uint8_t> gray(srcW * srcH);
+    img::toGray(
+        src.data(), srcPitch, pxFormat,
+        gray.data(), srcW,
+        srcW, srcH);
+
+    std::vector<std::uint8_t> got(gray.size());
+    img::toGray(
+        src.data(), srcPitch, pxFormat,
+        got.data(), srcW,
+        srcW, srcH,
+        &threadPool);
+    check("img::toGray()", got, gray);
+
+    const auto dstW = srcW * 4;
+    const auto dstH = srcH * 4;
+    const auto radius = 10;
+
+    img::Upscale upscale;
+    std::vector<std::uint8_t> upscaled(dstW * dstH);
+    upscale(
+        gray.data(), srcW, srcH, srcW,
+        upscaled.data(), dstW, dstH, dstW);
+
+    upscale.setThreadPool(&threadPool);
+    got.resize(upscaled.size());
+    upscale(
+        gray.data(), srcW, srcH, srcW,
+        got.data(), dstW, dstH, dstW);
+    check("img::Upscale", got, upscaled);
+
+    img::UnsharpMask unsharpMask;
+    std::vector<std::uint8_t> sharpened(dstW * dstH);
+    unsharpMask(
+        upscaled.data(), dstW,
+        sharpened.data(), dstW,
+        dstW, dstH,
+        radius);
+
+    unsharpMask.setThreadPool(&threadPool);
+    unsharpMask(
+        upscaled.data(), dstW,
+        got.data(), dstW,
+        dstW, dstH,
+        radius);
+    check("img::UnsharpMask", got, sharpened);
+
+    img::Preprocess preprocess;
+    preprocess.setThreadPool(&threadPool);
+    // Twice to check that reusing the bands works.
+    for (int i{}; i < 2; ++i) {
+        std::fill(got.begin(), got.end(), 0);
+        preprocess(
+            src.data(), srcPitch, pxFormat,
+            srcW, srcH,
+            got.data(), dstW,
+            dstW, dstH,
+            radius);
+        check("img::Preprocess", got, sharpened);
+    }
+
+    // A wide image split into bands shorter than the minimum stripe
+    // height.
+    const auto wideSrcW = 25000;
+    const auto wideSrcH = 3;
+    const auto wideSrcPitch =
+        wideSrcW * dpsoPxFormatGetBytesPerPx(pxFormat);
+    std::vector<std::uint8_t> wideSrc(wideSrcPitch * wideSrcH);
+    fillRandom(wideSrc, 1);
+
+    const auto wideDstW = wideSrcW * 4;
+    const auto wideDstH = wideSrcH * 4;
+
+    std::vector<std::uint8_t> wideExpected(wideDstW * wideDstH);
+    img::Preprocess{}(
+        wideSrc.data(), wideSrcPitch, pxFormat,
+        wideSrcW, wideSrcH,
+        wideExpected.data(), wideDstW,
+        wideDstW, wideDstH,
+        radius);
+
+    got.assign(wideExpected.size(), 0);
+    preprocess(
+        wideSrc.data(), wideSrcPitch, pxFormat,
+        wideSrcW, wideSrcH,
+        got.data(), wideDstW,
+        wideDstW, wideDstH,
+        radius);
+    check("img::Preprocess with short bands", got, wideExpected);
+}
+
+
+void testOps()
+{
+    testEstimateTextLineHeight();
+    testUpscale();
+    testUpscaleVRow();
+    testPreprocess();
+    testConvertPxFormat();
+    testParallel();
+}
+
+
+}
+
+
+REGISTER_TEST(testOps);
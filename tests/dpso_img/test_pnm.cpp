@@ -0,0 +1,160 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "dpso_img/pnm.h"
+
+#include "dpso_utils/error_get.h"
+
+#include "flow.h"
+#include "utils.h"
+
+
+using namespace dpso;
+
+
+namespace {
+
+
+const auto* const pnmFileName = "test_pnm.pnm";
+
+
+void testSaveLoad(DpsoPxFormat pxFormat)
+{
+    const auto w = 5;
+    const auto h = 3;
+    const auto bpp = dpsoPxFormatGetBytesPerPx(pxFormat);
+    // Padding should not be saved.
+    const auto pitch = w * bpp + 3;
+
+    std::vector<std::uint8_t> data(pitch * h);
+    for (std::size_t i{}; i < data.size(); ++i)
+        data[i] = i * 7;
+
+    img::savePnm(pnmFileName, pxFormat, data.data(), w, h, pitch);
+
+    const auto img = img::loadPnm(pnmFileName);
+    if (!img) {
+        test::failure(
+            "loadPnm() for {}: {}",
+            dpsoPxFormatToStr(pxFormat), dpsoGetError());
+        return;
+    }
+
+    if (dpsoImgGetPxFormat(img.get()) != pxFormat
+            || dpsoImgGetWidth(img.get()) != w
+            || dpsoImgGetHeight(img.get()) != h) {
+        test::failure(
+            "loadPnm() for {}: unexpected {} {}x{} image",
+            dpsoPxFormatToStr(pxFormat),
+            dpsoPxFormatToStr(dpsoImgGetPxFormat(img.get())),
+            dpsoImgGetWidth(img.get()),
+            dpsoImgGetHeight(img.get()));
+        return;
+    }
+
+    for (int y{}; y < h; ++y)
+        if (std::memcmp(
+                dpsoImgGetConstData(img.get())
+                    + y * dpsoImgGetPitch(img.get()),
+                data.data() + y * pitch,
+                w * bpp) != 0)
+            test::failure(
+                "loadPnm() for {}: row {} doesn't match",
+                dpsoPxFormatToStr(pxFormat), y);
+}
+
+
+// The image uses a private mapping of the file.
+void testModifyLoaded()
+{
+    const std::uint8_t data[]{1, 2, 3, 4};
+    img::savePnm(
+        pnmFileName, DpsoPxFormatGrayscale, data, 2, 2, 2);
+
+    if (auto img = img::loadPnm(pnmFileName))
+        std::memset(dpsoImgGetData(img.get()), 0, sizeof(data));
+    else {
+        test::failure("loadPnm(): {}", dpsoGetError());
+        return;
+    }
+
+    const auto img = img::loadPnm(pnmFileName);
+    if (!img) {
+        test::failure("loadPnm(): {}", dpsoGetError());
+        return;
+    }
+
+    if (std::memcmp(
+            dpsoImgGetConstData(img.get()), data, sizeof(data)) != 0)
+        test::failure("Modifying a loaded image changed the file");
+}
+
+
+void testLoad()
+{
+    const struct {
+        std::string data;
+        bool isValid;
+    } tests[]{
+        {"P5 1 1 255 x", true},
+        {"P5\n# Comment\n2 # Another comment\n1\n255\nxy", true},
+        {"P6\r\n1\t1\r\n255\r\nrgb", true},
+        // Trailing data is ignored.
+        {"P5 1 1 255 xyz", true},
+
+        {"", false},
+        {"P", false},
+        {"P2 1 1 255 1", false},
+        {"P5", false},
+        {"P51 1 255 x", false},
+        {"P5 1 1 255", false},
+        {"P5 1 1 255x", false},
+        {"P5 0 1 255 ", false},
+        {"P5 1 -1 255 x", false},
+        {"P5 1 1 65535 xx", false},
+        {"P5 100000 1 255 x", false},
+        // Truncated pixel data.
+        {"P5 2 1 255 x", false},
+        {"P6 1 1 255 rg", false},
+    };
+
+    for (const auto& test : tests) {
+        test::utils::saveText("testLoad", pnmFileName, test.data);
+
+        const auto img = img::loadPnm(pnmFileName);
+        if (static_cast<bool>(img) == test.isValid)
+            continue;
+
+        if (img)
+            test::failure(
+                "loadPnm({}): expected failure",
+                test::utils::escapeStr(test.data));
+        else
+            test::failure(
+                "loadPnm({}): {}",
+                test::utils::escapeStr(test.data),
+                dpsoGetError());
+    }
+
+    if (img::loadPnm("nonexistent_test_pnm.pnm"))
+        test::failure("loadPnm() for a nonexistent file succeeded");
+}
+
+
+void testPnm()
+{
+    testSaveLoad(DpsoPxFormatGrayscale);
+    testSaveLoad(DpsoPxFormatRgb);
+    testModifyLoaded();
+    testLoad();
+
+    test::utils::removeFile(pnmFileName);
+}
+
+
+}
+
+
+REGISTER_TEST(testPnm);
@@ -0,0 +1,60 @@
+#include <poll.h>
+
+#include "dpso_ocr/notifier.h"
+
+#include "flow.h"
+
+
+using namespace dpso;
+using namespace dpso::ocr;
+
+
+namespace {
+
+
+bool isReadable(const Notifier& notifier)
+{
+    pollfd pfd{notifier.getFd(), POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+
+void testNotifier()
+{
+    Notifier notifier;
+    if (notifier.getFd() == -1)
+        test::fatalError("Notifier::getFd() returned -1");
+
+    if (isReadable(notifier))
+        test::failure("Notifier is readable before notify()");
+
+    notifier.clear();
+    if (isReadable(notifier))
+        test::failure("Notifier is readable after empty clear()");
+
+    // Many notifications should be collapsed by a single clear(),
+    // even if they overflow the pipe.
+    for (int i{}; i < 100000; ++i)
+        notifier.notify();
+
+    if (!isReadable(notifier))
+        test::failure("Notifier is not readable after notify()");
+
+    notifier.clear();
+    if (isReadable(notifier))
+        test::failure("Notifier is readable after clear()");
+
+    notifier.notify();
+    if (!isReadable(notifier))
+        test::failure(
+            "Notifier is not readable after notify() following "
+            "clear()");
+
+    notifier.clear();
+}
+
+
+}
+
+
+REGISTER_TEST(testNotifier);
@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "dpso_ocr/result_cache.h"
+#include "dpso_utils/error_get.h"
+#include "dpso_utils/str.h"
+
+#include "flow.h"
+#include "utils.h"
+
+
+using namespace dpso;
+using namespace dpso::ocr;
+
+
+namespace {
+
+
+const auto* const cacheFileName = "test_result_cache.txt";
+
+
+img::ImgUPtr createImg(int w, int h, int pitch, std::uint8_t seed)
+{
+    img::ImgUPtr img{
+        dpsoImgCreate(DpsoPxFormatGrayscale, w, h, pitch)};
+    if (!img)
+        test::fatalError("dpsoImgCreate() failed");
+
+    auto* data = dpsoImgGetData(img.get());
+    for (int y{}; y < h; ++y)
+        for (int x{}; x < dpsoImgGetPitch(img.get()); ++x)
+            // The padding should not affect the key.
+            data[y * dpsoImgGetPitch(img.get()) + x] =
+                x < w ? seed + x * y : x;
+
+    return img;
+}
+
+
+ResultCache::Key createKey(int idx)
+{
+    return {{static_cast<std::uint64_t>(idx), 0}};
+}
+
+
+void testFind(
+    ResultCache& cache,
+    const ResultCache::Key& key,
+    const std::optional<std::string>& expected,
+    int lineNum)
+{
+    const auto got = cache.find(key);
+    if (got == expected)
+        return;
+
+    test::failure(
+        "line {}: ResultCache::find(): expected {}, got {}",
+        lineNum,
+        expected ? test::utils::toStr(*expected) : "nullopt",
+        got ? test::utils::toStr(*got) : "nullopt");
+}
+
+
+#define TEST_FIND(cache, key, expected) \
+    testFind(cache, key, expected, __LINE__)
+
+
+void testMakeKey()
+{
+    const auto key = ResultCache::makeKey(
+        *createImg(10, 10, 0, 1), "eng");
+
+    if (!(ResultCache::makeKey(*createImg(10, 10, 16, 1), "eng")
+            == key))
+        test::failure(
+            "ResultCache::makeKey(): pitch affects the key");
+
+    if (ResultCache::makeKey(*createImg(10, 10, 0, 2), "eng") == key)
+        test::failure(
+            "ResultCache::makeKey(): pixels don't affect the key");
+
+    if (ResultCache::makeKey(*createImg(10, 10, 0, 1), "deu") == key)
+        test::failure(
+            "ResultCache::makeKey(): params don't affect the key");
+
+    if (ResultCache::makeKey(*createImg(20, 5, 0, 1), "eng") == key)
+        test::failure(
+            "ResultCache::makeKey(): size doesn't affect the key");
+}
+
+
+void testLru()
+{
+    ResultCache cache;
+
+    cache.insert(createKey(1), "a");
+    TEST_FIND(cache, createKey(1), std::nullopt);
+    if (cache.getIsEnabled())
+        test::failure("ResultCache is enabled by default");
+
+    cache.configure(2, "");
+
+    cache.insert(createKey(1), "a");
+    cache.insert(createKey(2), "b");
+    // Make 1 the most recently used.
+    TEST_FIND(cache, createKey(1), "a");
+    cache.insert(createKey(3), "c");
+
+    TEST_FIND(cache, createKey(1), "a");
+    TEST_FIND(cache, createKey(2), std::nullopt);
+    TEST_FIND(cache, createKey(3), "c");
+
+    const auto stats = cache.getStats();
+    if (stats.numHits != 3 || stats.numMisses != 1)
+        test::failure(
+            "ResultCache::getStats(): expected 3 hits and 1 miss, "
+            "got {} and {}",
+            stats.numHits, stats.numMisses);
+
+    cache.clear();
+    TEST_FIND(cache, createKey(1), std::nullopt);
+}
+
+
+void testFile()
+{
+    test::utils::removeFile(cacheFileName);
+
+    {
+        ResultCache cache;
+        if (!cache.configure(3, cacheFileName))
+            test::fatalError(
+                "ResultCache::configure(): {}", dpsoGetError());
+
+        // Enough inserts to trigger a rewrite.
+        for (int i{}; i < 10; ++i)
+            cache.insert(createKey(i), "text\n" + str::toStr(i));
+    }
+
+    {
+        ResultCache cache;
+        cache.configure(2, cacheFileName);
+
+        TEST_FIND(cache, createKey(6), std::nullopt);
+        TEST_FIND(cache, createKey(7), std::nullopt);
+        TEST_FIND(cache, createKey(8), "text\n8");
+        TEST_FIND(cache, createKey(9), "text\n9");
+    }
+
+    // Truncated entry.
+    auto data = test::utils::loadText("testFile", cacheFileName);
+    data.pop_back();
+    test::utils::saveText("testFile", cacheFileName, data);
+
+    {
+        ResultCache cache;
+        cache.configure(2, cacheFileName);
+
+        TEST_FIND(cache, createKey(8), "text\n8");
+        TEST_FIND(cache, createKey(9), std::nullopt);
+
+        cache.clear();
+    }
+
+    {
+        ResultCache cache;
+        cache.configure(2, cacheFileName);
+        TEST_FIND(cache, createKey(8), std::nullopt);
+    }
+
+    test::utils::removeFile(cacheFileName);
+}
+
+
+void testResultCache()
+{
+    testMakeKey();
+    testLru();
+    testFile();
+}
+
+
+}
+
+
+REGISTER_TEST(testResultCache);
@@ -0,0 +1,133 @@
+#include <cstddef>
+#include <limits>
+#include <random>
+#include <string>
+
+#include "dpso_utils/lz.h"
+
+#include "flow.h"
+#include "utils.h"
+
+
+static std::string getRandomData(std::size_t size, int numSymbols)
+{
+    std::mt19937 rng;
+    std::uniform_int_distribution<int> dist{0, numSymbols - 1};
+
+    std::string result;
+    for (std::size_t i{}; i < size; ++i)
+        result += static_cast<char>(dist(rng));
+
+    return result;
+}
+
+
+static std::string repeat(std::string_view str, std::size_t count)
+{
+    std::string result;
+    for (std::size_t i{}; i < count; ++i)
+        result += str;
+
+    return result;
+}
+
+
+static void testRoundTrip()
+{
+    std::string text;
+    for (int i{}; i < 1000; ++i)
+        text += dpso::str::format(
+            "2024-01-01 12:00:{}\n\nRecognized text {}\f\n",
+            i % 60, i);
+
+    const struct {
+        const char* description;
+        std::string data;
+    } tests[]{
+        {"empty", ""},
+        {"short", "abc"},
+        {"minimal match", "abcdabcd"},
+        {"overlapping match", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"},
+        {"long literals", getRandomData(1000, 256)},
+        {"long match", repeat("0123456789", 1000)},
+        // Close to the maximum expansion of compressed data.
+        {"very long match", std::string(1000000, 'a')},
+        {"text", text},
+        {"binary", getRandomData(200000, 4)},
+        {"far match", repeat(getRandomData(70000, 256), 2)},
+    };
+
+    for (const auto& test : tests) {
+        const auto compressed = dpso::lz::compress(test.data);
+
+        std::string decompressed;
+        if (!dpso::lz::decompress(
+                compressed, test.data.size(), decompressed)) {
+            test::failure(
+                "{}: lz::decompress() failed", test.description);
+            continue;
+        }
+
+        if (decompressed != test.data)
+            test::failure(
+                "{}: decompressed data doesn't match the original",
+                test.description);
+    }
+
+    if (const auto compressed = dpso::lz::compress(text);
+            compressed.size() > text.size() / 2)
+        test::failure(
+            "Text is compressed poorly: {} to {} bytes",
+            text.size(), compressed.size());
+}
+
+
+static void testDamagedData()
+{
+    const std::string data = repeat("Some text. ", 100);
+    const auto compressed = dpso::lz::compress(data);
+
+    std::string decompressed;
+
+    if (dpso::lz::decompress(
+            compressed, data.size() + 1, decompressed))
+        test::failure("lz::decompress() accepted a wrong size");
+
+    // Sizes from damaged headers should be rejected before
+    // allocation.
+    for (const auto size : {
+            compressed.size() * 255 + 1,
+            std::numeric_limits<std::size_t>::max()})
+        if (dpso::lz::decompress(compressed, size, decompressed))
+            test::failure(
+                "lz::decompress() accepted size {}", size);
+
+    if (dpso::lz::decompress(
+            compressed.substr(0, compressed.size() / 2),
+            data.size(),
+            decompressed))
+        test::failure("lz::decompress() accepted truncated data");
+
+    // Every damaged byte should either be rejected or produce data of
+    // the expected size, without reading or writing out of bounds.
+    for (std::size_t i{}; i < compressed.size(); ++i) {
+        auto damaged = compressed;
+        damaged[i] = ~damaged[i];
+
+        if (dpso::lz::decompress(damaged, data.size(), decompressed)
+                && decompressed.size() != data.size())
+            test::failure(
+                "Damaged byte {}: unexpected data size {}",
+                i, decompressed.size());
+    }
+}
+
+
+static void testLz()
+{
+    testRoundTrip();
+    testDamagedData();
+}
+
+
+REGISTER_TEST(testLz);
@@ -0,0 +1,112 @@
+#include <cstring>
+#include <string_view>
+
+#include "dpso_utils/mapped_file.h"
+#include "dpso_utils/os_error.h"
+
+#include "flow.h"
+#include "utils.h"
+
+
+using namespace dpso;
+
+
+namespace {
+
+
+const auto* const testFileName = "test_mapped_file.txt";
+
+
+void testMap()
+{
+    const std::string_view text{"abc\0def", 7};
+    test::utils::saveText("testMap", testFileName, text);
+
+    try {
+        os::MappedFile file{testFileName};
+
+        if (file.getSize() != text.size()
+                || std::memcmp(
+                    file.getData(), text.data(), text.size()) != 0) {
+            test::failure("MappedFile: unexpected data");
+            return;
+        }
+
+        if (file.getWritableData())
+            test::failure(
+                "MappedFile::getWritableData(): expected null for "
+                "Mode::readOnly");
+
+        os::MappedFile cowFile{
+            testFileName, os::MappedFile::Mode::copyOnWrite};
+        if (!cowFile.getWritableData()) {
+            test::failure(
+                "MappedFile::getWritableData(): expected non-null "
+                "for Mode::copyOnWrite");
+            return;
+        }
+
+        // The mapping is private.
+        cowFile.getWritableData()[0] = 'x';
+    } catch (os::Error& e) {
+        test::failure(
+            "MappedFile(\"{}\"): {}", testFileName, e.what());
+        return;
+    }
+
+    const auto loadedText = test::utils::loadText(
+        "testMap", testFileName);
+    if (loadedText != text)
+        test::failure(
+            "Modifying MappedFile data changed the file to {}",
+            test::utils::toStr(loadedText));
+}
+
+
+void testMapEmpty()
+{
+    test::utils::saveText("testMapEmpty", testFileName, "");
+
+    try {
+        const os::MappedFile file{testFileName};
+        if (file.getData() || file.getSize() != 0)
+            test::failure(
+                "MappedFile for an empty file: expected null data");
+    } catch (os::Error& e) {
+        test::failure(
+            "MappedFile(\"{}\"): {}", testFileName, e.what());
+    }
+}
+
+
+void testMapNonexistent()
+{
+    try {
+        const os::MappedFile file{"nonexistent_test_mapped_file"};
+        test::failure(
+            "MappedFile for a nonexistent file: expected "
+            "FileNotFoundError");
+    } catch (os::FileNotFoundError&) {
+    } catch (os::Error& e) {
+        test::failure(
+            "MappedFile for a nonexistent file: expected "
+            "FileNotFoundError, got \"{}\"",
+            e.what());
+    }
+}
+
+
+void testMappedFile()
+{
+    testMap();
+    testMapEmpty();
+    testMapNonexistent();
+
+    test::utils::removeFile(testFileName);
+}
+
+
+}
+
+
+REGISTER_TEST(testMappedFile);
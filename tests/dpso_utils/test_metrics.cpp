@@ -0,0 +1,204 @@
+#include "dpso_utils/metrics.h"
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "flow.h"
+
+
+using namespace dpso;
+using namespace dpso::metrics;
+
+
+namespace {
+
+
+void testBuckets()
+{
+    for (int i{}; i < Histogram::numBuckets; ++i) {
+        const auto lowerBound = Histogram::getBucketLowerBound(i);
+        if (Histogram::getBucketIdx(lowerBound) != i)
+            test::failure(
+                "Histogram::getBucketIdx({}): expected {}, got {}",
+                lowerBound, i, Histogram::getBucketIdx(lowerBound));
+
+        if (i == 0)
+            continue;
+
+        const auto prevLowerBound =
+            Histogram::getBucketLowerBound(i - 1);
+        if (prevLowerBound >= lowerBound)
+            test::failure(
+                "Histogram bucket bounds are not increasing: "
+                "{} >= {} for bucket {}",
+                prevLowerBound, lowerBound, i);
+
+        if (Histogram::getBucketIdx(lowerBound - 1) != i - 1)
+            test::failure(
+                "Histogram::getBucketIdx({}): expected {}, got {}",
+                lowerBound - 1,
+                i - 1,
+                Histogram::getBucketIdx(lowerBound - 1));
+
+        // A bucket should not span more than 25% of its lower bound.
+        if (prevLowerBound >= 4
+                && (lowerBound - prevLowerBound) * 4 > prevLowerBound)
+            test::failure(
+                "Histogram bucket {} [{}, {}) is too wide",
+                i - 1, prevLowerBound, lowerBound);
+    }
+
+    if (Histogram::getBucketIdx(-1) != Histogram::numBuckets - 1)
+        test::failure(
+            "Histogram::getBucketIdx(max): expected the last bucket, "
+            "got {}",
+            Histogram::getBucketIdx(-1));
+}
+
+
+void testQuantiles()
+{
+    Histogram histogram;
+
+    auto s = histogram.getSnapshot();
+    if (s.count != 0 || s.getQuantileUs(0.5) != 0)
+        test::failure("Empty Histogram has non-zero values");
+
+    for (int i = 1; i <= 10000; ++i)
+        histogram.record(i);
+
+    s = histogram.getSnapshot();
+
+    if (s.count != 10000)
+        test::failure(
+            "Histogram count: expected 10000, got {}", s.count);
+    if (s.maxUs != 10000)
+        test::failure(
+            "Histogram max: expected 10000, got {}", s.maxUs);
+    if (s.getMeanUs() != 5000.5)
+        test::failure(
+            "Histogram mean: expected 5000.5, got {}",
+            s.getMeanUs());
+
+    const struct {
+        double q;
+        double expected;
+    } tests[]{
+        {0, 1},
+        {0.5, 5000},
+        {0.9, 9000},
+        {0.99, 9900},
+        {1, 10000},
+    };
+
+    for (const auto& test : tests) {
+        const auto got = s.getQuantileUs(test.q);
+        // Values are uniform, so interpolation within buckets should
+        // give nearly exact results.
+        if (std::abs(got - test.expected) > test.expected * 0.01)
+            test::failure(
+                "Histogram quantile {}: expected {}, got {}",
+                test.q, test.expected, got);
+    }
+
+    histogram.record(std::chrono::milliseconds{20});
+    if (histogram.getSnapshot().maxUs != 20000)
+        test::failure(
+            "Histogram::record(duration): expected max 20000, "
+            "got {}",
+            histogram.getSnapshot().maxUs);
+}
+
+
+void testConcurrentRecording()
+{
+    Registry registry;
+    auto& counter = registry.getCounter("events");
+    auto& histogram = registry.getHistogram("latency_us");
+
+    const auto numThreads = 4;
+    const auto numIterations = 10000;
+
+    std::vector<std::thread> threads;
+    for (int i{}; i < numThreads; ++i)
+        threads.emplace_back(
+            [&, i]
+            {
+                for (int j{}; j < numIterations; ++j) {
+                    counter.add();
+                    histogram.record(i * numIterations + j);
+                }
+            });
+
+    for (auto& thread : threads)
+        thread.join();
+
+    if (counter.get() != numThreads * numIterations)
+        test::failure(
+            "Counter: expected {}, got {}",
+            numThreads * numIterations, counter.get());
+
+    const auto s = histogram.getSnapshot();
+    if (s.count != numThreads * numIterations)
+        test::failure(
+            "Histogram count: expected {}, got {}",
+            numThreads * numIterations, s.count);
+    if (s.maxUs != numThreads * numIterations - 1)
+        test::failure(
+            "Histogram max: expected {}, got {}",
+            numThreads * numIterations - 1, s.maxUs);
+}
+
+
+void testRegistry()
+{
+    Registry registry;
+
+    if (registry.toJson()
+            != "{\n  \"counters\": {},\n  \"histograms\": {}\n}\n")
+        test::failure(
+            "Empty Registry::toJson(): got {}", registry.toJson());
+
+    auto& counter = registry.getCounter("b");
+    if (&registry.getCounter("b") != &counter)
+        test::failure(
+            "Registry::getCounter() returned different counters for "
+            "the same name");
+
+    counter.add(3);
+    registry.getCounter("a").add();
+    registry.getHistogram("c_us").record(5);
+
+    const auto* expected =
+        "{\n"
+        "  \"counters\": {\n"
+        "    \"a\": 1,\n"
+        "    \"b\": 3\n"
+        "  },\n"
+        "  \"histograms\": {\n"
+        "    \"c_us\": {\"count\": 1, \"sum\": 5, \"mean\": 5, "
+        "\"p50\": 5, \"p90\": 5, \"p99\": 5, \"max\": 5, "
+        "\"buckets\": [[5, 1]]}\n"
+        "  }\n"
+        "}\n";
+    if (registry.toJson() != expected)
+        test::failure(
+            "Registry::toJson(): expected:\n{}\ngot:\n{}",
+            expected, registry.toJson());
+}
+
+
+void testMetrics()
+{
+    testBuckets();
+    testQuantiles();
+    testConcurrentRecording();
+    testRegistry();
+}
+
+
+}
+
+
+REGISTER_TEST(testMetrics);
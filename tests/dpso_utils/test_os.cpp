@@ -79,10 +79,39 @@ void testLoadData()
 }
 
 
+void testSaveData()
+{
+    const std::string_view filePath{"test_save_data.txt"};
+
+    for (const auto* data : {"abc", ""})
+        try {
+            os::saveData(filePath, data);
+
+            const auto loadedData = os::loadData(filePath);
+            if (loadedData != data)
+                test::failure(
+                    "os::saveData(\"{}\", \"{}\"): file contains "
+                    "\"{}\"",
+                    filePath, data, loadedData);
+        } catch (os::Error& e) {
+            test::failure(
+                "os::saveData(\"{}\", \"{}\"): {}",
+                filePath, data, e.what());
+        }
+
+    test::utils::removeFile(filePath);
+
+    // The temporary file should be gone.
+    CHECK_FILE_NOT_FOUND_ERROR(
+        os::loadData, "test_save_data.txt.tmp");
+}
+
+
 void testOs()
 {
     testSyncDir();
     testLoadData();
+    testSaveData();
 }
 
 
@@ -158,6 +158,20 @@ void testToStr()
 }
 
 
+void testEscapeJsonStr()
+{
+    using dpso::str::escapeJsonStr;
+
+    TEST_STR(escapeJsonStr(""), "");
+    TEST_STR(escapeJsonStr("a b \xd1\x84"), "a b \xd1\x84");
+    TEST_STR(escapeJsonStr("\"a\\b\""), "\\\"a\\\\b\\\"");
+    TEST_STR(escapeJsonStr("a\nb\rc\td"), "a\\nb\\rc\\td");
+    TEST_STR(
+        escapeJsonStr(std::string_view{"\0\x01\x1f\x20", 4}),
+        "\\u0000\\u0001\\u001f ");
+}
+
+
 void testFormat()
 {
     using namespace dpso;
@@ -216,6 +230,7 @@ void testStr()
     testJustify();
     testTrim();
     testToStr();
+    testEscapeJsonStr();
     testFormat();
 }
 
@@ -0,0 +1,61 @@
+#include "dpso_utils/thread_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "flow.h"
+
+
+using namespace dpso;
+
+
+static void testThreadPool()
+{
+    for (const auto numThreads : {0, 1, 3}) {
+        ThreadPool threadPool{numThreads};
+
+        if (threadPool.getConcurrency() != numThreads + 1)
+            test::failure(
+                "ThreadPool{{{}}}.getConcurrency(): expected {}, "
+                "got {}",
+                numThreads,
+                numThreads + 1,
+                threadPool.getConcurrency());
+
+        // Several threads sharing the pool.
+        const auto numCallers = 4;
+        const auto numTasks = 100;
+        std::vector<std::atomic<int>> counters(numCallers * numTasks);
+
+        std::vector<std::thread> callers;
+        for (int callerIdx{}; callerIdx < numCallers; ++callerIdx)
+            callers.emplace_back(
+                [&, callerIdx]
+                {
+                    threadPool.parallelFor(
+                        numTasks,
+                        [&](int taskIdx)
+                        {
+                            ++counters[
+                                callerIdx * numTasks + taskIdx];
+                        });
+                });
+
+        for (auto& caller : callers)
+            caller.join();
+
+        for (std::size_t i{}; i < counters.size(); ++i)
+            if (counters[i] != 1)
+                test::failure(
+                    "ThreadPool{{{}}}.parallelFor(): task {} of "
+                    "caller {} was called {} times",
+                    numThreads,
+                    i % numTasks,
+                    i / numTasks,
+                    counters[i].load());
+    }
+}
+
+
+REGISTER_TEST(testThreadPool);
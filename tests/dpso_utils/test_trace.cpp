@@ -0,0 +1,104 @@
+#include "dpso_utils/trace.h"
+
+#include <string>
+#include <thread>
+
+#include "flow.h"
+#include "utils.h"
+
+
+using namespace dpso;
+using namespace dpso::trace;
+
+
+namespace {
+
+
+const auto* const traceFileName = "test_trace.json";
+
+
+std::size_t countOccurrences(
+    const std::string& str, const std::string& substr)
+{
+    std::size_t result{};
+    for (auto pos = str.find(substr);
+            pos != str.npos;
+            pos = str.find(substr, pos + substr.size()))
+        ++result;
+
+    return result;
+}
+
+
+void testTrace()
+{
+    {
+        Recorder recorder;
+        recorder.setThreadName(
+            std::this_thread::get_id(), "Main \"thread\"");
+
+        recorder.addAsyncBegin("job", 7);
+
+        std::thread thread{
+            [&]
+            {
+                const Span span{&recorder, "work", 7};
+                const Span nestedSpan{&recorder, "step"};
+            }};
+        recorder.setThreadName(thread.get_id(), "Worker");
+        thread.join();
+
+        recorder.addAsyncEnd("job", 7);
+
+        // A null recorder should be ignored.
+        const Span span{nullptr, "ignored"};
+
+        recorder.saveJson(traceFileName);
+    }
+
+    const auto json = test::utils::loadText(
+        "testTrace", traceFileName);
+
+    const struct {
+        const char* substr;
+        std::size_t count;
+    } tests[]{
+        {"{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n", 1},
+        {"\"thread_name\"", 2},
+        {"\"args\": {\"name\": \"Main \\\"thread\\\"\"}", 1},
+        {"\"args\": {\"name\": \"Worker\"}", 1},
+        {"\"name\": \"job\", \"cat\": \"dpso\", \"ph\": \"b\"", 1},
+        {"\"name\": \"job\", \"cat\": \"dpso\", \"ph\": \"e\"", 1},
+        {"\"id\": 7}", 2},
+        {"\"name\": \"work\", \"cat\": \"dpso\", \"ph\": \"X\"", 1},
+        {"\"args\": {\"job\": 7}}", 1},
+        {"\"name\": \"step\", \"cat\": \"dpso\", \"ph\": \"X\"", 1},
+        {"\"dur\": ", 2},
+        {"ignored", 0},
+        {"\n], \"otherData\": {\"numDroppedEvents\": \"0\"}}\n", 1},
+    };
+
+    auto failed = false;
+    for (const auto& test : tests)
+        if (const auto count = countOccurrences(json, test.substr);
+                count != test.count) {
+            failed = true;
+            test::failure(
+                "Recorder::saveJson(): expected {} occurrences of "
+                "{}, got {}",
+                test.count,
+                test::utils::escapeStr(test.substr),
+                count);
+        }
+
+    if (failed)
+        test::failure("Trace:\n{}", json);
+
+    test::utils::removeFile(traceFileName);
+}
+
+
+}
+
+
+REGISTER_TEST(testTrace);